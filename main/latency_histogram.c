@@ -0,0 +1,66 @@
+/* Airgradient Outdoor Sensor V1.1 firmware using ESP-IDF
+ * Copyright (C) 2023 Zach Strauss
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+#include "latency_histogram.h"
+
+/**
+ * @brief Bucket a duration falls into, floor(log2(duration)) capped to the last bucket
+ */
+static int latency_histogram_bucket(uint32_t duration)
+{
+    if (duration < 2) {
+        return 0;
+    }
+    int bucket = 31 - __builtin_clz(duration);
+    return bucket < LATENCY_HISTOGRAM_BUCKETS ? bucket : LATENCY_HISTOGRAM_BUCKETS - 1;
+}
+
+void latency_histogram_add(latency_histogram_t *histogram, uint32_t duration)
+{
+    histogram->buckets[latency_histogram_bucket(duration)]++;
+    histogram->count++;
+    histogram->sum += duration;
+    if (duration > histogram->max) {
+        histogram->max = duration;
+    }
+}
+
+uint32_t latency_histogram_percentile(const latency_histogram_t *histogram, int percent)
+{
+    if (!histogram->count) {
+        return 0;
+    }
+    /* rank of the sample, rounded up so the 100th percentile is the last sample */
+    uint32_t rank = (uint32_t) (((uint64_t) histogram->count * percent + 99) / 100);
+    uint32_t seen = 0;
+    for (int bucket = 0; bucket < LATENCY_HISTOGRAM_BUCKETS - 1; bucket++) {
+        seen += histogram->buckets[bucket];
+        if (seen >= rank) {
+            uint32_t bound = (2u << bucket) - 1;
+            return bound < histogram->max ? bound : histogram->max;
+        }
+    }
+    return histogram->max;
+}
+
+int latency_histogram_used_buckets(const latency_histogram_t *histogram)
+{
+    int used = LATENCY_HISTOGRAM_BUCKETS;
+    while (used > 0 && !histogram->buckets[used - 1]) {
+        used--;
+    }
+    return used;
+}
@@ -0,0 +1,57 @@
+/* Airgradient Outdoor Sensor V1.1 firmware using ESP-IDF
+ * Copyright (C) 2023 Zach Strauss
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+#pragma once
+
+#include <stdint.h>
+
+/**
+ * Number of buckets, the last one also holds everything above 2^24 us (16.8 s)
+ */
+#define LATENCY_HISTOGRAM_BUCKETS (24)
+
+/**
+ * Fixed size log2 scale histogram of durations in microseconds
+ * @details Bucket 0 holds 0 and 1 us, bucket n holds [2^n, 2^(n+1)) us
+ */
+typedef struct {
+    uint32_t buckets[LATENCY_HISTOGRAM_BUCKETS]; /*!< sample count per bucket */
+    uint32_t count; /*!< samples added */
+    uint64_t sum; /*!< sum of all samples, in us */
+    uint32_t max; /*!< largest sample, in us */
+} latency_histogram_t;
+
+/**
+ * @brief Add one duration
+ * @param histogram histogram instance
+ * @param duration duration in us
+ */
+void latency_histogram_add(latency_histogram_t *histogram, uint32_t duration);
+
+/**
+ * @brief Estimate a percentile
+ * @param histogram histogram instance
+ * @param percent percentile to estimate, 1 to 100
+ * @return upper bound of the bucket holding the percentile, clamped to the largest sample, 0 when empty
+ */
+uint32_t latency_histogram_percentile(const latency_histogram_t *histogram, int percent);
+
+/**
+ * @brief Number of buckets up to and including the last non-empty one
+ * @param histogram histogram instance
+ * @return bucket count worth reporting
+ */
+int latency_histogram_used_buckets(const latency_histogram_t *histogram);
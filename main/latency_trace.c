@@ -0,0 +1,55 @@
+/* Airgradient Outdoor Sensor V1.1 firmware using ESP-IDF
+ * Copyright (C) 2023 Zach Strauss
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+#include <string.h>
+#include "latency_trace.h"
+#include "freertos/FreeRTOS.h"
+#include "esp_timer.h"
+
+#if CONFIG_LATENCY_TRACE
+static const char *const LATENCY_STAGE_NAME[LATENCY_STAGE_COUNT] = {
+        "parse", "post", "handoff", "aggregate", "deliver", "enqueue", "total", "ack"
+};
+
+static latency_histogram_t latency_histograms[LATENCY_STAGE_COUNT];
+static portMUX_TYPE latency_lock = portMUX_INITIALIZER_UNLOCKED;
+
+uint32_t latency_trace_now(void)
+{
+    return (uint32_t) esp_timer_get_time();
+}
+
+void latency_trace_record(latency_stage_t stage, uint32_t since)
+{
+    uint32_t duration = latency_trace_now() - since;
+    taskENTER_CRITICAL(&latency_lock);
+    latency_histogram_add(&latency_histograms[stage], duration);
+    taskEXIT_CRITICAL(&latency_lock);
+}
+
+void latency_trace_take(latency_histogram_t *histograms)
+{
+    taskENTER_CRITICAL(&latency_lock);
+    memcpy(histograms, latency_histograms, sizeof(latency_histograms));
+    memset(latency_histograms, 0, sizeof(latency_histograms));
+    taskEXIT_CRITICAL(&latency_lock);
+}
+
+const char *latency_trace_stage_name(latency_stage_t stage)
+{
+    return LATENCY_STAGE_NAME[stage];
+}
+#endif
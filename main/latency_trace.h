@@ -0,0 +1,78 @@
+/* Airgradient Outdoor Sensor V1.1 firmware using ESP-IDF
+ * Copyright (C) 2023 Zach Strauss
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+#pragma once
+
+#include <stdint.h>
+#include "latency_histogram.h"
+#include "sdkconfig.h"
+
+/**
+ * Pipeline stages timed from a frame arriving on the UART to its reading being handed to the MQTT client
+ * @details With CONFIG_PMS5003_REACTOR the driver calls the manager directly, so there is no post/handoff split:
+ * both stages only time the way to that call and stay near zero.
+ */
+typedef enum {
+    LATENCY_STAGE_PARSE, /*!< UART data event to frame parsed and validated */
+    LATENCY_STAGE_POST, /*!< committing the reading to the manager's ring and notifying the manager task */
+    LATENCY_STAGE_HANDOFF, /*!< reading committed to taken by the manager */
+    LATENCY_STAGE_AGGREGATE, /*!< reducing a finished burst to one reading and filling in the derived fields */
+    LATENCY_STAGE_DELIVER, /*!< manager reading committed to its ring to handled by the main event loop */
+    LATENCY_STAGE_ENQUEUE, /*!< reading handled to every topic queued with the MQTT client */
+    LATENCY_STAGE_TOTAL, /*!< UART data event of a burst's last frame to its reading queued with the MQTT client */
+    LATENCY_STAGE_ACK, /*!< QoS 1 backlog batch published to acknowledged by the broker */
+    LATENCY_STAGE_COUNT
+} latency_stage_t;
+
+#if CONFIG_LATENCY_TRACE
+/**
+ * Current time for stamping a stage, 0 when tracing is compiled out
+ */
+#define LATENCY_TRACE_NOW() latency_trace_now()
+/**
+ * Record the time from a stamp until now against a stage, compiles to nothing when tracing is compiled out
+ */
+#define LATENCY_TRACE_RECORD(stage, since) latency_trace_record((stage), (since))
+#else
+#define LATENCY_TRACE_NOW() (0)
+#define LATENCY_TRACE_RECORD(stage, since) ((void) (since))
+#endif
+
+/**
+ * @brief Current time for stamping a stage
+ * @return microseconds since boot, wraps every 71 minutes
+ */
+uint32_t latency_trace_now(void);
+
+/**
+ * @brief Record the time from a stamp until now against a stage, safe to call from any task
+ * @param stage stage the time was spent in
+ * @param since stamp taken with latency_trace_now() when the stage started
+ */
+void latency_trace_record(latency_stage_t stage, uint32_t since);
+
+/**
+ * @brief Copy out the histogram of every stage and start new ones
+ * @param histograms receives LATENCY_STAGE_COUNT histograms, indexed by latency_stage_t
+ */
+void latency_trace_take(latency_histogram_t *histograms);
+
+/**
+ * @brief Short name of a stage for reports
+ * @param stage stage
+ * @return stage name
+ */
+const char *latency_trace_stage_name(latency_stage_t stage);
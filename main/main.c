@@ -14,16 +14,17 @@
  * You should have received a copy of the GNU General Public License
  * along with this program.  If not, see <https://www.gnu.org/licenses/>.
  */
+#include <stdlib.h>
 #include <string.h>
 
 #include "freertos/FreeRTOS.h"
 #include "freertos/task.h"
-#include "freertos/event_groups.h"
 
 #include "esp_system.h"
-#include "esp_wifi.h"
 #include "esp_event.h"
 #include "esp_log.h"
+#include "esp_timer.h"
+#include "esp_pm.h"
 
 #include "nvs_flash.h"
 #include "driver/uart.h"
@@ -33,125 +34,288 @@
 #include "pms5003t.h"
 #include "pms5003_manager.h"
 #include "stats_collector.h"
+#include "reading_log.h"
+#include "reading_aqi.h"
+#include "reading_fusion.h"
+#include "reading_format.h"
+#include "pms5003_scheduler.h"
+#include "latency_trace.h"
+#include "time_sync.h"
+#include "wifi_link.h"
 #include "mqtt_client.h"
 
 static const char *TAG = "openair_outdoor";
 
-#define OAG_WIFI_SSID      CONFIG_ESP_WIFI_SSID
-#define OAG_WIFI_PASS      CONFIG_ESP_WIFI_PASSWORD
-#define OAG_WIFI_MAXIMUM_RETRY  (5)
-
-#if CONFIG_ESP_WPA3_SAE_PWE_HUNT_AND_PECK
-#define ESP_WIFI_SAE_MODE WPA3_SAE_PWE_HUNT_AND_PECK
-#define OAG_H2E_IDENTIFIER ""
-#elif CONFIG_ESP_WPA3_SAE_PWE_HASH_TO_ELEMENT
-#define ESP_WIFI_SAE_MODE WPA3_SAE_PWE_HASH_TO_ELEMENT
-#define OAG_H2E_IDENTIFIER CONFIG_ESP_WIFI_PW_ID
-#elif CONFIG_ESP_WPA3_SAE_PWE_BOTH
-#define ESP_WIFI_SAE_MODE WPA3_SAE_PWE_BOTH
-#define OAG_H2E_IDENTIFIER CONFIG_ESP_WIFI_PW_ID
+ESP_EVENT_DEFINE_BASE(HOUSEKEEPING_EVENT);
+
+/**
+ * Main loop events of its own
+ */
+typedef enum {
+    HOUSEKEEPING_DUE /*!< time to run the periodic reports and forward the backlog */
+} housekeeping_event_id_t;
+
+/**
+ * Longest the main loop sleeps between housekeeping runs, the report intervals are checked this often
+ */
+#define HOUSEKEEPING_PERIOD_US (10 * 1000000LL)
+
+static esp_event_loop_handle_t main_events;
+static esp_timer_handle_t housekeeping_timer;
+#if CONFIG_PM_ENABLE
+static esp_pm_lock_handle_t dispatch_lock;
 #endif
 
-#if CONFIG_ESP_WIFI_AUTH_OPEN
-#define ESP_WIFI_SCAN_AUTH_MODE_THRESHOLD WIFI_AUTH_OPEN
-#elif CONFIG_ESP_WIFI_AUTH_WEP
-#define ESP_WIFI_SCAN_AUTH_MODE_THRESHOLD WIFI_AUTH_WEP
-#elif CONFIG_ESP_WIFI_AUTH_WPA_PSK
-#define ESP_WIFI_SCAN_AUTH_MODE_THRESHOLD WIFI_AUTH_WPA_PSK
-#elif CONFIG_ESP_WIFI_AUTH_WPA2_PSK
-#define ESP_WIFI_SCAN_AUTH_MODE_THRESHOLD WIFI_AUTH_WPA2_PSK
-#elif CONFIG_ESP_WIFI_AUTH_WPA_WPA2_PSK
-#define ESP_WIFI_SCAN_AUTH_MODE_THRESHOLD WIFI_AUTH_WPA_WPA2_PSK
-#elif CONFIG_ESP_WIFI_AUTH_WPA3_PSK
-#define ESP_WIFI_SCAN_AUTH_MODE_THRESHOLD WIFI_AUTH_WPA3_PSK
-#elif CONFIG_ESP_WIFI_AUTH_WPA2_WPA3_PSK
-#define ESP_WIFI_SCAN_AUTH_MODE_THRESHOLD WIFI_AUTH_WPA2_WPA3_PSK
-#elif CONFIG_ESP_WIFI_AUTH_WAPI_PSK
-#define ESP_WIFI_SCAN_AUTH_MODE_THRESHOLD WIFI_AUTH_WAPI_PSK
+static esp_mqtt_client_handle_t mqtt_client;
+
+#define MQTT_MAX_SENSORS (4)
+
+static reading_ring_t *sensor_rings[MQTT_MAX_SENSORS]; /*!< reading rings of the started sensor managers */
+static int sensor_ring_count = 0;
+
+#if CONFIG_MQTT_PUBLISH_JSON
+static const char *const READING_TOPIC_SUFFIX[] = {"reading"};
+#else
+static const char *const READING_TOPIC_SUFFIX[] = {
+        "temperature", "humidity",
+        "raw/0.3", "raw/0.5", "raw/1.0", "raw/2.5",
+        "standard/pm1.0", "standard/pm2.5", "standard/pm10.0",
+        "atmospheric/pm1.0", "atmospheric/pm2.5", "atmospheric/pm10.0",
+        "corrected/pm2.5", "aqi", "time"
+};
 #endif
+#define READING_TOPIC_COUNT (sizeof(READING_TOPIC_SUFFIX) / sizeof(READING_TOPIC_SUFFIX[0]))
 
-#define WIFI_CONNECTED_EVENT BIT0
-#define WIFI_FAIL_EVENT BIT1
+/**
+ * Prebuilt publish topics for one sensor
+ */
+typedef struct {
+    const char *sensor_id; /*!< sensor name the topics were built for */
+    char *topics[READING_TOPIC_COUNT]; /*!< full topic per READING_TOPIC_SUFFIX entry */
+    uint16_t aliases[READING_TOPIC_COUNT]; /*!< MQTT 5 topic alias per topic on the current connection, 0 for none */
+    uint32_t aliases_sent; /*!< bitmask of topics whose alias has been established with the broker */
+} sensor_topics_t;
 
-static EventGroupHandle_t wifi_event_group;
-static esp_mqtt_client_handle_t mqtt_client;
+static sensor_topics_t sensor_topic_table[MQTT_MAX_SENSORS];
+static int sensor_topic_count = 0;
 
-static int wifi_retry_count = 0;
+/**
+ * Incremented on every broker connection, topic aliases only live as long as one connection
+ */
+static volatile int mqtt_connection_id = 0;
+static volatile bool mqtt_connected = false;
+static volatile int64_t mqtt_connected_at = 0; /*!< esp_timer time of the last broker connection */
 
-static void wifi_event_handler(void* arg, esp_event_base_t event_base, int32_t event_id, void* event_data) {
-    if (event_base == WIFI_EVENT && event_id == WIFI_EVENT_STA_START) {
-        esp_wifi_connect();
-    } else if (event_base == WIFI_EVENT && event_id == WIFI_EVENT_STA_DISCONNECTED) {
-        if (wifi_retry_count < OAG_WIFI_MAXIMUM_RETRY) {
-            esp_wifi_connect();
-            wifi_retry_count++;
-            ESP_LOGI(TAG, "Reconnecting to wifi");
-        } else {
-            xEventGroupSetBits(wifi_event_group, WIFI_FAIL_EVENT);
+/**
+ * esp_timer times of the boot stages, 0 until reached
+ */
+static struct {
+    int64_t sensors_at; /*!< sensor managers started, the fan spin-up begins */
+    volatile int64_t mqtt_at; /*!< first broker connection */
+    int64_t wifi_at; /*!< first Wi-Fi connection */
+    int64_t first_reading_at; /*!< first reading delivered by a manager */
+    int64_t first_publish_at; /*!< first reading sent to a connected broker, live or in a backlog batch */
+    bool reported;
+} boot_timing;
+
+/**
+ * @brief Look up the topic table entry for a sensor, building its topics the first time it is seen
+ * @param sensor_id sensor name to report against
+ * @return topic table entry, NULL if the table is full or allocation failed
+ */
+static sensor_topics_t *get_sensor_topics(const char *sensor_id)
+{
+    for (int i = 0; i < sensor_topic_count; i++) {
+        if (sensor_topic_table[i].sensor_id == sensor_id || strcmp(sensor_topic_table[i].sensor_id, sensor_id) == 0) {
+            return &sensor_topic_table[i];
         }
-        ESP_LOGI(TAG, "Wifi connection failed");
-    } else if (event_base == IP_EVENT && event_id == IP_EVENT_STA_GOT_IP) {
-        ip_event_got_ip_t *event = (ip_event_got_ip_t *) event_data;
-        ESP_LOGI(TAG, "Connected to wifi with IP Address:" IPSTR, IP2STR(&event->ip_info.ip));
-        wifi_retry_count = 0;
-        xEventGroupSetBits(wifi_event_group, WIFI_CONNECTED_EVENT);
     }
-}
 
-void wifi_init_sta(void) {
-    wifi_event_group = xEventGroupCreate();
+    if (sensor_topic_count >= MQTT_MAX_SENSORS) {
+        ESP_LOGE(TAG, "no room in topic table for %s", sensor_id);
+        return NULL;
+    }
 
-    ESP_ERROR_CHECK(esp_netif_init());
+    sensor_topics_t *entry = &sensor_topic_table[sensor_topic_count];
+    for (int topic = 0; topic < READING_TOPIC_COUNT; topic++) {
+        int len = snprintf(NULL, 0, "%s%s/%s", CONFIG_MQTT_BASE_PATH, sensor_id, READING_TOPIC_SUFFIX[topic]);
+        entry->topics[topic] = malloc(len + 1);
+        if (!entry->topics[topic]) {
+            ESP_LOGE(TAG, "topic allocation for %s failed", sensor_id);
+            while (topic--) {
+                free(entry->topics[topic]);
+            }
+            return NULL;
+        }
+        sprintf(entry->topics[topic], "%s%s/%s", CONFIG_MQTT_BASE_PATH, sensor_id, READING_TOPIC_SUFFIX[topic]);
+    }
+    entry->sensor_id = sensor_id;
+    memset(entry->aliases, 0, sizeof(entry->aliases));
+    entry->aliases_sent = 0;
+    sensor_topic_count++;
+    return entry;
+}
 
-    ESP_ERROR_CHECK(esp_event_loop_create_default());
-    esp_netif_create_default_wifi_sta();
+#if CONFIG_MQTT_TOPIC_ALIASES
+static int alias_connection = -1; /*!< connection the assigned topic aliases belong to */
+static uint16_t alias_next; /*!< next unassigned topic alias on that connection */
+static uint16_t alias_limit; /*!< highest topic alias the broker is known to accept on that connection */
 
-    wifi_init_config_t cfg = WIFI_INIT_CONFIG_DEFAULT();
-    ESP_ERROR_CHECK(esp_wifi_init(&cfg));
+/**
+ * Forget every topic alias when a new connection is first published on, aliases only live as long as one connection
+ */
+static void reset_topic_aliases(int connection)
+{
+    alias_connection = connection;
+    alias_next = 1;
+    alias_limit = CONFIG_MQTT_TOPIC_ALIAS_MAXIMUM;
+    for (int i = 0; i < sensor_topic_count; i++) {
+        memset(sensor_topic_table[i].aliases, 0, sizeof(sensor_topic_table[i].aliases));
+        sensor_topic_table[i].aliases_sent = 0;
+    }
+}
 
-    esp_event_handler_instance_t instance_any_id;
-    esp_event_handler_instance_t instance_got_ip;
+/**
+ * Drop the topic alias publish_to_topic() leaves set on the client, so it is not sent along with the next publish
+ */
+static void clear_topic_alias(void)
+{
+    esp_mqtt5_publish_property_config_t property = {0};
+    esp_mqtt5_client_set_publish_property(mqtt_client, &property);
+}
+#endif
 
-    ESP_ERROR_CHECK(esp_event_handler_instance_register(WIFI_EVENT, ESP_EVENT_ANY_ID, &wifi_event_handler, NULL, &instance_any_id));
-    ESP_ERROR_CHECK(esp_event_handler_instance_register(IP_EVENT, IP_EVENT_STA_GOT_IP, &wifi_event_handler, NULL, &instance_got_ip));
+/**
+ * Publishes closer together than this are counted as one radio wakeup
+ */
+#define RADIO_IDLE_TICKS pdMS_TO_TICKS(1000)
+#define SCHEDULER_REPORT_TOPIC CONFIG_MQTT_BASE_PATH "scheduler"
+#define SCHEDULER_REPORT_TICKS pdMS_TO_TICKS(3600 * 1000)
 
-    wifi_config_t wifi_config = {
-            .sta = {
-                    .ssid = OAG_WIFI_SSID,
-                    .password = OAG_WIFI_PASS,
-                    /* Authmode threshold resets to WPA2 as default if password matches WPA2 standards (pasword len => 8).
-                     * If you want to connect the device to deprecated WEP/WPA networks, Please set the threshold value
-                     * to WIFI_AUTH_WEP/WIFI_AUTH_WPA_PSK and set the password with length and format matching to
-                     * WIFI_AUTH_WEP/WIFI_AUTH_WPA_PSK standards.
-                     */
-                    .threshold.authmode = ESP_WIFI_SCAN_AUTH_MODE_THRESHOLD,
-                    .sae_pwe_h2e = ESP_WIFI_SAE_MODE,
-                    .sae_h2e_identifier = OAG_H2E_IDENTIFIER,
-            },
-    };
+static TickType_t radio_last_activity = 0;
+static uint32_t radio_wakeups = 0;
+static uint32_t radio_on_ticks = 0;
+static TickType_t scheduler_report_at = 0;
 
-    /* Start Wi-Fi in station mode */
-    ESP_ERROR_CHECK(esp_wifi_set_mode(WIFI_MODE_STA));
-    ESP_ERROR_CHECK(esp_wifi_set_config(WIFI_IF_STA, &wifi_config));
-    ESP_ERROR_CHECK(esp_wifi_start());
-
-    EventBits_t bits = xEventGroupWaitBits(wifi_event_group,
-                                           WIFI_CONNECTED_EVENT | WIFI_FAIL_EVENT,
-                                           pdFALSE,
-                                           pdFALSE,
-                                           portMAX_DELAY);
-
-    if (bits & WIFI_CONNECTED_EVENT) {
-        ESP_LOGI(TAG, "connected to ap SSID:%s password:%s",
-                 OAG_WIFI_SSID, OAG_WIFI_PASS);
-    } else if (bits & WIFI_FAIL_EVENT) {
-        ESP_LOGI(TAG, "Failed to connect to SSID:%s, password:%s",
-                 OAG_WIFI_SSID, OAG_WIFI_SSID);
+/**
+ * @brief Account a publish towards the radio metrics
+ * @details The radio is taken to stay up for RADIO_IDLE_TICKS after the last publish, so radio on time is an
+ * estimate of how long publishes keep it out of modem sleep rather than a measurement
+ */
+static void note_radio_activity(void)
+{
+    TickType_t now = xTaskGetTickCount();
+    TickType_t gap = now - radio_last_activity;
+    if (gap > RADIO_IDLE_TICKS) {
+        radio_wakeups++;
+        radio_on_ticks += RADIO_IDLE_TICKS;
     } else {
-        ESP_LOGE(TAG, "UNEXPECTED EVENT");
+        radio_on_ticks += gap;
     }
+    radio_last_activity = now;
 }
 
+/**
+ * Queue a QoS 0 message on a topic that has no alias
+ */
+static void mqtt_enqueue(const char *topic, const char *payload, int len)
+{
+#if CONFIG_MQTT_TOPIC_ALIASES
+    clear_topic_alias();
+#endif
+    note_radio_activity();
+    esp_mqtt_client_enqueue(mqtt_client, topic, payload, len, 0, 0, true);
+}
+
+/**
+ * @brief Publish a payload to one of a sensor's prebuilt topics
+ * @details With topic aliases enabled the full topic is only sent the first time on each connection, later
+ * publishes carry just the 2 byte alias. Aliases are tied to the connection, so those publishes go out directly
+ * rather than through the outbox where they could be replayed on a later connection. That write happens on the
+ * main loop and blocks it, ring draining and housekeeping included, for as long as the socket takes to accept the
+ * message, up to the client's network timeout on a stalled link. Topics that find the connection's aliases used
+ * up, and publishes that fail, go through the non-blocking outbox with the full topic.
+ * @param entry sensor topic table entry
+ * @param topic index into READING_TOPIC_SUFFIX
+ * @param payload message payload
+ * @param len payload length, 0 to use strlen
+ */
+static void publish_to_topic(sensor_topics_t *entry, int topic, const char *payload, int len)
+{
+    note_radio_activity();
+#if CONFIG_MQTT_TOPIC_ALIASES
+    int connection = mqtt_connection_id;
+    if (mqtt_connected) {
+        if (alias_connection != connection) {
+            reset_topic_aliases(connection);
+        }
+        if (!entry->aliases[topic] && alias_next <= alias_limit) {
+            entry->aliases[topic] = alias_next++;
+        }
+        uint16_t alias = entry->aliases[topic];
+        if (alias) {
+            esp_mqtt5_publish_property_config_t property = {
+                    .topic_alias = alias,
+            };
+            esp_mqtt5_client_set_publish_property(mqtt_client, &property);
+            bool alias_sent = entry->aliases_sent & (1 << topic);
+            if (esp_mqtt_client_publish(mqtt_client, alias_sent ? "" : entry->topics[topic], payload, len, 0, 0) >= 0) {
+                entry->aliases_sent |= (1 << topic);
+                return;
+            }
+            clear_topic_alias();
+            /*
+             * ESP-MQTT refuses aliases above the broker's CONNACK Topic Alias Maximum without exposing it. If the
+             * same publish goes through on the same connection without the alias, the alias was what it refused;
+             * any other failure leaves the limit alone and falls back to the outbox
+             */
+            if (!alias_sent && mqtt_connected && mqtt_connection_id == connection &&
+                esp_mqtt_client_publish(mqtt_client, entry->topics[topic], payload, len, 0, 0) >= 0) {
+                ESP_LOGW(TAG, "topic alias %u refused, publishing full topics beyond alias %u", alias, alias - 1);
+                alias_limit = alias - 1;
+                entry->aliases[topic] = 0;
+                return;
+            }
+        }
+    }
+    clear_topic_alias();
+#endif
+    esp_mqtt_client_enqueue(mqtt_client, entry->topics[topic], payload, len, 0, 0, true);
+}
+
+#if CONFIG_READING_LOG
+#define BACKLOG_TOPIC CONFIG_MQTT_BASE_PATH "backlog"
+#define BACKLOG_BATCH_SIZE CONFIG_READING_LOG_BATCH_SIZE
+#define BACKLOG_ROW_MAX_LEN (128)
+#define BACKLOG_HEADER_MAX_LEN (32)
+#define BACKLOG_DRAIN_TICKS pdMS_TO_TICKS(CONFIG_READING_LOG_DRAIN_INTERVAL)
+#define BACKLOG_ACK_TIMEOUT_TICKS pdMS_TO_TICKS(30000)
+
+static reading_log_handle_t reading_log = NULL;
+static reading_log_entry_t backlog_entries[BACKLOG_BATCH_SIZE];
+static char *backlog_buffer = NULL;
+static int backlog_msg_id = -1; /*!< message id of the batch waiting for PUBACK, -1 if none */
+static uint32_t backlog_last_sequence; /*!< newest log sequence in the batch waiting for PUBACK */
+static TickType_t backlog_sent_at = 0;
+static uint32_t backlog_published_at; /*!< latency trace stamp of the batch waiting for PUBACK */
+static volatile int backlog_acked_msg_id = -1;
+#endif
+
+/**
+ * Run housekeeping on the main loop now rather than at the next timer expiry, callable from any task
+ */
+static esp_err_t housekeeping_kick(void)
+{
+    return esp_event_post_to(main_events, HOUSEKEEPING_EVENT, HOUSEKEEPING_DUE, NULL, 0, 0);
+}
+
+static void housekeeping_timer_callback(void *arg)
+{
+    /* housekeeping() arms the timer again, so a run must not be lost to a full queue */
+    if (housekeeping_kick() != ESP_OK) {
+        esp_timer_start_once(housekeeping_timer, 100 * 1000);
+    }
+}
 
 static void log_error_if_nonzero(const char *message, int error_code)
 {
@@ -169,9 +333,17 @@ static void mqtt_event_handler(void *handler_args, esp_event_base_t base, int32_
     switch ((esp_mqtt_event_id_t)event_id) {
         case MQTT_EVENT_CONNECTED:
             ESP_LOGI(TAG, "MQTT Connected");
+            mqtt_connection_id++;
+            mqtt_connected_at = esp_timer_get_time();
+            if (!boot_timing.mqtt_at) {
+                boot_timing.mqtt_at = mqtt_connected_at;
+            }
+            housekeeping_kick();
+            mqtt_connected = true;
             break;
         case MQTT_EVENT_DISCONNECTED:
             ESP_LOGI(TAG, "MQTT Disconnected");
+            mqtt_connected = false;
             break;
 
         case MQTT_EVENT_SUBSCRIBED:
@@ -182,6 +354,12 @@ static void mqtt_event_handler(void *handler_args, esp_event_base_t base, int32_
             break;
         case MQTT_EVENT_PUBLISHED:
             ESP_LOGI(TAG, "MQTT_EVENT_PUBLISHED, msg_id=%d", event->msg_id);
+#if CONFIG_READING_LOG
+            /* backlog batches are the only QoS 1 publishes */
+            LATENCY_TRACE_RECORD(LATENCY_STAGE_ACK, backlog_published_at);
+            backlog_acked_msg_id = event->msg_id;
+            housekeeping_kick();
+#endif
             break;
         case MQTT_EVENT_DATA:
             ESP_LOGI(TAG, "MQTT_EVENT_DATA");
@@ -207,6 +385,9 @@ static void mqtt_init()
             .broker.address.uri = CONFIG_MQTT_TARGET_URL,
             .credentials.username = CONFIG_MQTT_USERNAME,
             .credentials.authentication.password = CONFIG_MQTT_PASSOWRD,
+#if CONFIG_MQTT_TOPIC_ALIASES
+            .session.protocol_ver = MQTT_PROTOCOL_V_5,
+#endif
     };
 
     mqtt_client = esp_mqtt_client_init(&mqtt_config);
@@ -214,67 +395,669 @@ static void mqtt_init()
     esp_mqtt_client_start(mqtt_client);
 }
 
-static char *mqtt_topic_buffer[256];
-static char *mqtt_payload_buffer[256];
-static void sensor_event_handler(void *event_handler_arg, esp_event_base_t event_base, int32_t event_id, void *event_data) {
-    if (event_base == PMS5003_MANAGER_EVENT) {
-        switch (event_id) {
-            case PMS5003T_MANAGER_READING:
-                pms5003T_reading_t * pms5003T_reading = (pms5003T_reading_t *) event_data;
+static char mqtt_payload_buffer[384];
 
-                sprintf(mqtt_topic_buffer, "%s%s/temperature", CONFIG_MQTT_BASE_PATH, pms5003T_reading->sensor_id);
-                sprintf(mqtt_payload_buffer, "%f", (pms5003T_reading->temperature / 10.0));
-                esp_mqtt_client_enqueue(mqtt_client, mqtt_topic_buffer, mqtt_payload_buffer, 0, 0, 0, true);
+/**
+ * Longest output of format_reading_fields()
+ */
+#define READING_FIELDS_MAX_LEN (80)
 
-                sprintf(mqtt_topic_buffer, "%s%s/humidity", CONFIG_MQTT_BASE_PATH, pms5003T_reading->sensor_id);
-                sprintf(mqtt_payload_buffer, "%f", (pms5003T_reading->humidity / 10.0));
-                esp_mqtt_client_enqueue(mqtt_client, mqtt_topic_buffer, mqtt_payload_buffer, 0, 0, 0, true);
+/**
+ * @brief Write the published fields of a reading as a comma separated list
+ * @details Order is temperature, humidity, raw 0.3/0.5/1.0/2.5, standard PM1.0/2.5/10.0 and atmospheric
+ * PM1.0/2.5/10.0
+ * @param buffer destination, at least READING_FIELDS_MAX_LEN bytes
+ * @param reading reading to format
+ * @return length written
+ */
+static int format_reading_fields(char *buffer, const pms5003T_reading_t *reading)
+{
+    const uint16_t counts[] = {
+            reading->raw_pm_0_3, reading->raw_pm_0_5, reading->raw_pm_1_0, reading->raw_pm_2_5,
+            reading->standard.pm_1_0, reading->standard.pm_2_5, reading->standard.pm_10_0,
+            reading->atmospheric.pm_1_0, reading->atmospheric.pm_2_5, reading->atmospheric.pm_10_0
+    };
 
-                sprintf(mqtt_topic_buffer, "%s%s/raw/0.3", CONFIG_MQTT_BASE_PATH, pms5003T_reading->sensor_id);
-                sprintf(mqtt_payload_buffer, "%d", pms5003T_reading->raw_pm_0_3);
-                esp_mqtt_client_enqueue(mqtt_client, mqtt_topic_buffer, mqtt_payload_buffer, 0, 0, 0, true);
+    int len = reading_format_tenths(buffer, reading->temperature);
+    buffer[len++] = ',';
+    len += reading_format_tenths(buffer + len, reading->humidity);
+    for (int i = 0; i < sizeof(counts) / sizeof(counts[0]); i++) {
+        buffer[len++] = ',';
+        len += reading_format_uint(buffer + len, counts[i]);
+    }
+    return len;
+}
 
-                sprintf(mqtt_topic_buffer, "%s%s/raw/0.5", CONFIG_MQTT_BASE_PATH, pms5003T_reading->sensor_id);
-                sprintf(mqtt_payload_buffer, "%d", pms5003T_reading->raw_pm_0_5);
-                esp_mqtt_client_enqueue(mqtt_client, mqtt_topic_buffer, mqtt_payload_buffer, 0, 0, 0, true);
+#if CONFIG_MQTT_PUBLISH_JSON
+/**
+ * Publish a reading as a single JSON document under {base path}/{sensor ID}/reading
+ * @param reading reading to publish
+ */
+static void publish_reading(const pms5003T_reading_t *reading)
+{
+    sensor_topics_t *topics = get_sensor_topics(reading->sensor_id);
+    if (!topics) {
+        return;
+    }
+    char temperature[READING_FORMAT_TENTHS_MAX_LEN + 1];
+    char humidity[READING_FORMAT_TENTHS_MAX_LEN + 1];
+    char corrected[READING_FORMAT_TENTHS_MAX_LEN + 1];
+    reading_format_tenths(temperature, reading->temperature);
+    reading_format_tenths(humidity, reading->humidity);
+    reading_format_tenths(corrected, reading->pm_2_5_corrected);
 
-                sprintf(mqtt_topic_buffer, "%s%s/raw/1.0", CONFIG_MQTT_BASE_PATH, pms5003T_reading->sensor_id);
-                sprintf(mqtt_payload_buffer, "%d", pms5003T_reading->raw_pm_1_0);
-                esp_mqtt_client_enqueue(mqtt_client, mqtt_topic_buffer, mqtt_payload_buffer, 0, 0, 0, true);
+    int len = snprintf(mqtt_payload_buffer, sizeof(mqtt_payload_buffer),
+                       "{\"temperature\":%s,\"humidity\":%s,"
+                       "\"raw\":{\"0.3\":%d,\"0.5\":%d,\"1.0\":%d,\"2.5\":%d},"
+                       "\"standard\":{\"pm1.0\":%d,\"pm2.5\":%d,\"pm10.0\":%d},"
+                       "\"atmospheric\":{\"pm1.0\":%d,\"pm2.5\":%d,\"pm10.0\":%d},"
+                       "\"corrected\":{\"pm2.5\":%s},\"aqi\":%d",
+                       temperature, humidity,
+                       reading->raw_pm_0_3, reading->raw_pm_0_5, reading->raw_pm_1_0, reading->raw_pm_2_5,
+                       reading->standard.pm_1_0, reading->standard.pm_2_5, reading->standard.pm_10_0,
+                       reading->atmospheric.pm_1_0, reading->atmospheric.pm_2_5, reading->atmospheric.pm_10_0,
+                       corrected, reading->aqi);
+    uint32_t captured_at = time_sync_resolve(reading->captured_at);
+    if (len > 0 && len < sizeof(mqtt_payload_buffer)) {
+        len += captured_at ? snprintf(mqtt_payload_buffer + len, sizeof(mqtt_payload_buffer) - len, ",\"t\":%lu}",
+                                      (unsigned long)captured_at)
+                           : snprintf(mqtt_payload_buffer + len, sizeof(mqtt_payload_buffer) - len, "}");
+    }
+    if (len < 0 || len >= sizeof(mqtt_payload_buffer)) {
+        ESP_LOGE(TAG, "reading document for %s does not fit payload buffer", reading->sensor_id);
+        return;
+    }
+    publish_to_topic(topics, 0, mqtt_payload_buffer, len);
+}
+#else
+/**
+ * Publish every field of a reading to its own topic under {base path}/{sensor ID}/
+ * @param reading reading to publish
+ */
+static void publish_reading(const pms5003T_reading_t *reading)
+{
+    sensor_topics_t *topics = get_sensor_topics(reading->sensor_id);
+    if (!topics) {
+        return;
+    }
+    const uint16_t counts[] = {
+            reading->raw_pm_0_3, reading->raw_pm_0_5, reading->raw_pm_1_0, reading->raw_pm_2_5,
+            reading->standard.pm_1_0, reading->standard.pm_2_5, reading->standard.pm_10_0,
+            reading->atmospheric.pm_1_0, reading->atmospheric.pm_2_5, reading->atmospheric.pm_10_0
+    };
 
-                sprintf(mqtt_topic_buffer, "%s%s/raw/2.5", CONFIG_MQTT_BASE_PATH, pms5003T_reading->sensor_id);
-                sprintf(mqtt_payload_buffer, "%d", pms5003T_reading->raw_pm_2_5);
-                esp_mqtt_client_enqueue(mqtt_client, mqtt_topic_buffer, mqtt_payload_buffer, 0, 0, 0, true);
+    int len = reading_format_tenths(mqtt_payload_buffer, reading->temperature);
+    publish_to_topic(topics, 0, mqtt_payload_buffer, len);
 
-                sprintf(mqtt_topic_buffer, "%s%s/standard/pm1.0", CONFIG_MQTT_BASE_PATH, pms5003T_reading->sensor_id);
-                sprintf(mqtt_payload_buffer, "%d", pms5003T_reading->standard.pm_1_0);
-                esp_mqtt_client_enqueue(mqtt_client, mqtt_topic_buffer, mqtt_payload_buffer, 0, 0, 0, true);
+    len = reading_format_tenths(mqtt_payload_buffer, reading->humidity);
+    publish_to_topic(topics, 1, mqtt_payload_buffer, len);
 
-                sprintf(mqtt_topic_buffer, "%s%s/standard/pm2.5", CONFIG_MQTT_BASE_PATH, pms5003T_reading->sensor_id);
-                sprintf(mqtt_payload_buffer, "%d", pms5003T_reading->standard.pm_2_5);
-                esp_mqtt_client_enqueue(mqtt_client, mqtt_topic_buffer, mqtt_payload_buffer, 0, 0, 0, true);
+    for (int i = 0; i < sizeof(counts) / sizeof(counts[0]); i++) {
+        len = reading_format_uint(mqtt_payload_buffer, counts[i]);
+        publish_to_topic(topics, 2 + i, mqtt_payload_buffer, len);
+    }
+
+    len = reading_format_tenths(mqtt_payload_buffer, reading->pm_2_5_corrected);
+    publish_to_topic(topics, 12, mqtt_payload_buffer, len);
+
+    len = reading_format_uint(mqtt_payload_buffer, reading->aqi);
+    publish_to_topic(topics, 13, mqtt_payload_buffer, len);
+
+    uint32_t captured_at = time_sync_resolve(reading->captured_at);
+    if (captured_at) {
+        len = reading_format_uint(mqtt_payload_buffer, captured_at);
+        publish_to_topic(topics, 14, mqtt_payload_buffer, len);
+    }
+}
+#endif
 
-                sprintf(mqtt_topic_buffer, "%s%s/standard/pm10.0", CONFIG_MQTT_BASE_PATH, pms5003T_reading->sensor_id);
-                sprintf(mqtt_payload_buffer, "%d", pms5003T_reading->standard.pm_10_0);
-                esp_mqtt_client_enqueue(mqtt_client, mqtt_topic_buffer, mqtt_payload_buffer, 0, 0, 0, true);
+#if CONFIG_READING_LOG
+/**
+ * Open the flash reading log and allocate the buffers used to forward it
+ */
+static void backlog_init(void)
+{
+    reading_log = reading_log_init(CONFIG_READING_LOG_PARTITION_LABEL);
+    if (!reading_log) {
+        ESP_LOGE(TAG, "reading log unavailable, offline readings will only be kept in RAM");
+        return;
+    }
 
-                sprintf(mqtt_topic_buffer, "%s%s/atmospheric/pm1.0", CONFIG_MQTT_BASE_PATH, pms5003T_reading->sensor_id);
-                sprintf(mqtt_payload_buffer, "%d", pms5003T_reading->atmospheric.pm_1_0);
-                esp_mqtt_client_enqueue(mqtt_client, mqtt_topic_buffer, mqtt_payload_buffer, 0, 0, 0, true);
+    backlog_buffer = malloc(BACKLOG_BATCH_SIZE * BACKLOG_ROW_MAX_LEN + BACKLOG_HEADER_MAX_LEN);
+    if (!backlog_buffer) {
+        ESP_LOGE(TAG, "backlog buffer allocation failed");
+        reading_log = NULL;
+    }
+}
 
-                sprintf(mqtt_topic_buffer, "%s%s/atmospheric/pm2.5", CONFIG_MQTT_BASE_PATH, pms5003T_reading->sensor_id);
-                sprintf(mqtt_payload_buffer, "%d", pms5003T_reading->atmospheric.pm_2_5);
-                esp_mqtt_client_enqueue(mqtt_client, mqtt_topic_buffer, mqtt_payload_buffer, 0, 0, 0, true);
+/**
+ * Format a batch of logged readings as
+ * {"t":base time,"readings":[[sensor, sequence, time offset, fields..., corrected PM2.5, AQI], ...]}
+ * @details Corrected PM2.5 and AQI are not logged, they are derived again just like for a live reading. The base time is the Unix time of the first reading whose capture time is known, each row carries its
+ * offset from it in seconds, or null when unknown. t is left out when no reading's time is known.
+ * @return length of the document in backlog_buffer
+ */
+static int backlog_format(int count)
+{
+    uint32_t captured_at[BACKLOG_BATCH_SIZE];
+    uint32_t base = 0;
+    for (int i = 0; i < count; i++) {
+        captured_at[i] = time_sync_resolve(backlog_entries[i].reading.captured_at);
+        if (!base) {
+            base = captured_at[i];
+        }
+    }
+
+    int len = base ? sprintf(backlog_buffer, "{\"t\":%lu,\"readings\":[", (unsigned long)base)
+                   : sprintf(backlog_buffer, "{\"readings\":[");
+    for (int i = 0; i < count; i++) {
+        len += sprintf(backlog_buffer + len, "%s[\"%s\",%lu,", i ? "," : "", backlog_entries[i].reading.sensor_id,
+                       (unsigned long)backlog_entries[i].sequence);
+        if (captured_at[i]) {
+            len += sprintf(backlog_buffer + len, "%ld,", (long)(int32_t)(captured_at[i] - base));
+        } else {
+            len += sprintf(backlog_buffer + len, "null,");
+        }
+        pms5003T_reading_t *reading = &backlog_entries[i].reading;
+        reading_aqi_derive(reading);
+        len += format_reading_fields(backlog_buffer + len, reading);
+        backlog_buffer[len++] = ',';
+        len += reading_format_tenths(backlog_buffer + len, reading->pm_2_5_corrected);
+        backlog_buffer[len++] = ',';
+        len += reading_format_uint(backlog_buffer + len, reading->aqi);
+        backlog_buffer[len++] = ']';
+    }
+    len += sprintf(backlog_buffer + len, "]}");
+    return len;
+}
+
+/**
+ * @brief Forward the next batch of logged readings if the broker is reachable
+ * @details One QoS 1 batch is in flight at a time and batches are spaced by CONFIG_READING_LOG_DRAIN_INTERVAL, so
+ * draining a long outage does not starve live readings. Readings are only marked forwarded once the broker
+ * acknowledges the batch; a batch that is never acknowledged is sent again.
+ */
+static void backlog_forward(void)
+{
+    if (!reading_log || !mqtt_connected) {
+        return;
+    }
+
+    TickType_t now = xTaskGetTickCount();
+    if (backlog_msg_id >= 0) {
+        if (backlog_acked_msg_id == backlog_msg_id) {
+            if (reading_log_consume(reading_log, backlog_last_sequence) != ESP_OK) {
+                ESP_LOGE(TAG, "marking backlog forwarded failed");
+            }
+            backlog_msg_id = -1;
+        } else if (now - backlog_sent_at < BACKLOG_ACK_TIMEOUT_TICKS) {
+            return;
+        } else {
+            backlog_msg_id = -1;
+        }
+    }
+    if (now - backlog_sent_at < BACKLOG_DRAIN_TICKS) {
+        return;
+    }
+
+    int count = reading_log_peek(reading_log, backlog_entries, BACKLOG_BATCH_SIZE);
+    if (!count) {
+        return;
+    }
+    int len = backlog_format(count);
+    backlog_sent_at = now;
+#if CONFIG_MQTT_TOPIC_ALIASES
+    clear_topic_alias();
+#endif
+    note_radio_activity();
+    backlog_published_at = LATENCY_TRACE_NOW();
+    int msg_id = esp_mqtt_client_publish(mqtt_client, BACKLOG_TOPIC, backlog_buffer, len, 1, 0);
+    if (msg_id > 0) {
+        backlog_msg_id = msg_id;
+        if (!boot_timing.first_publish_at) {
+            boot_timing.first_publish_at = esp_timer_get_time();
+        }
+        backlog_last_sequence = backlog_entries[count - 1].sequence;
+        ESP_LOGI(TAG, "forwarding %d logged readings, %lu pending", count,
+                 (unsigned long)reading_log_pending(reading_log));
+    }
+}
+#endif
+
+#if CONFIG_MQTT_PUBLISH_SUMMARIES
+static char summary_buffer[4 * (READING_FIELDS_MAX_LEN + 12) + 48];
+
+/**
+ * Publish rolling window statistics under {base path}/{sensor ID}/summary/{window seconds}
+ * @details The mean, min, max and stddev arrays use the field order of format_reading_fields()
+ * @param summary statistics to publish
+ */
+static void publish_summary(const reading_summary_t *summary)
+{
+    if (!mqtt_connected || !summary->count) {
+        return;
+    }
+    char topic[128];
+    snprintf(topic, sizeof(topic), "%s%s/summary/%lu", CONFIG_MQTT_BASE_PATH, summary->mean.sensor_id,
+             (unsigned long)summary->window);
+
+    int len = sprintf(summary_buffer, "{\"count\":%lu,", (unsigned long)summary->count);
+    uint32_t captured_at = time_sync_resolve(summary->mean.captured_at);
+    if (captured_at) {
+        len += sprintf(summary_buffer + len, "\"t\":%lu,", (unsigned long)captured_at);
+    }
+    len += sprintf(summary_buffer + len, "\"mean\":[");
+    len += format_reading_fields(summary_buffer + len, &summary->mean);
+    len += sprintf(summary_buffer + len, "],\"min\":[");
+    len += format_reading_fields(summary_buffer + len, &summary->min);
+    len += sprintf(summary_buffer + len, "],\"max\":[");
+    len += format_reading_fields(summary_buffer + len, &summary->max);
+    len += sprintf(summary_buffer + len, "],\"stddev\":[");
+    len += format_reading_fields(summary_buffer + len, &summary->stddev);
+    len += sprintf(summary_buffer + len, "]}");
+
+    mqtt_enqueue(topic, summary_buffer, len);
+}
+#endif
 
-                sprintf(mqtt_topic_buffer, "%s%s/atmospheric/pm10.0", CONFIG_MQTT_BASE_PATH, pms5003T_reading->sensor_id);
-                sprintf(mqtt_payload_buffer, "%d", pms5003T_reading->atmospheric.pm_10_0);
-                esp_mqtt_client_enqueue(mqtt_client, mqtt_topic_buffer, mqtt_payload_buffer, 0, 0, 0, true);
+#if CONFIG_READING_FUSION
+#define FUSION_TOPIC CONFIG_MQTT_BASE_PATH "fused"
 
+static reading_fusion_t reading_fusion;
+static char fusion_buffer[READING_FIELDS_MAX_LEN + PMS5003_FIELD_COUNT * 24 + 96];
+
+/**
+ * @brief Pair a reading with the other sensor's and publish the fused result under {base path}/fused
+ * @details Channels the sensors disagree on are listed by their per-topic name, with the fused fields in the order
+ * of format_reading_fields()
+ * @param reading reading from either sensor
+ */
+static void fuse_reading(const pms5003T_reading_t *reading)
+{
+    reading_fusion_result_t result;
+    if (!reading_fusion_add(&reading_fusion, reading, (uint32_t)(esp_timer_get_time() / 1000000), &result)) {
+        return;
+    }
+    if (result.divergent) {
+        ESP_LOGW(TAG, "%s and %s disagree, agreement %d, divergent channels 0x%04x", reading_fusion.sensor_ids[0],
+                 reading_fusion.sensor_ids[1], result.agreement, result.divergent);
+    }
+    if (!mqtt_connected) {
+        return;
+    }
+
+    int len = sprintf(fusion_buffer, "{\"sensors\":[\"%s\",\"%s\"],\"agreement\":%d,\"divergent\":[",
+                      reading_fusion.sensor_ids[0], reading_fusion.sensor_ids[1], result.agreement);
+    bool first = true;
+    for (int field = 0; field < PMS5003_FIELD_COUNT; field++) {
+        if (result.divergent & (1 << field)) {
+            len += sprintf(fusion_buffer + len, "%s\"%s\"", first ? "" : ",", reading_fusion_channel_name(field));
+            first = false;
+        }
+    }
+    len += sprintf(fusion_buffer + len, "],\"fused\":[");
+    len += format_reading_fields(fusion_buffer + len, &result.fused);
+    len += sprintf(fusion_buffer + len, "]}");
+
+    mqtt_enqueue(FUSION_TOPIC, fusion_buffer, len);
+}
+#endif
+
+/**
+ * @brief Publish the hourly fan and radio duty under {base path}/scheduler
+ * @details Compare the reports of the stagger and align schedules to pick one; stagger keeps at most one fan
+ * running, align needs fewer radio wakeups
+ */
+static void scheduler_report(void)
+{
+    TickType_t now = xTaskGetTickCount();
+    if (now - scheduler_report_at < SCHEDULER_REPORT_TICKS) {
+        return;
+    }
+    scheduler_report_at = now;
+
+    pms5003_scheduler_fan_stats_t fan_stats;
+    pms5003_scheduler_take_fan_stats(now, &fan_stats);
+    char payload[128];
+    int len = snprintf(payload, sizeof(payload),
+                       "{\"mode\":\"%s\",\"fan_on_s\":%lu,\"max_fans_on\":%d,\"radio_wakeups\":%lu,\"radio_on_s\":%lu}",
+#if CONFIG_PMS5003_SCHEDULE_STAGGER
+                       "stagger",
+#else
+                       "align",
+#endif
+                       (unsigned long)(fan_stats.fan_on_ms / 1000), fan_stats.max_fans_on,
+                       (unsigned long)radio_wakeups, (unsigned long)(radio_on_ticks * portTICK_PERIOD_MS / 1000));
+    ESP_LOGI(TAG, "last hour: %s", payload);
+    radio_wakeups = 0;
+    radio_on_ticks = 0;
+    if (mqtt_connected) {
+        mqtt_enqueue(SCHEDULER_REPORT_TOPIC, payload, len);
+    }
+}
+
+#define CONNECTION_REPORT_TOPIC CONFIG_MQTT_BASE_PATH "connection"
+
+static wifi_link_timing_t connection_timing;
+static bool connection_pending = false;
+
+/**
+ * @brief Publish how the last Wi-Fi connection came up under {base path}/connection
+ * @details Waits for the broker connection that follows the Wi-Fi connection, so the report covers the time from
+ * the radio starting (or the connection dropping) until publishes can go out again
+ */
+static void connection_report(void)
+{
+    if (!connection_pending) {
+        connection_pending = wifi_link_take_timing(&connection_timing);
+        if (connection_pending && !boot_timing.wifi_at) {
+            boot_timing.wifi_at = connection_timing.connected_at;
+        }
+    }
+    if (!connection_pending || !mqtt_connected || mqtt_connected_at < connection_timing.connected_at) {
+        return;
+    }
+    connection_pending = false;
+
+    char payload[128];
+    int len = snprintf(payload, sizeof(payload),
+                       "{\"attempts\":%lu,\"cached_ap\":%s,\"associate_ms\":%lu,\"ip_ms\":%lu,\"mqtt_ms\":%lu}",
+                       (unsigned long)connection_timing.attempts, connection_timing.cached_ap ? "true" : "false",
+                       (unsigned long)connection_timing.associate_ms, (unsigned long)connection_timing.ip_ms,
+                       (unsigned long)((mqtt_connected_at - connection_timing.connected_at) / 1000));
+    ESP_LOGI(TAG, "connection: %s", payload);
+    mqtt_enqueue(CONNECTION_REPORT_TOPIC, payload, len);
+}
+
+#define BOOT_REPORT_TOPIC CONFIG_MQTT_BASE_PATH "boot"
+
+/**
+ * @brief Publish how long each boot stage took under {base path}/boot, once the first reading has gone out
+ * @details All times are ms since boot. The sensors start spinning up before the network is up, so first_reading_ms
+ * is set by the fan spin-up and first_publish_ms by whichever of the two finishes last.
+ */
+static void boot_report(void)
+{
+    if (boot_timing.reported || !boot_timing.first_publish_at || !mqtt_connected) {
+        return;
+    }
+    boot_timing.reported = true;
+
+    char payload[160];
+    int len = snprintf(payload, sizeof(payload),
+                       "{\"sensors_ms\":%lu,\"wifi_ms\":%lu,\"mqtt_ms\":%lu,\"first_reading_ms\":%lu,"
+                       "\"first_publish_ms\":%lu}",
+                       (unsigned long)(boot_timing.sensors_at / 1000), (unsigned long)(boot_timing.wifi_at / 1000),
+                       (unsigned long)(boot_timing.mqtt_at / 1000),
+                       (unsigned long)(boot_timing.first_reading_at / 1000),
+                       (unsigned long)(boot_timing.first_publish_at / 1000));
+    ESP_LOGI(TAG, "boot: %s", payload);
+    mqtt_enqueue(BOOT_REPORT_TOPIC, payload, len);
+}
+
+#if CONFIG_PMS5003_ADAPTIVE_INTERVAL
+static const char *const SCHEDULE_ACTION_NAME[] = {"hold", "shorten", "stretch"};
+
+/**
+ * Publish an adaptive interval decision under {base path}/{sensor ID}/schedule
+ * @param decision decision taken after a burst
+ */
+static void publish_schedule(const pms5003_scheduler_decision_t *decision)
+{
+    char topic[128];
+    char payload[160];
+    snprintf(topic, sizeof(topic), "%s%s/schedule", CONFIG_MQTT_BASE_PATH, decision->sensor_id);
+    int len = snprintf(payload, sizeof(payload),
+                       "{\"pm2.5\":%d,\"change\":%d,\"variation\":%d,\"action\":\"%s\",\"sleep_s\":%lu,\"cycle_s\":%lu}",
+                       decision->pm_2_5, decision->change_percent, decision->variation_percent,
+                       SCHEDULE_ACTION_NAME[decision->action], (unsigned long)decision->sleep_time,
+                       (unsigned long)decision->cycle_time);
+    if (decision->action != PMS5003_SCHEDULE_HOLD) {
+        ESP_LOGI(TAG, "%s schedule: %s", decision->sensor_id, payload);
+    }
+    if (mqtt_connected) {
+        mqtt_enqueue(topic, payload, len);
+    }
+}
+#endif
+
+#if configUSE_TRACE_FACILITY
+#define TELEMETRY_TOPIC CONFIG_MQTT_BASE_PATH "telemetry"
+
+static char telemetry_buffer[80 + STATS_COLLECTOR_TASK_LIST_SIZE * (configMAX_TASK_NAME_LEN + 32)];
+
+/**
+ * @brief Publish a stats collector snapshot under {base path}/telemetry
+ * @details Idle is the idle task's CPU share in tenths of a percent, heap is [free, minimum free, largest free
+ * block] in bytes, each task is
+ * [name, CPU share in tenths of a percent, stack high water mark in bytes, change of the mark since the last snapshot]
+ * @param snapshot snapshot posted by the collector
+ */
+static void publish_telemetry(const stats_collector_snapshot_t *snapshot)
+{
+    if (!mqtt_connected) {
+        return;
+    }
+    int len = sprintf(telemetry_buffer, "{\"idle\":%d,\"heap\":[%lu,%lu,%lu],\"tasks\":[",
+                      snapshot->idle_permille, (unsigned long)snapshot->free_heap,
+                      (unsigned long)snapshot->minimum_free_heap, (unsigned long)snapshot->largest_free_block);
+    for (int i = 0; i < snapshot->task_count; i++) {
+        const stats_collector_task_t *task = &snapshot->tasks[i];
+        len += sprintf(telemetry_buffer + len, "%s[\"%s\",%d,%lu,%ld]", i ? "," : "", task->name,
+                       task->cpu_permille, (unsigned long)task->stack_high_water, (long)task->stack_high_water_change);
+    }
+    len += sprintf(telemetry_buffer + len, "]}");
+    mqtt_enqueue(TELEMETRY_TOPIC, telemetry_buffer, len);
+}
+#endif
+
+#if CONFIG_LATENCY_TRACE
+#define LATENCY_REPORT_TOPIC CONFIG_MQTT_BASE_PATH "latency"
+#define LATENCY_REPORT_TICKS pdMS_TO_TICKS(CONFIG_LATENCY_TRACE_REPORT_INTERVAL * 1000)
+#define LATENCY_REPORT_STAGE_MAX_LEN (128 + LATENCY_HISTOGRAM_BUCKETS * 11)
+
+static TickType_t latency_report_at = 0;
+static latency_histogram_t latency_histograms[LATENCY_STAGE_COUNT];
+static char latency_buffer[32 + LATENCY_STAGE_COUNT * LATENCY_REPORT_STAGE_MAX_LEN];
+
+/**
+ * @brief Publish the pipeline stage latency histograms under {base path}/latency and start new ones
+ * @details Times are in us. Bucket n counts latencies from 2^n to 2^(n+1) us, trailing empty buckets are left out.
+ * Percentiles are the upper bound of the bucket they fall in.
+ */
+static void latency_report(void)
+{
+    TickType_t now = xTaskGetTickCount();
+    if (now - latency_report_at < LATENCY_REPORT_TICKS) {
+        return;
+    }
+    latency_report_at = now;
+
+    latency_trace_take(latency_histograms);
+    int len = sprintf(latency_buffer, "{\"period_s\":%d", CONFIG_LATENCY_TRACE_REPORT_INTERVAL);
+    for (int stage = 0; stage < LATENCY_STAGE_COUNT; stage++) {
+        const latency_histogram_t *histogram = &latency_histograms[stage];
+        if (!histogram->count) {
+            continue;
+        }
+        len += sprintf(latency_buffer + len,
+                       ",\"%s\":{\"count\":%lu,\"mean\":%lu,\"p50\":%lu,\"p99\":%lu,\"max\":%lu,\"buckets\":[",
+                       latency_trace_stage_name(stage), (unsigned long)histogram->count,
+                       (unsigned long)(histogram->sum / histogram->count),
+                       (unsigned long)latency_histogram_percentile(histogram, 50),
+                       (unsigned long)latency_histogram_percentile(histogram, 99), (unsigned long)histogram->max);
+        int used = latency_histogram_used_buckets(histogram);
+        for (int bucket = 0; bucket < used; bucket++) {
+            len += sprintf(latency_buffer + len, "%s%lu", bucket ? "," : "", (unsigned long)histogram->buckets[bucket]);
+        }
+        len += sprintf(latency_buffer + len, "]}");
+    }
+    len += sprintf(latency_buffer + len, "}");
+    ESP_LOGD(TAG, "latency: %s", latency_buffer);
+    if (mqtt_connected) {
+        mqtt_enqueue(LATENCY_REPORT_TOPIC, latency_buffer, len);
+    }
+}
+#endif
+
+/**
+ * @brief Run the reports and forward the backlog, then arm the timer for the next run
+ * @details Runs every HOUSEKEEPING_PERIOD_US, or every drain interval while a backlog is being forwarded, so the
+ * main loop otherwise blocks and lets the chip sleep
+ */
+static void housekeeping(void)
+{
+    scheduler_report();
+    connection_report();
+    boot_report();
+#if CONFIG_LATENCY_TRACE
+    latency_report();
+#endif
+    uint64_t next = HOUSEKEEPING_PERIOD_US;
+#if CONFIG_READING_LOG
+    backlog_forward();
+    if (reading_log && mqtt_connected && (backlog_msg_id >= 0 || reading_log_pending(reading_log))) {
+        next = (uint64_t) CONFIG_READING_LOG_DRAIN_INTERVAL * 1000;
+    }
+#endif
+    esp_timer_stop(housekeeping_timer);
+    esp_timer_start_once(housekeeping_timer, next);
+}
+
+/**
+ * @brief Fuse, log or publish one burst reading taken out of a manager's ring
+ * @param reading reading in the ring slot
+ * @param handled_at latency trace stamp of the event that woke the main loop
+ */
+static void handle_reading(const pms5003T_reading_t *reading, uint32_t handled_at) {
+    LATENCY_TRACE_RECORD(LATENCY_STAGE_DELIVER, reading->stage_at);
+    if (!boot_timing.first_reading_at) {
+        boot_timing.first_reading_at = esp_timer_get_time();
+    }
+#if CONFIG_READING_FUSION
+    fuse_reading(reading);
+#endif
+#if CONFIG_READING_LOG
+    if (reading_log && !mqtt_connected) {
+        if (reading_log_append(reading_log, reading) != ESP_OK) {
+            ESP_LOGE(TAG, "logging reading failed");
+        }
+        return;
+    }
+#endif
+    publish_reading(reading);
+    if (mqtt_connected && !boot_timing.first_publish_at) {
+        boot_timing.first_publish_at = esp_timer_get_time();
+        boot_report();
+    }
+    LATENCY_TRACE_RECORD(LATENCY_STAGE_ENQUEUE, handled_at);
+    LATENCY_TRACE_RECORD(LATENCY_STAGE_TOTAL, reading->received_at);
+}
+
+/**
+ * @brief Handle every reading waiting in the managers' rings
+ * @param handled_at latency trace stamp of the event that woke the main loop
+ */
+static void drain_sensor_rings(uint32_t handled_at) {
+    for (int ring = 0; ring < sensor_ring_count; ring++) {
+        const pms5003T_reading_t *reading;
+        while ((reading = reading_ring_peek(sensor_rings[ring]))) {
+            handle_reading(reading, handled_at);
+            reading_ring_release(sensor_rings[ring]);
+        }
+    }
+}
+
+static void handle_event(esp_event_base_t event_base, int32_t event_id, void *event_data) {
+    uint32_t handled_at = LATENCY_TRACE_NOW();
+    if (event_base == HOUSEKEEPING_EVENT) {
+        /* Picks up readings whose PMS5003T_MANAGER_READINGS_QUEUED was lost to a full queue */
+        drain_sensor_rings(handled_at);
+        housekeeping();
+        return;
+    }
+#if configUSE_TRACE_FACILITY
+    if (event_base == STATS_COLLECTOR_EVENT && event_id == TASK_STATE) {
+        publish_telemetry((stats_collector_snapshot_t *) event_data);
+        return;
+    }
+#endif
+    if (event_base == PMS5003_MANAGER_EVENT) {
+        switch (event_id) {
+            case PMS5003T_MANAGER_READINGS_QUEUED:
+                drain_sensor_rings(handled_at);
                 break;
+#if CONFIG_MQTT_PUBLISH_SUMMARIES
+            case PMS5003T_MANAGER_SUMMARY:
+                publish_summary((reading_summary_t *) event_data);
+                break;
+#endif
+#if CONFIG_PMS5003_ADAPTIVE_INTERVAL
+            case PMS5003T_MANAGER_SCHEDULE:
+                publish_schedule((pms5003_scheduler_decision_t *) event_data);
+                break;
+#endif
         }
     }
 }
 
+/**
+ * Handle every main loop event at full CPU speed, formatting and queuing a burst's publishes is when it is busiest
+ */
+static void sensor_event_handler(void *event_handler_arg, esp_event_base_t event_base, int32_t event_id, void *event_data) {
+#if CONFIG_PM_ENABLE
+    esp_pm_lock_acquire(dispatch_lock);
+#endif
+    handle_event(event_base, event_id, event_data);
+#if CONFIG_PM_ENABLE
+    esp_pm_lock_release(dispatch_lock);
+#endif
+}
+
+/**
+ * @brief Let the chip drop its clock and enter light sleep whenever every task is blocked
+ * @details Locks hold it awake while a sensor is being read and while the main loop is busy, the Wi-Fi driver
+ * takes its own around radio activity
+ */
+static void power_init(void)
+{
+#if CONFIG_PM_ENABLE
+    if (esp_pm_lock_create(ESP_PM_CPU_FREQ_MAX, 0, "main_events", &dispatch_lock) != ESP_OK) {
+        ESP_LOGE(TAG, "main loop power management lock creation failed");
+    }
+#endif
+#if CONFIG_POWER_SAVE
+    esp_pm_config_t pm_config = {
+            .max_freq_mhz = CONFIG_ESP_DEFAULT_CPU_FREQ_MHZ,
+            .min_freq_mhz = CONFIG_XTAL_FREQ,
+            .light_sleep_enable = true,
+    };
+    if (esp_pm_configure(&pm_config) != ESP_OK) {
+        ESP_LOGE(TAG, "enabling automatic light sleep failed");
+    }
+#endif
+}
+
+/**
+ * Drain a started sensor manager's readings on the main loop, managers that failed to start are skipped
+ */
+static void add_sensor_manager(pms5003_manager_handle_t manager)
+{
+    if (manager && sensor_ring_count < MQTT_MAX_SENSORS) {
+        sensor_rings[sensor_ring_count++] = pms5003_manager_get_readings(manager);
+    }
+}
+
+/**
+ * @brief Start bringing up Wi-Fi, the clock and the broker connection, without waiting for any of them
+ */
+static void network_init(void)
+{
+    wifi_link_init();
+    time_sync_init();
+    mqtt_init();
+}
+
 void app_main(void) {
     /* Initialize NVS partition */
     esp_err_t ret = nvs_flash_init();
@@ -286,15 +1069,15 @@ void app_main(void) {
         /* Retry nvs_flash_init */
         ESP_ERROR_CHECK(nvs_flash_init());
     }
+    power_init();
 
-    wifi_init_sta();
-    mqtt_init();
-
+#if CONFIG_READING_LOG
+    backlog_init();
+#endif
     esp_event_loop_args_t event_loop_args = {
             .queue_size = 32,
             .task_name = NULL
     };
-    esp_event_loop_handle_t main_events;
     if (esp_event_loop_create(&event_loop_args, &main_events) != ESP_OK) {
         ESP_LOGE(TAG, "main event loop creation failed");
         esp_restart();
@@ -303,8 +1086,15 @@ void app_main(void) {
     esp_event_handler_register_with(main_events, ESP_EVENT_ANY_BASE, ESP_EVENT_ANY_ID,
                                     sensor_event_handler, NULL);
 
+    esp_timer_create_args_t housekeeping_timer_args = {
+            .callback = housekeeping_timer_callback,
+            .name = "housekeeping",
+    };
+    ESP_ERROR_CHECK(esp_timer_create(&housekeeping_timer_args, &housekeeping_timer));
+    housekeeping_kick();
+
     #if configUSE_TRACE_FACILITY
-    stats_collector_init(NULL);
+    stats_collector_init(main_events);
     #endif
 
     pms5003_config_t config1 = PMS5003_CONFIG_DEFAULT();
@@ -316,6 +1106,8 @@ void app_main(void) {
 //    pms5003_add_handler(pms5003_handle_1, pms5003_event_handler, NULL);
 
     pms5003_manager_handle_t pms5003_handle_1 = pms5003_manager_init(&config1, "SENS1", main_events);
+    add_sensor_manager(pms5003_handle_1);
+    get_sensor_topics("SENS1");
 
 
     pms5003_config_t config2 = PMS5003_CONFIG_DEFAULT();
@@ -324,8 +1116,20 @@ void app_main(void) {
 //    pms5003_handle_t pms5003_handle_2 = pms5003_init(&config2);
 //    pms5003_add_handler(pms5003_handle_2, pms5003_event_handler, NULL);
     pms5003_manager_handle_t pms5003_handle_2 = pms5003_manager_init(&config2, "SENS0", main_events);
+    add_sensor_manager(pms5003_handle_2);
+    get_sensor_topics("SENS0");
+    boot_timing.sensors_at = esp_timer_get_time();
+#if CONFIG_READING_FUSION
+    /* Fusion needs the aligned schedule, both sensors read at the same time */
+    reading_fusion_init(&reading_fusion, "SENS0", "SENS1", CONFIG_READING_FUSION_PAIR_WINDOW,
+                        CONFIG_READING_FUSION_DIVERGENCE);
+#endif
+
+    /* The network comes up in the background while the sensors spin up, readings taken before the broker is
+     * reachable are buffered in the reading log or the MQTT outbox */
+    network_init();
 
     while (1) {
-        esp_event_loop_run(main_events, pdMS_TO_TICKS(50));
+        esp_event_loop_run(main_events, portMAX_DELAY);
     }
 }
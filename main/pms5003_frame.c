@@ -0,0 +1,184 @@
+/* Airgradient Outdoor Sensor V1.1 firmware using ESP-IDF
+ * Copyright (C) 2023 Zach Strauss
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include <string.h>
+#include "pms5003_frame.h"
+#include "sdkconfig.h"
+
+#define PMS5003_FRAME_PAYLOAD_LEN (PMS5003_FRAME_LEN - 4)
+#define PMS5003_FRAME_SOM_1 (0x42)
+#define PMS5003_FRAME_SOM_2 (0x4D)
+
+#define PMS5003_HEADER_SCAN_ATTEMPTS CONFIG_PMS5003_SOH_SCAN_LENGTH
+
+/**
+ * Fetch the big-endian data word at the given payload field index of a frame
+ */
+#define PMS5003_FRAME_FIELD(frame, index) ((uint16_t)(((frame)[4 + 2 * (index)] << 8) | (frame)[5 + 2 * (index)]))
+
+/**
+ * Find where the next message header starts in a partially filled frame buffer
+ * @param buffer bytes read so far
+ * @param len number of valid bytes in buffer
+ * @return offset of the first possible header byte, len if none was found
+ */
+static int pms5003_find_header(const uint8_t *buffer, int len)
+{
+    for (int offset = 0; offset < len; offset++) {
+        if (buffer[offset] != PMS5003_FRAME_SOM_1) {
+            continue;
+        }
+        if (offset + 1 == len || buffer[offset + 1] == PMS5003_FRAME_SOM_2) {
+            return offset;
+        }
+    }
+    return len;
+}
+
+/**
+ * Drop bytes from the front of the partial frame buffer
+ * @param parser
+ * @param count number of bytes to drop
+ * @return true if the header scan limit was hit
+ */
+static bool pms5003_discard_bytes(pms5003_frame_parser_t *parser, int count)
+{
+    parser->filled -= count;
+    memmove(parser->buffer, parser->buffer + count, parser->filled);
+    parser->discarded += count;
+    if (parser->discarded >= PMS5003_HEADER_SCAN_ATTEMPTS) {
+        parser->discarded = 0;
+        return true;
+    }
+    return false;
+}
+
+int pms5003_frame_decode(const uint8_t *frame, pms5003T_reading_t *reading)
+{
+    if (frame[0] != PMS5003_FRAME_SOM_1 || frame[1] != PMS5003_FRAME_SOM_2) {
+        return -1;
+    }
+    if (((frame[2] << 8) | frame[3]) != PMS5003_FRAME_PAYLOAD_LEN) {
+        return -4;
+    }
+
+    uint16_t checksum = 0;
+    for (int i = 0; i < PMS5003_FRAME_LEN - 2; i++) {
+        checksum += frame[i];
+    }
+    if (checksum != ((frame[PMS5003_FRAME_LEN - 2] << 8) | frame[PMS5003_FRAME_LEN - 1])) {
+        return -2;
+    }
+
+    uint16_t fields[PMS5003_FIELD_COUNT];
+    for (int i = 0; i < PMS5003_FIELD_COUNT; i++) {
+        fields[i] = PMS5003_FRAME_FIELD(frame, i);
+    }
+    pms5003_reading_unpack(fields, reading);
+    return 0;
+}
+
+void pms5003_frame_encode(const pms5003T_reading_t *reading, uint8_t *frame)
+{
+    uint16_t fields[PMS5003_FIELD_COUNT];
+    pms5003_reading_pack(reading, fields);
+
+    memset(frame, 0, PMS5003_FRAME_LEN);
+    frame[0] = PMS5003_FRAME_SOM_1;
+    frame[1] = PMS5003_FRAME_SOM_2;
+    frame[3] = PMS5003_FRAME_PAYLOAD_LEN;
+    for (int i = 0; i < PMS5003_FIELD_COUNT; i++) {
+        frame[4 + 2 * i] = fields[i] >> 8;
+        frame[5 + 2 * i] = fields[i] & 0xFF;
+    }
+
+    uint16_t checksum = 0;
+    for (int i = 0; i < PMS5003_FRAME_LEN - 2; i++) {
+        checksum += frame[i];
+    }
+    frame[PMS5003_FRAME_LEN - 2] = checksum >> 8;
+    frame[PMS5003_FRAME_LEN - 1] = checksum & 0xFF;
+}
+
+void pms5003_frame_parser_reset(pms5003_frame_parser_t *parser)
+{
+    parser->filled = 0;
+    parser->discarded = 0;
+}
+
+uint8_t *pms5003_frame_parser_space(pms5003_frame_parser_t *parser, size_t *space)
+{
+    *space = PMS5003_FRAME_LEN - parser->filled;
+    return parser->buffer + parser->filled;
+}
+
+int pms5003_frame_parser_commit(pms5003_frame_parser_t *parser, size_t len, pms5003T_reading_t *reading)
+{
+    int ret = PMS5003_FRAME_INCOMPLETE;
+    parser->filled += len;
+
+    int offset = pms5003_find_header(parser->buffer, parser->filled);
+    if (offset > 0 && pms5003_discard_bytes(parser, offset)) {
+        ret = -1;
+    }
+    if (parser->filled < PMS5003_FRAME_LEN) {
+        return ret;
+    }
+
+    ret = pms5003_frame_decode(parser->buffer, reading);
+    if (ret != 0) {
+        /* Resync on the next candidate header rather than throwing the whole frame away */
+        pms5003_discard_bytes(parser, 1);
+        return ret;
+    }
+    pms5003_frame_parser_reset(parser);
+    return 0;
+}
+
+void pms5003_reading_pack(const pms5003T_reading_t *reading, uint16_t *fields)
+{
+    fields[0] = reading->standard.pm_1_0;
+    fields[1] = reading->standard.pm_2_5;
+    fields[2] = reading->standard.pm_10_0;
+    fields[3] = reading->atmospheric.pm_1_0;
+    fields[4] = reading->atmospheric.pm_2_5;
+    fields[5] = reading->atmospheric.pm_10_0;
+    fields[6] = reading->raw_pm_0_3;
+    fields[7] = reading->raw_pm_0_5;
+    fields[8] = reading->raw_pm_1_0;
+    fields[9] = reading->raw_pm_2_5;
+    fields[10] = (uint16_t)reading->temperature;
+    fields[11] = reading->humidity;
+    fields[12] = reading->voc;
+}
+
+void pms5003_reading_unpack(const uint16_t *fields, pms5003T_reading_t *reading)
+{
+    reading->standard.pm_1_0 = fields[0];
+    reading->standard.pm_2_5 = fields[1];
+    reading->standard.pm_10_0 = fields[2];
+    reading->atmospheric.pm_1_0 = fields[3];
+    reading->atmospheric.pm_2_5 = fields[4];
+    reading->atmospheric.pm_10_0 = fields[5];
+    reading->raw_pm_0_3 = fields[6];
+    reading->raw_pm_0_5 = fields[7];
+    reading->raw_pm_1_0 = fields[8];
+    reading->raw_pm_2_5 = fields[9];
+    reading->temperature = (int16_t)fields[10];
+    reading->humidity = fields[11];
+    reading->voc = fields[12];
+}
@@ -0,0 +1,155 @@
+/* Airgradient Outdoor Sensor V1.1 firmware using ESP-IDF
+ * Copyright (C) 2023 Zach Strauss
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+
+/**
+ * Length of a complete measurement frame, including header and checksum
+ */
+#define PMS5003_FRAME_LEN (32)
+
+/**
+ * Number of data words carried in a measurement frame
+ */
+#define PMS5003_FIELD_COUNT (13)
+
+/**
+ * Index of temperature, the only signed data word, in pms5003_reading_pack() order
+ */
+#define PMS5003_FIELD_TEMPERATURE (10)
+
+/**
+ * Frame parser result when more bytes are needed to complete a frame
+ */
+#define PMS5003_FRAME_INCOMPLETE (1)
+
+/**
+ * Capture times below this are seconds since boot, counted from 1, rather than Unix time
+ * @details Uptime stays below it for 31 years, Unix time has been above it since 2001. 0 means unknown.
+ */
+#define PMS5003_CAPTURED_EPOCH_MIN (1000000000)
+
+/**
+ * Particle concentrations in ug/m3
+ */
+typedef struct {
+    uint16_t pm_1_0; /*!< PM1.0 */
+    uint16_t pm_2_5; /*!< PM2.5 */
+    uint16_t pm_10_0; /*!< PM10.0 */
+} pms5003_concentration_t;
+
+/**
+ * Individual reading off the sensor
+ */
+typedef struct {
+    pms5003_concentration_t standard; /*!< Concentration at standard particle */
+    pms5003_concentration_t atmospheric; /*!< Concentration under atmospheric conditions */
+
+    uint16_t raw_pm_0_3; /*!< Raw number of particles larger than 0.3um in 0.1L of air */
+    uint16_t raw_pm_0_5; /*!< Raw number of particles larger than 0.5um in 0.1L of air */
+    uint16_t raw_pm_1_0; /*!< Raw number of particles larger than 1.0um in 0.1L of air */
+    uint16_t raw_pm_2_5; /*!< Raw number of particles larger than 2.5um in 0.1L of air */
+
+    int16_t temperature; /*!< Temperature (in tenths of a degree C) */
+    uint16_t humidity; /*!< Relative Humidity (in tenths of a percent) */
+    uint16_t voc; /*!< */
+
+    uint16_t pm_2_5_corrected; /*!< Humidity corrected PM2.5 (in tenths of a ug/m3), derived by the manager */
+    uint16_t aqi; /*!< US EPA AQI of pm_2_5_corrected, derived by the manager */
+
+    uint32_t captured_at; /*!< time the frame was read, Unix time in s once the clock is set, see PMS5003_CAPTURED_EPOCH_MIN */
+    uint32_t received_at; /*!< time the UART event carrying the frame was handled, in us, for latency tracing */
+    uint32_t stage_at; /*!< time the reading left its last pipeline stage, in us, for latency tracing */
+
+    char *sensor_id; /*!< Sensor name to report against */
+} pms5003T_reading_t;
+
+/**
+ * Resumable parser state for a byte stream coming off the sensor
+ */
+typedef struct {
+    uint8_t buffer[PMS5003_FRAME_LEN]; /*!< frame-sized buffer to read into */
+    int filled; /*!< bytes of the current partial frame held in buffer */
+    int discarded; /*!< bytes dropped while searching for the next message header */
+} pms5003_frame_parser_t;
+
+/**
+ * @brief Drop any partial frame and start looking for a new message header
+ * @param parser parser instance
+ */
+void pms5003_frame_parser_reset(pms5003_frame_parser_t *parser);
+
+/**
+ * @brief Get the space the next incoming bytes should be written into
+ * @details Bytes are written straight into the parser buffer so a frame is never copied before decoding
+ * @param parser parser instance
+ * @param space set to the number of bytes that may be written
+ * @return pointer to write the next bytes to
+ */
+uint8_t *pms5003_frame_parser_space(pms5003_frame_parser_t *parser, size_t *space);
+
+/**
+ * @brief Account for bytes written into the parser space and decode a frame if one is complete
+ * @param parser parser instance
+ * @param len number of bytes written
+ * @param reading destination for the decoded fields when a frame completes
+ * @return
+ *     0: reading holds a new, validated frame
+ *     PMS5003_FRAME_INCOMPLETE: more bytes are needed
+ *     -1: CONFIG_PMS5003_SOH_SCAN_LENGTH bytes were dropped looking for a message header
+ *     -2: Checksum validation failed
+ *     -4: Unexpected payload length
+ */
+int pms5003_frame_parser_commit(pms5003_frame_parser_t *parser, size_t len, pms5003T_reading_t *reading);
+
+/**
+ * @brief Validate and decode a complete measurement frame
+ * @param frame PMS5003_FRAME_LEN bytes starting at the message header
+ * @param reading destination for the decoded fields
+ * @return
+ *     0: No error
+ *     -1: Message header not found at start of frame
+ *     -2: Checksum validation failed
+ *     -4: Unexpected payload length
+ */
+int pms5003_frame_decode(const uint8_t *frame, pms5003T_reading_t *reading);
+
+/**
+ * @brief Build the measurement frame a sensor would send for a reading
+ * @param reading reading to encode
+ * @param frame destination for PMS5003_FRAME_LEN bytes
+ */
+void pms5003_frame_encode(const pms5003T_reading_t *reading, uint8_t *frame);
+
+/**
+ * @brief Copy the data fields of a reading into an array, in the order they appear on the wire
+ * @param reading reading to copy from
+ * @param fields PMS5003_FIELD_COUNT entries to copy to
+ */
+void pms5003_reading_pack(const pms5003T_reading_t *reading, uint16_t *fields);
+
+/**
+ * @brief Fill the data fields of a reading from an array in wire order
+ * @details sensor_id is left untouched
+ * @param fields PMS5003_FIELD_COUNT entries to copy from
+ * @param reading reading to copy to
+ */
+void pms5003_reading_unpack(const uint16_t *fields, pms5003T_reading_t *reading);
@@ -15,112 +15,386 @@
  * along with this program.  If not, see <https://www.gnu.org/licenses/>.
  */
 
+#include <stdatomic.h>
 #include "pms5003_manager.h"
 #include "pms5003t.h"
+#include "pms5003_reactor.h"
+#include "pms5003_scheduler.h"
+#include "reading_aggregator.h"
+#include "reading_reducer.h"
+#include "reading_convergence.h"
+#include "reading_aqi.h"
+#include "latency_trace.h"
 #include "esp_log.h"
+#include "esp_timer.h"
+#include "esp_pm.h"
 #include "sdkconfig.h"
 
 #define PMS5003_MANAGER_READCOUNT CONFIG_PMS5003_MANAGER_READ_COUNT
 #define PMS5003_MANAGER_SPINUP_TICKS (CONFIG_PMS5003_MANAGER_SPINUP_TIME * 1000) / portTICK_PERIOD_MS
-#define PMS5003_MANAGER_SLEEP_TICKS (CONFIG_PMS5003_MANAGER_SLEEP_TIME * 1000) / portTICK_PERIOD_MS
+#define PMS5003_MANAGER_READ_TIMEOUT_TICKS pdMS_TO_TICKS(CONFIG_PMS5003_MANAGER_READ_TIMEOUT)
+#define PMS5003_MANAGER_READ_RETRIES CONFIG_PMS5003_MANAGER_READ_RETRIES
+
+#if CONFIG_PMS5003_ADAPTIVE_SPINUP
+#define PMS5003_MANAGER_SPINUP_MIN_TICKS pdMS_TO_TICKS(CONFIG_PMS5003_SPINUP_MIN_TIME * 1000)
+#define PMS5003_MANAGER_SETTLE_INTERVAL_TICKS pdMS_TO_TICKS(CONFIG_PMS5003_SPINUP_SAMPLE_INTERVAL)
+#endif
+
+#if CONFIG_PMS5003_MANAGER_REDUCE_MEDIAN
+#define PMS5003_MANAGER_REDUCTION READING_REDUCE_MEDIAN
+#define PMS5003_MANAGER_TRIM_PERCENT (0)
+#elif CONFIG_PMS5003_MANAGER_REDUCE_TRIMMED_MEAN
+#define PMS5003_MANAGER_REDUCTION READING_REDUCE_TRIMMED_MEAN
+#define PMS5003_MANAGER_TRIM_PERCENT CONFIG_PMS5003_MANAGER_TRIM_PERCENT
+#endif
 
 static const char *PMS5003_MANAGER_TAG = "PMS5003_manager";
 ESP_EVENT_DEFINE_BASE(PMS5003_MANAGER_EVENT);
 
+/**
+ * Where the manager is in its duty cycle
+ */
+typedef enum {
+    MANAGER_STATE_WAKE, /*!< sensor is due to be woken */
+    MANAGER_STATE_SPINUP, /*!< fan is spinning up, readings are not valid yet */
+    MANAGER_STATE_SETTLING, /*!< past the minimum spin-up, sampling until readings converge */
+    MANAGER_STATE_READING, /*!< read burst in progress */
+    MANAGER_STATE_SLEEPING /*!< sensor is asleep until the next cycle */
+} pms5003_manager_state_t;
+
 typedef struct {
     pms5003_handle_t sensor_handle;
     pms5003T_reading_t pending_reading;
+    reading_aggregator_t aggregator;
+#ifdef PMS5003_MANAGER_REDUCTION
+    uint16_t burst[PMS5003_MANAGER_READCOUNT][PMS5003_FIELD_COUNT]; /*!< packed readings of the burst, for the reducer */
+#endif
     int remaining_reads;
-    bool read_pending;
+    int failures;
+    pms5003_manager_state_t state;
+    TickType_t deadline;
+    int schedule_slot;
+    uint32_t burst_captured_at; /*!< capture time of the newest reading in the burst */
+    uint32_t burst_received_at; /*!< latency trace stamp of the newest reading in the burst */
+    uint32_t burst_flags; /*!< PMS5003_MANAGER_LATEST_* flags gathered while the burst ran */
+    uint32_t burst_count; /*!< bursts completed */
+    atomic_uint latest_sequence; /*!< bumped before each copy of latest is written, readers use latest[sequence & 1] */
+    pms5003_manager_latest_t latest[2]; /*!< two copies, so one is always consistent for readers */
+#if CONFIG_PMS5003_ADAPTIVE_SPINUP
+    TickType_t woken_at; /*!< when the fan was switched on */
+    reading_convergence_t convergence;
+#endif
+    reading_ring_t output; /*!< burst readings for the main loop, woken with PMS5003T_MANAGER_READINGS_QUEUED */
+    bool output_wake_lost; /*!< the last PMS5003T_MANAGER_READINGS_QUEUED post failed, the main loop may be asleep */
+#if !CONFIG_PMS5003_REACTOR
+    reading_ring_t input; /*!< readings parsed by the driver task */
     TaskHandle_t task_handle;
+#endif
+#if CONFIG_PM_ENABLE
+    esp_pm_lock_handle_t uart_lock; /*!< keeps the chip out of light sleep, which stops UART reception */
+    bool uart_lock_held;
+#endif
     char *TAG;
 
     esp_event_loop_handle_t event_target;
 } pms5003_manager_runtime_t;
 
+static const uint32_t PMS5003_MANAGER_WINDOWS[READING_WINDOW_COUNT] = {
+        CONFIG_READING_WINDOW_SHORT, CONFIG_READING_WINDOW_MEDIUM, CONFIG_READING_WINDOW_LONG
+};
+
+/**
+ * Monotonic time in seconds for the rolling windows, does not wrap like the tick count
+ */
+static uint32_t pms5003_manager_uptime(void) {
+    return (uint32_t) (esp_timer_get_time() / 1000000);
+}
+
 static void pms5003_manager_clear_pending_reads(pms5003_manager_runtime_t *runtime) {
     runtime->remaining_reads = PMS5003_MANAGER_READCOUNT;
-    runtime->read_pending = false;
-    runtime->pending_reading.voc = 0;
-    runtime->pending_reading.humidity = 0;
-    runtime->pending_reading.temperature = 0;
-    runtime->pending_reading.raw_pm_2_5 = 0;
-    runtime->pending_reading.raw_pm_1_0 = 0;
-    runtime->pending_reading.raw_pm_0_5 = 0;
-    runtime->pending_reading.raw_pm_0_3 = 0;
-    runtime->pending_reading.standard.pm_10_0 = 0;
-    runtime->pending_reading.standard.pm_2_5 = 0;
-    runtime->pending_reading.standard.pm_1_0 = 0;
-    runtime->pending_reading.atmospheric.pm_10_0 = 0;
-    runtime->pending_reading.atmospheric.pm_2_5 = 0;
-    runtime->pending_reading.atmospheric.pm_1_0 = 0;
-    runtime->pending_reading.sensor_id = runtime->TAG;
+    reading_aggregator_burst_reset(&runtime->aggregator);
+}
+
+/**
+ * @brief Publish a new latest snapshot
+ * @details Sequence latch: readers are moved over to one copy while the other is written, so a reader preempted by
+ * the manager, or a higher priority reader, always finds a consistent copy. Only the manager writes.
+ */
+static void pms5003_manager_set_latest(pms5003_manager_runtime_t *runtime, const pms5003T_reading_t *reading,
+                                       int count) {
+    uint32_t flags = runtime->burst_flags;
+    if (count < PMS5003_MANAGER_READCOUNT) {
+        flags |= PMS5003_MANAGER_LATEST_PARTIAL;
+    }
+    if (reading->captured_at < PMS5003_CAPTURED_EPOCH_MIN) {
+        flags |= PMS5003_MANAGER_LATEST_CLOCK_UNSET;
+    }
+    runtime->burst_count++;
+
+    unsigned sequence = atomic_load_explicit(&runtime->latest_sequence, memory_order_relaxed);
+    for (int copy = 0; copy < 2; copy++) {
+        atomic_store_explicit(&runtime->latest_sequence, ++sequence, memory_order_relaxed);
+        atomic_thread_fence(memory_order_release);
+        pms5003_manager_latest_t *latest = &runtime->latest[copy];
+        latest->reading = *reading;
+        latest->sample_count = count;
+        latest->burst = runtime->burst_count;
+        latest->flags = flags;
+        atomic_thread_fence(memory_order_release);
+    }
+}
+
+/**
+ * Post the burst reduced to one reading, the scheduling decision it led to, then a summary of every rolling window
+ */
+static void pms5003_manager_post(pms5003_manager_runtime_t *runtime, int count) {
+    uint32_t post_start = LATENCY_TRACE_NOW();
+    reading_summary_t summary;
+    reading_aggregator_burst_summary(&runtime->aggregator, &summary);
+#ifdef PMS5003_MANAGER_REDUCTION
+    reading_reduce(runtime->burst, count, PMS5003_MANAGER_REDUCTION, PMS5003_MANAGER_TRIM_PERCENT,
+                   &runtime->pending_reading);
+#else
+    runtime->pending_reading = summary.mean;
+#endif
+    pms5003T_reading_t *reading = &runtime->pending_reading;
+    reading->sensor_id = runtime->TAG;
+    reading_aqi_derive(reading);
+    reading->captured_at = runtime->burst_captured_at;
+    reading->received_at = runtime->burst_received_at;
+    reading->stage_at = LATENCY_TRACE_NOW();
+    LATENCY_TRACE_RECORD(LATENCY_STAGE_AGGREGATE, post_start);
+    pms5003_manager_set_latest(runtime, reading, count);
+
+    pms5003T_reading_t *slot = reading_ring_reserve(&runtime->output);
+    if (slot) {
+        *slot = *reading;
+        /* Only wake the main loop when it may have drained the ring, it picks up everything committed meanwhile.
+         * A wake-up lost to a full queue is posted again with the next reading, housekeeping drains the rest */
+        if (reading_ring_commit(&runtime->output) || runtime->output_wake_lost) {
+            runtime->output_wake_lost = esp_event_post_to(runtime->event_target, PMS5003_MANAGER_EVENT,
+                                                          PMS5003T_MANAGER_READINGS_QUEUED, NULL, 0,
+                                                          100 / portTICK_PERIOD_MS) != ESP_OK;
+        }
+    } else {
+        atomic_fetch_add_explicit(&runtime->output.dropped, 1, memory_order_relaxed);
+        ESP_LOGW(PMS5003_MANAGER_TAG, "%s dropped reading, main loop is behind", runtime->TAG);
+    }
+
+    pms5003_scheduler_decision_t decision;
+    pms5003_scheduler_report(runtime->schedule_slot, reading->atmospheric.pm_2_5,
+                             summary.stddev.atmospheric.pm_2_5, &decision);
+    decision.sensor_id = runtime->TAG;
+    esp_event_post_to(runtime->event_target, PMS5003_MANAGER_EVENT, PMS5003T_MANAGER_SCHEDULE,
+                      &decision, sizeof(pms5003_scheduler_decision_t), 100 / portTICK_PERIOD_MS);
+
+    uint32_t now = pms5003_manager_uptime();
+    for (int window = 0; window < READING_WINDOW_COUNT; window++) {
+        reading_aggregator_window_summary(&runtime->aggregator, window, now, &summary);
+        summary.mean.sensor_id = runtime->TAG;
+        summary.mean.captured_at = runtime->burst_captured_at;
+        summary.min.sensor_id = runtime->TAG;
+        summary.max.sensor_id = runtime->TAG;
+        summary.stddev.sensor_id = runtime->TAG;
+        esp_event_post_to(runtime->event_target, PMS5003_MANAGER_EVENT, PMS5003T_MANAGER_SUMMARY,
+                          &summary, sizeof(reading_summary_t), 100 / portTICK_PERIOD_MS);
+    }
+}
+
+/**
+ * @brief Hold the chip out of light sleep while the sensor is being read
+ * @details Held from the first read request after wake until the sensor is put back to sleep. The wake command
+ * needs no lock, UART transmission is finished before light sleep is entered.
+ */
+static void pms5003_manager_hold_uart(pms5003_manager_runtime_t *runtime, bool hold) {
+#if CONFIG_PM_ENABLE
+    if (hold != runtime->uart_lock_held) {
+        runtime->uart_lock_held = hold;
+        if (hold) {
+            esp_pm_lock_acquire(runtime->uart_lock);
+        } else {
+            esp_pm_lock_release(runtime->uart_lock);
+        }
+    }
+#endif
+}
+
+/**
+ * Ask the sensor for the next reading of the burst
+ */
+static void pms5003_manager_request_read(pms5003_manager_runtime_t *runtime, TickType_t now) {
+    pms5003_manager_hold_uart(runtime, true);
+    pms5003_request_read(runtime->sensor_handle);
+    runtime->deadline = now + PMS5003_MANAGER_READ_TIMEOUT_TICKS;
+}
+
+/**
+ * Spin-up is over, start the read burst
+ */
+static void pms5003_manager_start_burst(pms5003_manager_runtime_t *runtime, TickType_t now) {
+#if CONFIG_PMS5003_ADAPTIVE_SPINUP
+    ESP_LOGI(PMS5003_MANAGER_TAG, "%s spun up in %lu ms", runtime->TAG,
+             (unsigned long) pdTICKS_TO_MS(now - runtime->woken_at));
+#endif
+    pms5003_manager_clear_pending_reads(runtime);
+    runtime->failures = 0;
+    runtime->burst_flags = 0;
+    runtime->state = MANAGER_STATE_READING;
+    pms5003_manager_request_read(runtime, now);
+}
+
+/**
+ * Put the sensor to sleep and post the average of whatever the burst collected
+ */
+static void pms5003_manager_finish_burst(pms5003_manager_runtime_t *runtime, TickType_t now) {
+    int count = PMS5003_MANAGER_READCOUNT - runtime->remaining_reads;
+    pms5003_request_sleep(runtime->sensor_handle, SLEEP_SLEEP);
+    pms5003_manager_hold_uart(runtime, false);
+
+    if (count > 0) {
+        pms5003_manager_post(runtime, count);
+    }
+
+    pms5003_scheduler_fan(runtime->schedule_slot, false, now);
+    runtime->state = MANAGER_STATE_SLEEPING;
+    runtime->deadline = pms5003_scheduler_next_wake(runtime->schedule_slot, now);
+}
+
+/**
+ * @brief Advance the duty cycle past any deadline that has expired
+ * @param runtime manager instance
+ * @param now current tick count
+ * @return ticks until the next deadline
+ */
+static TickType_t pms5003_manager_step(pms5003_manager_runtime_t *runtime, TickType_t now) {
+    while ((int32_t)(runtime->deadline - now) <= 0) {
+        switch (runtime->state) {
+            case MANAGER_STATE_WAKE:
+                pms5003_request_sleep(runtime->sensor_handle, SLEEP_AWAKE);
+                pms5003_scheduler_fan(runtime->schedule_slot, true, now);
+                runtime->state = MANAGER_STATE_SPINUP;
+#if CONFIG_PMS5003_ADAPTIVE_SPINUP
+                runtime->woken_at = now;
+                runtime->deadline = now + PMS5003_MANAGER_SPINUP_MIN_TICKS;
+#else
+                runtime->deadline = now + PMS5003_MANAGER_SPINUP_TICKS;
+#endif
+                break;
+            case MANAGER_STATE_SPINUP:
+#if CONFIG_PMS5003_ADAPTIVE_SPINUP
+                reading_convergence_init(&runtime->convergence, CONFIG_PMS5003_SPINUP_TOLERANCE,
+                                         CONFIG_PMS5003_SPINUP_STABLE_COUNT);
+                runtime->state = MANAGER_STATE_SETTLING;
+                pms5003_manager_request_read(runtime, now);
+#else
+                pms5003_manager_start_burst(runtime, now);
+#endif
+                break;
+#if CONFIG_PMS5003_ADAPTIVE_SPINUP
+            case MANAGER_STATE_SETTLING:
+                if (now - runtime->woken_at >= PMS5003_MANAGER_SPINUP_TICKS) {
+                    pms5003_manager_start_burst(runtime, now);
+                    runtime->burst_flags |= PMS5003_MANAGER_LATEST_UNSETTLED;
+                } else {
+                    pms5003_manager_request_read(runtime, now);
+                }
+                break;
+#endif
+            case MANAGER_STATE_READING:
+                if (++runtime->failures > PMS5003_MANAGER_READ_RETRIES) {
+                    ESP_LOGE(PMS5003_MANAGER_TAG, "%s stopped responding, %d reads missing", runtime->TAG,
+                             runtime->remaining_reads);
+                    pms5003_manager_finish_burst(runtime, now);
+                } else {
+                    pms5003_manager_request_read(runtime, now);
+                }
+                break;
+            case MANAGER_STATE_SLEEPING:
+            default:
+                runtime->state = MANAGER_STATE_WAKE;
+                break;
+        }
+    }
+    return runtime->deadline - now;
+}
+
+/**
+ * @brief Take a reading from the sensor into the current burst, or into the spin-up convergence check
+ * @details Readings that show up outside of a burst or spin-up sampling are dropped
+ * @param runtime manager instance
+ * @param reading reading from the sensor
+ * @param now current tick count
+ */
+static void pms5003_manager_on_reading(pms5003_manager_runtime_t *runtime, const pms5003T_reading_t *reading,
+                                       TickType_t now) {
+#if CONFIG_PMS5003_ADAPTIVE_SPINUP
+    if (runtime->state == MANAGER_STATE_SETTLING) {
+        if (reading_convergence_add(&runtime->convergence, reading)) {
+            pms5003_manager_start_burst(runtime, now);
+        } else if (now - runtime->woken_at >= PMS5003_MANAGER_SPINUP_TICKS) {
+            pms5003_manager_start_burst(runtime, now);
+            runtime->burst_flags |= PMS5003_MANAGER_LATEST_UNSETTLED;
+        } else {
+            runtime->deadline = now + PMS5003_MANAGER_SETTLE_INTERVAL_TICKS;
+        }
+        return;
+    }
+#endif
+    if (runtime->state != MANAGER_STATE_READING) {
+        return;
+    }
+    LATENCY_TRACE_RECORD(LATENCY_STAGE_HANDOFF, reading->stage_at);
+    runtime->burst_captured_at = reading->captured_at;
+    runtime->burst_received_at = reading->received_at;
+    reading_aggregator_add(&runtime->aggregator, reading, pms5003_manager_uptime());
+#ifdef PMS5003_MANAGER_REDUCTION
+    pms5003_reading_pack(reading, runtime->burst[PMS5003_MANAGER_READCOUNT - runtime->remaining_reads]);
+#endif
+    runtime->remaining_reads--;
+    runtime->failures = 0;
+    if (runtime->remaining_reads > 0) {
+        pms5003_manager_request_read(runtime, now);
+    } else {
+        pms5003_manager_finish_burst(runtime, now);
+    }
 }
 
+#if CONFIG_PMS5003_REACTOR
+/**
+ * Readings are handed over directly, the handler runs in the I/O task alongside the duty cycle
+ */
 static void pms5003_manager_event_handler(void *event_handler_arg, esp_event_base_t event_base, int32_t event_id,
                                           void *event_data) {
-    pms5003T_reading_t *pms5003T_reading = NULL;
     pms5003_manager_runtime_t *manager_runtime = (pms5003_manager_runtime_t *) event_handler_arg;
     if (event_base == PMS5003_EVENT) {
         switch (event_id) {
             case PMS5003T_READING:
-                manager_runtime->read_pending = false;
-
-                pms5003T_reading = (pms5003T_reading_t *) event_data;
-                manager_runtime->pending_reading.voc += pms5003T_reading->voc;
-                manager_runtime->pending_reading.humidity += pms5003T_reading->humidity;
-                manager_runtime->pending_reading.temperature += pms5003T_reading->temperature;
-                manager_runtime->pending_reading.raw_pm_2_5 += pms5003T_reading->raw_pm_2_5;
-                manager_runtime->pending_reading.raw_pm_1_0 += pms5003T_reading->raw_pm_1_0;
-                manager_runtime->pending_reading.raw_pm_0_5 += pms5003T_reading->raw_pm_0_5;
-                manager_runtime->pending_reading.raw_pm_0_3 += pms5003T_reading->raw_pm_0_3;
-                manager_runtime->pending_reading.standard.pm_10_0 += pms5003T_reading->standard.pm_10_0;
-                manager_runtime->pending_reading.standard.pm_2_5 += pms5003T_reading->standard.pm_2_5;
-                manager_runtime->pending_reading.standard.pm_1_0 += pms5003T_reading->standard.pm_1_0;
-                manager_runtime->pending_reading.atmospheric.pm_10_0 += pms5003T_reading->atmospheric.pm_10_0;
-                manager_runtime->pending_reading.atmospheric.pm_2_5 += pms5003T_reading->atmospheric.pm_2_5;
-                manager_runtime->pending_reading.atmospheric.pm_1_0 += pms5003T_reading->atmospheric.pm_1_0;
-                manager_runtime->remaining_reads--;
+                pms5003_manager_on_reading(manager_runtime, (pms5003T_reading_t *) event_data, xTaskGetTickCount());
                 break;
         }
     }
 }
 
+static TickType_t pms5003_manager_reactor_step(void *arg, TickType_t now) {
+    return pms5003_manager_step((pms5003_manager_runtime_t *) arg, now);
+}
+#else
+/**
+ * Run the duty cycle, taking readings out of the ring the driver task parses them into whenever it notifies
+ */
 static void pms5003_manager_task_entry(void *arg) {
     pms5003_manager_runtime_t *runtime = (pms5003_manager_runtime_t *)arg;
+    const pms5003T_reading_t *reading;
     while (1) {
-        pms5003_request_sleep(runtime->sensor_handle, SLEEP_AWAKE);
-        vTaskDelay(PMS5003_MANAGER_SPINUP_TICKS);
-        pms5003_manager_clear_pending_reads(runtime);
-        while (runtime->remaining_reads > 0) {
-            runtime->read_pending = true;
-            pms5003_request_read(runtime->sensor_handle);
-            while (runtime->read_pending == true) {
-                vTaskDelay(250 / portTICK_PERIOD_MS);
-            }
+        TickType_t wait = pms5003_manager_step(runtime, xTaskGetTickCount());
+        ulTaskNotifyTake(pdTRUE, wait);
+        while ((reading = reading_ring_peek(&runtime->input))) {
+            pms5003_manager_on_reading(runtime, reading, xTaskGetTickCount());
+            reading_ring_release(&runtime->input);
         }
-        runtime->pending_reading.voc /= PMS5003_MANAGER_READCOUNT;
-        runtime->pending_reading.humidity /= PMS5003_MANAGER_READCOUNT;
-        runtime->pending_reading.temperature /= PMS5003_MANAGER_READCOUNT;
-        runtime->pending_reading.raw_pm_2_5 /= PMS5003_MANAGER_READCOUNT;
-        runtime->pending_reading.raw_pm_1_0 /= PMS5003_MANAGER_READCOUNT;
-        runtime->pending_reading.raw_pm_0_5 /= PMS5003_MANAGER_READCOUNT;
-        runtime->pending_reading.raw_pm_0_3 /= PMS5003_MANAGER_READCOUNT;
-        runtime->pending_reading.standard.pm_10_0 /= PMS5003_MANAGER_READCOUNT;
-        runtime->pending_reading.standard.pm_2_5 /= PMS5003_MANAGER_READCOUNT;
-        runtime->pending_reading.standard.pm_1_0 /= PMS5003_MANAGER_READCOUNT;
-        runtime->pending_reading.atmospheric.pm_10_0 /= PMS5003_MANAGER_READCOUNT;
-        runtime->pending_reading.atmospheric.pm_2_5 /= PMS5003_MANAGER_READCOUNT;
-        runtime->pending_reading.atmospheric.pm_1_0 /= PMS5003_MANAGER_READCOUNT;
-
-        pms5003_request_sleep(runtime->sensor_handle, SLEEP_SLEEP);
-
-        esp_event_post_to(runtime->event_target, PMS5003_MANAGER_EVENT, PMS5003T_MANAGER_READING,
-                          &(runtime->pending_reading), sizeof(pms5003T_reading_t), 100 / portTICK_PERIOD_MS);
-
-        vTaskDelay(PMS5003_MANAGER_SLEEP_TICKS);
     }
 }
+#endif
 
 pms5003_manager_handle_t pms5003_manager_init(const pms5003_config_t *config, char *TAG, esp_event_loop_handle_t event_target) {
     pms5003_manager_runtime_t *runtime = calloc(1, sizeof(pms5003_manager_runtime_t));
@@ -130,30 +404,82 @@ pms5003_manager_handle_t pms5003_manager_init(const pms5003_config_t *config, ch
     }
     runtime->TAG = TAG;
     runtime->event_target = event_target;
+    atomic_init(&runtime->latest_sequence, 0);
+    reading_aggregator_init(&runtime->aggregator, PMS5003_MANAGER_WINDOWS);
+    runtime->schedule_slot = pms5003_scheduler_register();
+    if (runtime->schedule_slot < 0) {
+        ESP_LOGE(PMS5003_MANAGER_TAG, "no pms5003 scheduler slot left");
+        goto error_slot;
+    }
+#if CONFIG_PM_ENABLE
+    if (esp_pm_lock_create(ESP_PM_NO_LIGHT_SLEEP, 0, TAG, &runtime->uart_lock) != ESP_OK) {
+        ESP_LOGE(PMS5003_MANAGER_TAG, "pms5003 manager power management lock creation failed");
+        goto error_lock;
+    }
+#endif
+    runtime->state = MANAGER_STATE_WAKE;
+    runtime->deadline = pms5003_scheduler_next_wake(runtime->schedule_slot, xTaskGetTickCount());
+
+    reading_ring_init(&runtime->output);
 
     runtime->sensor_handle = pms5003_init(config);
     if (!runtime->sensor_handle) {
         ESP_LOGE(PMS5003_MANAGER_TAG, "init of pms5003 sensor failed");
-        goto error_struct;
+        goto error_sensor;
     }
 
     pms5003_request_mode(runtime->sensor_handle, MODE_PASSIVE);
+
+#if CONFIG_PMS5003_REACTOR
     pms5003_add_handler(runtime->sensor_handle, pms5003_manager_event_handler, runtime);
+    if (pms5003_reactor_add(runtime->sensor_handle, pms5003_manager_reactor_step, runtime) != ESP_OK) {
+        ESP_LOGE(PMS5003_MANAGER_TAG, "adding pms5003 sensor to I/O task failed");
+        goto error_task_create;
+    }
 
-    BaseType_t taskErr = xTaskCreate(pms5003_manager_task_entry, "PMS5003_sensor_manager", configMINIMAL_STACK_SIZE, runtime,
+    ESP_LOGI(PMS5003_MANAGER_TAG, "Added PMS5003 manager to I/O task");
+#else
+    BaseType_t taskErr = xTaskCreate(pms5003_manager_task_entry, "PMS5003_sensor_manager", 2048, runtime,
                                      2, &runtime->task_handle);
 
     if (taskErr != pdTRUE) {
         ESP_LOGE(PMS5003_MANAGER_TAG, "pms5003 reader task creation failed");
         goto error_task_create;
     }
+    reading_ring_init(&runtime->input);
+    pms5003_set_reading_ring(runtime->sensor_handle, &runtime->input, runtime->task_handle);
 
     ESP_LOGI(PMS5003_MANAGER_TAG, "Started PMS5003 manager task");
+#endif
 
     return runtime;
 
     error_task_create:
-    error_struct:
+    pms5003_deinit(runtime->sensor_handle);
+    error_sensor:
+#if CONFIG_PM_ENABLE
+    esp_pm_lock_delete(runtime->uart_lock);
+    error_lock:
+#endif
+    pms5003_scheduler_release(runtime->schedule_slot);
+    error_slot:
     free(runtime);
+    error_struct:
     return NULL;
-}
\ No newline at end of file
+}
+
+reading_ring_t *pms5003_manager_get_readings(pms5003_manager_handle_t handle) {
+    pms5003_manager_runtime_t *runtime = (pms5003_manager_runtime_t *) handle;
+    return &runtime->output;
+}
+
+bool pms5003_manager_get_latest(pms5003_manager_handle_t handle, pms5003_manager_latest_t *latest) {
+    pms5003_manager_runtime_t *runtime = (pms5003_manager_runtime_t *) handle;
+    unsigned sequence;
+    do {
+        sequence = atomic_load_explicit(&runtime->latest_sequence, memory_order_acquire);
+        *latest = runtime->latest[sequence & 1];
+        atomic_thread_fence(memory_order_acquire);
+    } while (atomic_load_explicit(&runtime->latest_sequence, memory_order_relaxed) != sequence);
+    return latest->burst != 0;
+}
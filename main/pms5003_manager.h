@@ -19,15 +19,55 @@
 #define H_PMS5003T_MANAGER
 
 #include "pms5003t.h"
+#include "reading_aggregator.h"
+#include "pms5003_scheduler.h"
+#include "reading_ring.h"
 
 typedef void *pms5003_manager_handle_t;
 
+#define PMS5003_MANAGER_LATEST_PARTIAL (1 << 0) /*!< the sensor stopped answering, the burst is short of readings */
+#define PMS5003_MANAGER_LATEST_CLOCK_UNSET (1 << 1) /*!< captured_at is uptime rather than Unix time */
+#define PMS5003_MANAGER_LATEST_UNSETTLED (1 << 2) /*!< readings had not converged when the spin-up time ran out */
+
+/**
+ * Snapshot of the latest read burst
+ */
+typedef struct {
+    pms5003T_reading_t reading; /*!< reduced reading, with AQI and the capture time of the burst */
+    uint32_t sample_count; /*!< readings the burst collected */
+    uint32_t burst; /*!< bursts completed since start, changes with every new snapshot */
+    uint32_t flags; /*!< PMS5003_MANAGER_LATEST_* quality flags */
+} pms5003_manager_latest_t;
+
 
 ESP_EVENT_DECLARE_BASE(PMS5003_MANAGER_EVENT);
 typedef enum {
-    PMS5003T_MANAGER_READING
+    PMS5003T_MANAGER_READINGS_QUEUED, /*!< Burst readings are waiting in the manager's reading ring, no event data.
+                                           Only posted when the ring may have been drained or the previous post
+                                           failed, so take every reading it holds, and drain it now and then in case a
+                                           post is lost. Replaces PMS5003T_MANAGER_READING, which carried the reading */
+    PMS5003T_MANAGER_SUMMARY, /*!< Rolling window statistics after a read burst, event data is a reading_summary_t */
+    PMS5003T_MANAGER_SCHEDULE /*!< Sleep interval decision after a read burst, event data is a pms5003_scheduler_decision_t */
 } pms5003_manager_event_id_t;
 
 pms5003_manager_handle_t pms5003_manager_init(const pms5003_config_t *config, char *TAG, esp_event_loop_handle_t event_target);
 
+/**
+ * @brief Copy out the latest burst reading
+ * @details Lock free and safe from any number of tasks. Readers never block the manager and never wait on it, a
+ * read only retries if a new burst completes while it is copying.
+ * @param handle manager instance
+ * @param latest filled with the snapshot
+ * @return true, false if no burst has completed yet
+ */
+bool pms5003_manager_get_latest(pms5003_manager_handle_t handle, pms5003_manager_latest_t *latest);
+
+/**
+ * @brief Get the ring a manager puts the reduced reading of every read burst in
+ * @details The manager is the only producer, the task running event_target must be the only consumer
+ * @param handle manager instance
+ * @return reading ring
+ */
+reading_ring_t *pms5003_manager_get_readings(pms5003_manager_handle_t handle);
+
 #endif
\ No newline at end of file
@@ -0,0 +1,176 @@
+/* Airgradient Outdoor Sensor V1.1 firmware using ESP-IDF
+ * Copyright (C) 2023 Zach Strauss
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include "pms5003_reactor.h"
+#include "freertos/task.h"
+#include "freertos/queue.h"
+#include "freertos/semphr.h"
+#include "esp_log.h"
+#include "sdkconfig.h"
+
+#if CONFIG_PMS5003_REACTOR
+
+#define PMS5003_REACTOR_MAX_SENSORS CONFIG_PMS5003_REACTOR_MAX_SENSORS
+#define PMS5003_REACTOR_EVENTS_PER_SENSOR (32)
+#define PMS5003_REACTOR_SET_LEN (PMS5003_REACTOR_MAX_SENSORS * PMS5003_REACTOR_EVENTS_PER_SENSOR + 1)
+#define PMS5003_REACTOR_ADD_ATTEMPTS (3)
+
+static const char *TAG = "PMS5003_reactor";
+
+/**
+ * Sensor served by the I/O task
+ */
+typedef struct {
+    pms5003_handle_t sensor; /*!< driver instance */
+    QueueHandle_t queue; /*!< driver's UART event queue */
+    pms5003_reactor_step_t step; /*!< scheduling callback */
+    void *step_args; /*!< additional args for step */
+} pms5003_reactor_entry_t;
+
+/**
+ * Holder for runtime state of the I/O task
+ */
+typedef struct {
+    pms5003_reactor_entry_t entries[PMS5003_REACTOR_MAX_SENSORS]; /*!< served sensors */
+    volatile int entry_count; /*!< entries ready to be served */
+    QueueSetHandle_t queue_set; /*!< every UART event queue plus the kick semaphore */
+    SemaphoreHandle_t kick; /*!< given to make the task pick up a new entry */
+    TaskHandle_t task_handle; /*!< reference to the I/O task */
+} pms5003_reactor_runtime_t;
+
+static pms5003_reactor_runtime_t *reactor = NULL;
+static portMUX_TYPE reactor_lock = portMUX_INITIALIZER_UNLOCKED;
+
+static void pms5003_reactor_task_entry(void *arg)
+{
+    pms5003_reactor_runtime_t *runtime = (pms5003_reactor_runtime_t *)arg;
+    while (1) {
+        TickType_t now = xTaskGetTickCount();
+        TickType_t wait = portMAX_DELAY;
+        int count = runtime->entry_count;
+        for (int i = 0; i < count; i++) {
+            TickType_t entry_wait = runtime->entries[i].step(runtime->entries[i].step_args, now);
+            if (entry_wait < wait) {
+                wait = entry_wait;
+            }
+        }
+
+        QueueSetMemberHandle_t member = xQueueSelectFromSet(runtime->queue_set, wait);
+        if (!member) {
+            continue;
+        }
+        if (member == runtime->kick) {
+            xSemaphoreTake(runtime->kick, 0);
+            continue;
+        }
+        for (int i = 0; i < count; i++) {
+            if (member == runtime->entries[i].queue) {
+                pms5003_service(runtime->entries[i].sensor);
+                break;
+            }
+        }
+    }
+}
+
+/**
+ * Create the queue set and I/O task on first use
+ */
+static esp_err_t pms5003_reactor_start(void)
+{
+    pms5003_reactor_runtime_t *runtime = calloc(1, sizeof(pms5003_reactor_runtime_t));
+    if (!runtime) {
+        ESP_LOGE(TAG, "calloc for reactor runtime struct failed");
+        goto error_struct;
+    }
+
+    runtime->queue_set = xQueueCreateSet(PMS5003_REACTOR_SET_LEN);
+    if (!runtime->queue_set) {
+        ESP_LOGE(TAG, "queue set creation failed");
+        goto error_set;
+    }
+
+    runtime->kick = xSemaphoreCreateBinary();
+    if (!runtime->kick || xQueueAddToSet(runtime->kick, runtime->queue_set) != pdPASS) {
+        ESP_LOGE(TAG, "kick semaphore creation failed");
+        goto error_kick;
+    }
+
+    BaseType_t taskErr = xTaskCreate(pms5003_reactor_task_entry, "PMS5003_io", 3072, runtime,
+                                     2, &runtime->task_handle);
+    if (taskErr != pdTRUE) {
+        ESP_LOGE(TAG, "reactor task creation failed");
+        goto error_task_create;
+    }
+
+    reactor = runtime;
+    ESP_LOGI(TAG, "Started PMS5003 I/O task");
+    return ESP_OK;
+
+    error_task_create:
+    error_kick:
+    if (runtime->kick) {
+        vSemaphoreDelete(runtime->kick);
+    }
+    vQueueDelete(runtime->queue_set);
+    error_set:
+    free(runtime);
+    error_struct:
+    return ESP_ERR_NO_MEM;
+}
+
+esp_err_t pms5003_reactor_add(pms5003_handle_t sensor, pms5003_reactor_step_t step, void *step_args)
+{
+    if (!reactor && pms5003_reactor_start() != ESP_OK) {
+        return ESP_ERR_NO_MEM;
+    }
+    if (reactor->entry_count >= PMS5003_REACTOR_MAX_SENSORS) {
+        ESP_LOGE(TAG, "no room for another sensor");
+        return ESP_ERR_NO_MEM;
+    }
+
+    UBaseType_t queue_len;
+    QueueHandle_t queue = pms5003_get_event_queue(sensor, &queue_len);
+    if (queue_len > PMS5003_REACTOR_EVENTS_PER_SENSOR) {
+        ESP_LOGE(TAG, "uart event queue longer than %d", PMS5003_REACTOR_EVENTS_PER_SENSOR);
+        return ESP_ERR_INVALID_SIZE;
+    }
+
+    /* A queue can only join a set while empty, and the sensor may already be sending */
+    BaseType_t added = pdFAIL;
+    for (int attempt = 0; attempt < PMS5003_REACTOR_ADD_ATTEMPTS && added != pdPASS; attempt++) {
+        xQueueReset(queue);
+        added = xQueueAddToSet(queue, reactor->queue_set);
+    }
+    if (added != pdPASS) {
+        ESP_LOGE(TAG, "adding uart queue to set failed");
+        return ESP_FAIL;
+    }
+
+    pms5003_reactor_entry_t *entry = &reactor->entries[reactor->entry_count];
+    entry->sensor = sensor;
+    entry->queue = queue;
+    entry->step = step;
+    entry->step_args = step_args;
+    taskENTER_CRITICAL(&reactor_lock);
+    reactor->entry_count++;
+    taskEXIT_CRITICAL(&reactor_lock);
+
+    xSemaphoreGive(reactor->kick);
+    return ESP_OK;
+}
+
+#endif
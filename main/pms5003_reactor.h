@@ -0,0 +1,45 @@
+/* Airgradient Outdoor Sensor V1.1 firmware using ESP-IDF
+ * Copyright (C) 2023 Zach Strauss
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include "freertos/FreeRTOS.h"
+#include "esp_err.h"
+#include "pms5003t.h"
+
+/**
+ * Scheduling callback run by the I/O task every time it wakes
+ * @param arg step_args given when the sensor was added
+ * @param now current tick count
+ * @return ticks until the callback next needs to run
+ */
+typedef TickType_t (*pms5003_reactor_step_t)(void *arg, TickType_t now);
+
+/**
+ * @brief Serve a sensor from the shared I/O task, starting the task on first use
+ * @details The I/O task waits on every sensor's UART event queue through one queue set and parses frames as they
+ * arrive. Between events it runs each sensor's step callback, sleeping until the earliest deadline they return.
+ * @param sensor pointer to PMS5003T instance initialized with CONFIG_PMS5003_REACTOR
+ * @param step scheduling callback for the sensor
+ * @param step_args additional args to pass to step
+ * @return
+ *  - ESP_OK: sensor added
+ *  - ESP_ERR_NO_MEM: CONFIG_PMS5003_REACTOR_MAX_SENSORS reached or task/queue set allocation failed
+ *  - ESP_ERR_INVALID_SIZE: the sensor's UART event queue is longer than the queue set allows for
+ *  - ESP_FAIL: the UART event queue could not be added to the queue set
+ */
+esp_err_t pms5003_reactor_add(pms5003_handle_t sensor, pms5003_reactor_step_t step, void *step_args);
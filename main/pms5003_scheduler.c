@@ -0,0 +1,224 @@
+/* Airgradient Outdoor Sensor V1.1 firmware using ESP-IDF
+ * Copyright (C) 2023 Zach Strauss
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include <string.h>
+#include "pms5003_scheduler.h"
+#include "freertos/task.h"
+#include "sdkconfig.h"
+
+#define PMS5003_SCHEDULER_SPINUP_TIME CONFIG_PMS5003_MANAGER_SPINUP_TIME
+#if CONFIG_PMS5003_ADAPTIVE_INTERVAL
+#define PMS5003_SCHEDULER_MIN_SLEEP CONFIG_PMS5003_ADAPTIVE_MIN_SLEEP
+#define PMS5003_SCHEDULER_MAX_SLEEP CONFIG_PMS5003_ADAPTIVE_MAX_SLEEP
+#else
+#define PMS5003_SCHEDULER_MIN_SLEEP CONFIG_PMS5003_MANAGER_SLEEP_TIME
+#define PMS5003_SCHEDULER_MAX_SLEEP CONFIG_PMS5003_MANAGER_SLEEP_TIME
+#endif
+
+/**
+ * PM2.5 below this is treated as this when working out relative change, so clean air noise does not count as fast
+ */
+#define PMS5003_SCHEDULER_PM_FLOOR (5)
+
+/**
+ * Duty cycle state of one manager
+ */
+typedef struct {
+    TickType_t last_wake; /*!< wake time handed out last */
+    bool started; /*!< whether last_wake has been handed out yet */
+    bool fan_on; /*!< whether the fan is running */
+    TickType_t fan_on_since; /*!< when the fan was switched on, or fan time was last collected */
+    bool reported; /*!< whether last_pm_2_5 holds a burst result */
+    uint16_t last_pm_2_5; /*!< PM2.5 mean of the previous burst */
+    uint32_t sleep_time; /*!< sleep time in seconds this slot asks for */
+} pms5003_scheduler_slot_t;
+
+typedef struct {
+    pms5003_scheduler_slot_t slots[PMS5003_SCHEDULER_MAX_SLOTS];
+    int slot_count;
+    TickType_t cycle_start; /*!< start of the current cycle */
+    TickType_t cycle_ticks; /*!< length of the current cycle */
+    TickType_t next_cycle_ticks; /*!< length the following cycles will have */
+    uint32_t fan_on_ticks;
+    int fans_on;
+    int max_fans_on;
+} pms5003_scheduler_runtime_t;
+
+static pms5003_scheduler_runtime_t scheduler;
+static portMUX_TYPE scheduler_lock = portMUX_INITIALIZER_UNLOCKED;
+
+static TickType_t pms5003_scheduler_cycle_ticks(uint32_t sleep_time)
+{
+    return pdMS_TO_TICKS((PMS5003_SCHEDULER_SPINUP_TIME + sleep_time) * 1000);
+}
+
+int pms5003_scheduler_register(void)
+{
+    int slot = -1;
+    taskENTER_CRITICAL(&scheduler_lock);
+    if (scheduler.slot_count < PMS5003_SCHEDULER_MAX_SLOTS) {
+        if (!scheduler.slot_count) {
+            scheduler.cycle_start = xTaskGetTickCount();
+            scheduler.cycle_ticks = pms5003_scheduler_cycle_ticks(CONFIG_PMS5003_MANAGER_SLEEP_TIME);
+            scheduler.next_cycle_ticks = scheduler.cycle_ticks;
+        }
+        slot = scheduler.slot_count++;
+        scheduler.slots[slot].sleep_time = CONFIG_PMS5003_MANAGER_SLEEP_TIME;
+    }
+    taskEXIT_CRITICAL(&scheduler_lock);
+    return slot;
+}
+
+void pms5003_scheduler_release(int slot)
+{
+    taskENTER_CRITICAL(&scheduler_lock);
+    if (slot >= 0 && slot == scheduler.slot_count - 1) {
+        memset(&scheduler.slots[slot], 0, sizeof(scheduler.slots[slot]));
+        scheduler.slot_count--;
+    }
+    taskEXIT_CRITICAL(&scheduler_lock);
+}
+
+/**
+ * Offset of a slot's wake time into a cycle, spreading the slots evenly: half a cycle apart for two sensors
+ */
+static TickType_t pms5003_scheduler_offset(int slot, TickType_t cycle_ticks)
+{
+#if CONFIG_PMS5003_SCHEDULE_STAGGER
+    return cycle_ticks / scheduler.slot_count * slot;
+#else
+    return 0;
+#endif
+}
+
+TickType_t pms5003_scheduler_next_wake(int slot, TickType_t now)
+{
+    taskENTER_CRITICAL(&scheduler_lock);
+    while (now - scheduler.cycle_start >= scheduler.cycle_ticks) {
+        scheduler.cycle_start += scheduler.cycle_ticks;
+        scheduler.cycle_ticks = scheduler.next_cycle_ticks;
+    }
+
+    pms5003_scheduler_slot_t *entry = &scheduler.slots[slot];
+    TickType_t wake = scheduler.cycle_start + pms5003_scheduler_offset(slot, scheduler.cycle_ticks);
+    if (!entry->started && (int32_t)(wake - now) < 0) {
+        /* Time passed between registering and asking, a slot's first wake is not pushed a whole cycle out */
+        wake = now;
+    } else if ((entry->started && entry->last_wake == wake) || (int32_t)(wake - now) < 0) {
+        wake = scheduler.cycle_start + scheduler.cycle_ticks + pms5003_scheduler_offset(slot, scheduler.next_cycle_ticks);
+    }
+    entry->started = true;
+    entry->last_wake = wake;
+    taskEXIT_CRITICAL(&scheduler_lock);
+    return wake;
+}
+
+uint32_t pms5003_scheduler_slot_spacing(void)
+{
+    uint32_t spacing = 0;
+    taskENTER_CRITICAL(&scheduler_lock);
+    if (scheduler.slot_count) {
+        /* The same offset the wakes of the current cycle are placed at */
+        spacing = pms5003_scheduler_offset(1, scheduler.cycle_ticks) * portTICK_PERIOD_MS / 1000;
+    }
+    taskEXIT_CRITICAL(&scheduler_lock);
+    return spacing;
+}
+
+void pms5003_scheduler_report(int slot, uint16_t pm_2_5, uint16_t pm_2_5_stddev,
+                              pms5003_scheduler_decision_t *decision)
+{
+    taskENTER_CRITICAL(&scheduler_lock);
+    pms5003_scheduler_slot_t *entry = &scheduler.slots[slot];
+    uint32_t previous = entry->reported ? entry->last_pm_2_5 : pm_2_5;
+    uint32_t change = pm_2_5 > previous ? pm_2_5 - previous : previous - pm_2_5;
+    uint32_t change_percent = change * 100 / (previous > PMS5003_SCHEDULER_PM_FLOOR ? previous : PMS5003_SCHEDULER_PM_FLOOR);
+    uint32_t variation_percent = (uint32_t)pm_2_5_stddev * 100 /
+                                 (pm_2_5 > PMS5003_SCHEDULER_PM_FLOOR ? pm_2_5 : PMS5003_SCHEDULER_PM_FLOOR);
+    entry->reported = true;
+    entry->last_pm_2_5 = pm_2_5;
+
+    decision->action = PMS5003_SCHEDULE_HOLD;
+#if CONFIG_PMS5003_ADAPTIVE_INTERVAL
+    if (change_percent >= CONFIG_PMS5003_ADAPTIVE_FAST_CHANGE || variation_percent >= CONFIG_PMS5003_ADAPTIVE_FAST_CHANGE) {
+        if (entry->sleep_time != PMS5003_SCHEDULER_MIN_SLEEP) {
+            entry->sleep_time = PMS5003_SCHEDULER_MIN_SLEEP;
+            decision->action = PMS5003_SCHEDULE_SHORTEN;
+        }
+    } else if (change_percent <= CONFIG_PMS5003_ADAPTIVE_STABLE_CHANGE &&
+               variation_percent <= CONFIG_PMS5003_ADAPTIVE_STABLE_CHANGE) {
+        uint32_t stretched = entry->sleep_time + entry->sleep_time / 2;
+        if (stretched > PMS5003_SCHEDULER_MAX_SLEEP) {
+            stretched = PMS5003_SCHEDULER_MAX_SLEEP;
+        }
+        if (stretched != entry->sleep_time) {
+            entry->sleep_time = stretched;
+            decision->action = PMS5003_SCHEDULE_STRETCH;
+        }
+    }
+#endif
+
+    uint32_t cycle_sleep = entry->sleep_time;
+    for (int other = 0; other < scheduler.slot_count; other++) {
+        if (scheduler.slots[other].sleep_time < cycle_sleep) {
+            cycle_sleep = scheduler.slots[other].sleep_time;
+        }
+    }
+    scheduler.next_cycle_ticks = pms5003_scheduler_cycle_ticks(cycle_sleep);
+
+    decision->pm_2_5 = pm_2_5;
+    decision->change_percent = change_percent > UINT16_MAX ? UINT16_MAX : change_percent;
+    decision->variation_percent = variation_percent > UINT16_MAX ? UINT16_MAX : variation_percent;
+    decision->sleep_time = entry->sleep_time;
+    decision->cycle_time = PMS5003_SCHEDULER_SPINUP_TIME + cycle_sleep;
+    taskEXIT_CRITICAL(&scheduler_lock);
+}
+
+void pms5003_scheduler_fan(int slot, bool on, TickType_t now)
+{
+    taskENTER_CRITICAL(&scheduler_lock);
+    pms5003_scheduler_slot_t *entry = &scheduler.slots[slot];
+    if (on && !entry->fan_on) {
+        entry->fan_on_since = now;
+        scheduler.fans_on++;
+        if (scheduler.fans_on > scheduler.max_fans_on) {
+            scheduler.max_fans_on = scheduler.fans_on;
+        }
+    } else if (!on && entry->fan_on) {
+        scheduler.fan_on_ticks += now - entry->fan_on_since;
+        scheduler.fans_on--;
+    }
+    entry->fan_on = on;
+    taskEXIT_CRITICAL(&scheduler_lock);
+}
+
+void pms5003_scheduler_take_fan_stats(TickType_t now, pms5003_scheduler_fan_stats_t *stats)
+{
+    taskENTER_CRITICAL(&scheduler_lock);
+    for (int slot = 0; slot < scheduler.slot_count; slot++) {
+        pms5003_scheduler_slot_t *entry = &scheduler.slots[slot];
+        if (entry->fan_on) {
+            scheduler.fan_on_ticks += now - entry->fan_on_since;
+            entry->fan_on_since = now;
+        }
+    }
+    stats->fan_on_ms = scheduler.fan_on_ticks * portTICK_PERIOD_MS;
+    stats->max_fans_on = scheduler.max_fans_on;
+    scheduler.fan_on_ticks = 0;
+    scheduler.max_fans_on = scheduler.fans_on;
+    taskEXIT_CRITICAL(&scheduler_lock);
+}
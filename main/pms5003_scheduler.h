@@ -0,0 +1,120 @@
+/* Airgradient Outdoor Sensor V1.1 firmware using ESP-IDF
+ * Copyright (C) 2023 Zach Strauss
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "freertos/FreeRTOS.h"
+
+/**
+ * Most managers the scheduler hands out wake times to
+ */
+#define PMS5003_SCHEDULER_MAX_SLOTS (4)
+
+/**
+ * Fan activity since the last call to pms5003_scheduler_take_fan_stats()
+ */
+typedef struct {
+    uint32_t fan_on_ms; /*!< fan on time summed over every sensor */
+    uint8_t max_fans_on; /*!< most fans that were on at the same time */
+} pms5003_scheduler_fan_stats_t;
+
+/**
+ * What the adaptive interval did with a burst result
+ */
+typedef enum {
+    PMS5003_SCHEDULE_HOLD, /*!< sleep time left as it was */
+    PMS5003_SCHEDULE_SHORTEN, /*!< particulate levels are changing fast, sleep time dropped to the minimum */
+    PMS5003_SCHEDULE_STRETCH /*!< air is stable, sleep time lengthened towards the maximum */
+} pms5003_schedule_action_t;
+
+/**
+ * Adaptive interval decision taken after a read burst, for auditing
+ */
+typedef struct {
+    const char *sensor_id; /*!< sensor the burst came from */
+    uint16_t pm_2_5; /*!< atmospheric PM2.5 mean of the burst */
+    uint16_t change_percent; /*!< change of pm_2_5 against the previous burst */
+    uint16_t variation_percent; /*!< standard deviation of PM2.5 within the burst relative to its mean */
+    pms5003_schedule_action_t action; /*!< what was done with the sensor's sleep time */
+    uint32_t sleep_time; /*!< sleep time in seconds this sensor asks for */
+    uint32_t cycle_time; /*!< length in seconds of the shared cycle from the next cycle on */
+} pms5003_scheduler_decision_t;
+
+/**
+ * @brief Get a slot on the shared duty cycle grid
+ * @details The first registration starts the first cycle. With CONFIG_PMS5003_SCHEDULE_STAGGER slot wake times
+ * are spread evenly over each cycle, with CONFIG_PMS5003_SCHEDULE_ALIGN every slot wakes at the start of the cycle.
+ * @return slot to pass to the other calls, -1 if all slots are taken
+ */
+int pms5003_scheduler_register(void);
+
+/**
+ * @brief Give back a slot, for unwinding a manager that failed to start
+ * @details Only the most recently registered slot can be given back, so the other slots keep their wake offsets
+ * @param slot slot returned by pms5003_scheduler_register(), -1 is ignored
+ */
+void pms5003_scheduler_release(int slot);
+
+/**
+ * @brief Get when a slot is due to wake its sensor next
+ * @details Wake times sit on a grid of cycles shared by every slot, so they do not drift with how long spin-up and
+ * the read burst took. A slot wakes once per cycle. A slot's first wake time that has already passed in the cycle
+ * it registered in, because ticks went by before the first call, is now rather than a cycle later.
+ * @param slot registered slot
+ * @param now current tick count
+ * @return tick count of the slot's wake time in the current cycle if it is still ahead, else in the next cycle
+ */
+TickType_t pms5003_scheduler_next_wake(int slot, TickType_t now);
+
+/**
+ * @brief Get how far apart two consecutive slots wake
+ * @details With CONFIG_PMS5003_SCHEDULE_STAGGER this is the current cycle divided by the number of registered slots,
+ * so it shrinks and grows with the adaptive interval.
+ * @return spacing in seconds, 0 with CONFIG_PMS5003_SCHEDULE_ALIGN or before any slot is registered
+ */
+uint32_t pms5003_scheduler_slot_spacing(void);
+
+/**
+ * @brief Feed a burst result to the adaptive interval
+ * @details Without CONFIG_PMS5003_ADAPTIVE_INTERVAL the cycle stays at spin-up plus CONFIG_PMS5003_MANAGER_SLEEP_TIME.
+ * Otherwise a fast change of PM2.5 against the slot's previous burst, or a large spread within the burst, drops the
+ * slot's sleep time to the minimum, while stable readings stretch it by half up to the maximum. The shared cycle
+ * follows the slot asking for the shortest sleep, starting with the next cycle.
+ * @param slot registered slot
+ * @param pm_2_5 mean PM2.5 of the burst
+ * @param pm_2_5_stddev standard deviation of PM2.5 within the burst
+ * @param decision destination for the decision taken, sensor_id is left untouched
+ */
+void pms5003_scheduler_report(int slot, uint16_t pm_2_5, uint16_t pm_2_5_stddev,
+                              pms5003_scheduler_decision_t *decision);
+
+/**
+ * @brief Record a fan being switched on or off
+ * @param slot registered slot
+ * @param on whether the fan is now running
+ * @param now current tick count
+ */
+void pms5003_scheduler_fan(int slot, bool on, TickType_t now);
+
+/**
+ * @brief Collect the fan statistics since the last call and start counting again
+ * @param now current tick count
+ * @param stats destination
+ */
+void pms5003_scheduler_take_fan_stats(TickType_t now, pms5003_scheduler_fan_stats_t *stats);
@@ -0,0 +1,378 @@
+/* Airgradient Outdoor Sensor V1.1 firmware using ESP-IDF
+ * Copyright (C) 2023 Zach Strauss
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+#include <string.h>
+#include "pms5003_sim.h"
+
+/**
+ * Time from a read request to the end of the answer: processing plus 32 bytes at 9600 baud
+ */
+#define PMS5003_SIM_ANSWER_MS (55)
+
+/**
+ * Interval between frames in active mode
+ */
+#define PMS5003_SIM_FRAME_MS (1000)
+
+/**
+ * Time after waking during which the sensor sends nothing and ignores read requests
+ */
+#define PMS5003_SIM_SILENT_MS (2500)
+
+/**
+ * Time after waking until the fan is at speed and counts reach the true value
+ */
+#define PMS5003_SIM_SPINUP_MS (30000)
+
+#define PMS5003_SIM_COMMAND_LEN (7)
+#define PMS5003_SIM_CMD_MODE (0xE1)
+#define PMS5003_SIM_CMD_READ (0xE2)
+#define PMS5003_SIM_CMD_SLEEP (0xE4)
+
+/**
+ * Air quality used when no trace is given
+ */
+static const pms5003_sim_sample_t PMS5003_SIM_CLEAN_AIR = {
+        .time = 0, .pm_1_0 = 3, .pm_2_5 = 5, .pm_10_0 = 6, .temperature = 200, .humidity = 500
+};
+
+static uint32_t pms5003_sim_random(pms5003_sim_t *sim)
+{
+    uint32_t x = sim->random;
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    sim->random = x;
+    return x;
+}
+
+/**
+ * @brief Roll for a fault
+ * @param per_mille chance in a thousand
+ */
+static bool pms5003_sim_chance(pms5003_sim_t *sim, uint16_t per_mille)
+{
+    return per_mille && pms5003_sim_random(sim) % 1000 < per_mille;
+}
+
+static int32_t pms5003_sim_interpolate(int32_t from, int32_t to, uint32_t elapsed, uint32_t span)
+{
+    return from + (to - from) * (int32_t) elapsed / (int32_t) span;
+}
+
+/**
+ * @brief Look up the air quality at a point in the looped trace
+ */
+static void pms5003_sim_sample_at(const pms5003_sim_t *sim, uint32_t now, pms5003_sim_sample_t *sample)
+{
+    if (!sim->trace || sim->trace_len < 1) {
+        *sample = PMS5003_SIM_CLEAN_AIR;
+        return;
+    }
+    uint32_t period = sim->trace[sim->trace_len - 1].time;
+    if (sim->trace_len == 1 || !period) {
+        *sample = sim->trace[0];
+        return;
+    }
+    uint32_t t = (now / 1000) % period;
+    int i = 0;
+    while (i < sim->trace_len - 2 && sim->trace[i + 1].time <= t) {
+        i++;
+    }
+    const pms5003_sim_sample_t *a = &sim->trace[i];
+    const pms5003_sim_sample_t *b = &sim->trace[i + 1];
+    uint32_t span = b->time - a->time;
+    uint32_t elapsed = t > a->time ? t - a->time : 0;
+    if (!span || elapsed > span) {
+        *sample = *a;
+        return;
+    }
+    sample->time = t;
+    sample->pm_1_0 = pms5003_sim_interpolate(a->pm_1_0, b->pm_1_0, elapsed, span);
+    sample->pm_2_5 = pms5003_sim_interpolate(a->pm_2_5, b->pm_2_5, elapsed, span);
+    sample->pm_10_0 = pms5003_sim_interpolate(a->pm_10_0, b->pm_10_0, elapsed, span);
+    sample->temperature = pms5003_sim_interpolate(a->temperature, b->temperature, elapsed, span);
+    sample->humidity = pms5003_sim_interpolate(a->humidity, b->humidity, elapsed, span);
+}
+
+/**
+ * @brief Apply measurement noise of about 3% plus one count, and the fan spin-up shortfall
+ * @param scale fraction of the true value reached, in percent
+ */
+static uint16_t pms5003_sim_measure(pms5003_sim_t *sim, uint32_t value, int scale)
+{
+    int32_t measured = (int32_t) (value * scale / 100);
+    measured += measured * (int32_t) (pms5003_sim_random(sim) % 7 - 3) / 100;
+    measured += (int32_t) (pms5003_sim_random(sim) % 3) - 1;
+    if (measured < 0) {
+        return 0;
+    }
+    return measured > UINT16_MAX ? UINT16_MAX : measured;
+}
+
+/**
+ * @brief Atmospheric concentration the sensor reports for a standard particle concentration
+ * @details The two match in clean air and atmospheric reads about a third lower at high concentrations
+ */
+static uint16_t pms5003_sim_atmospheric(uint16_t standard)
+{
+    return standard < 30 ? standard : 20 + (standard - 30) * 2 / 3;
+}
+
+static void pms5003_sim_reading(pms5003_sim_t *sim, uint32_t now, pms5003T_reading_t *reading)
+{
+    pms5003_sim_sample_t sample;
+    pms5003_sim_sample_at(sim, now, &sample);
+
+    uint32_t spun = now - sim->woken_at;
+    int scale = spun >= PMS5003_SIM_SPINUP_MS ? 100 : 30 + (int) (70 * spun / PMS5003_SIM_SPINUP_MS);
+
+    memset(reading, 0, sizeof(*reading));
+    reading->standard.pm_1_0 = pms5003_sim_measure(sim, sample.pm_1_0, scale);
+    reading->standard.pm_2_5 = pms5003_sim_measure(sim, sample.pm_2_5, scale);
+    reading->standard.pm_10_0 = pms5003_sim_measure(sim, sample.pm_10_0, scale);
+    reading->atmospheric.pm_1_0 = pms5003_sim_atmospheric(reading->standard.pm_1_0);
+    reading->atmospheric.pm_2_5 = pms5003_sim_atmospheric(reading->standard.pm_2_5);
+    reading->atmospheric.pm_10_0 = pms5003_sim_atmospheric(reading->standard.pm_10_0);
+    /* typical particle size spread of ambient air, counts per 0.1L */
+    reading->raw_pm_0_3 = pms5003_sim_measure(sim, 150 * sample.pm_2_5 + 100, scale);
+    reading->raw_pm_0_5 = pms5003_sim_measure(sim, 45 * sample.pm_2_5 + 30, scale);
+    reading->raw_pm_1_0 = pms5003_sim_measure(sim, 8 * sample.pm_2_5, scale);
+    reading->raw_pm_2_5 = pms5003_sim_measure(sim, 2 * (sample.pm_10_0 - sample.pm_2_5) + 1, scale);
+    reading->temperature = sample.temperature + (int16_t) (pms5003_sim_random(sim) % 3) - 1;
+    reading->humidity = sample.humidity + (pms5003_sim_random(sim) % 5) - 2;
+}
+
+/**
+ * @brief Put a frame on the line, with whatever faults come up
+ */
+static void pms5003_sim_send_frame(pms5003_sim_t *sim, uint32_t now)
+{
+    pms5003T_reading_t reading;
+    uint8_t frame[PMS5003_FRAME_LEN];
+    pms5003_sim_reading(sim, now, &reading);
+    pms5003_frame_encode(&reading, frame);
+    if (pms5003_sim_chance(sim, sim->faults.bad_checksum)) {
+        frame[PMS5003_FRAME_LEN - 1] ^= 0x5A;
+    }
+
+    if (pms5003_sim_chance(sim, sim->faults.noise)) {
+        int count = 1 + pms5003_sim_random(sim) % 4;
+        for (int i = 0; i < count && sim->output_len < PMS5003_SIM_OUTPUT_LEN; i++) {
+            sim->output[sim->output_len++] = pms5003_sim_random(sim) & 0x3F;
+        }
+    }
+    for (int i = 0; i < PMS5003_FRAME_LEN && sim->output_len < PMS5003_SIM_OUTPUT_LEN; i++) {
+        if (!pms5003_sim_chance(sim, sim->faults.byte_drop)) {
+            sim->output[sim->output_len++] = frame[i];
+        }
+    }
+}
+
+/**
+ * @brief Line up the next active mode frame
+ */
+static void pms5003_sim_schedule_active(pms5003_sim_t *sim, uint32_t now)
+{
+    uint32_t ready_at = sim->woken_at + PMS5003_SIM_SILENT_MS;
+    sim->frame_scheduled = true;
+    sim->frame_at = (int32_t) (ready_at - now) > 0 ? ready_at : now + PMS5003_SIM_FRAME_MS;
+}
+
+static void pms5003_sim_command(pms5003_sim_t *sim, uint8_t command, uint8_t data, uint32_t now)
+{
+    switch (command) {
+        case PMS5003_SIM_CMD_READ:
+            if (!sim->awake || !sim->passive || now - sim->woken_at < PMS5003_SIM_SILENT_MS ||
+                pms5003_sim_chance(sim, sim->faults.stall)) {
+                return;
+            }
+            sim->frame_scheduled = true;
+            sim->frame_at = now + PMS5003_SIM_ANSWER_MS;
+            break;
+        case PMS5003_SIM_CMD_MODE:
+            sim->passive = !data;
+            sim->frame_scheduled = false;
+            if (sim->awake && !sim->passive) {
+                pms5003_sim_schedule_active(sim, now);
+            }
+            break;
+        case PMS5003_SIM_CMD_SLEEP:
+            if (!data) {
+                sim->awake = false;
+                sim->frame_scheduled = false;
+            } else if (!sim->awake) {
+                sim->awake = true;
+                sim->woken_at = now;
+                if (!sim->passive) {
+                    pms5003_sim_schedule_active(sim, now);
+                }
+            }
+            break;
+    }
+}
+
+void pms5003_sim_init(pms5003_sim_t *sim, const pms5003_sim_sample_t *trace, int trace_len,
+                      const pms5003_sim_faults_t *faults, uint32_t seed, uint32_t now)
+{
+    memset(sim, 0, sizeof(*sim));
+    sim->trace = trace;
+    sim->trace_len = trace_len;
+    if (faults) {
+        sim->faults = *faults;
+    }
+    sim->random = seed ? seed : 1;
+    sim->awake = true;
+    sim->woken_at = now;
+    pms5003_sim_schedule_active(sim, now);
+}
+
+void pms5003_sim_write(pms5003_sim_t *sim, const uint8_t *data, size_t len, uint32_t now)
+{
+    for (size_t i = 0; i < len; i++) {
+        uint8_t byte = data[i];
+        if ((sim->command_len == 0 && byte != 0x42) || (sim->command_len == 1 && byte != 0x4D)) {
+            sim->command_len = byte == 0x42 ? 1 : 0;
+            sim->command[0] = byte;
+            continue;
+        }
+        sim->command[sim->command_len++] = byte;
+        if (sim->command_len < PMS5003_SIM_COMMAND_LEN) {
+            continue;
+        }
+        sim->command_len = 0;
+
+        uint16_t checksum = 0;
+        for (int j = 0; j < PMS5003_SIM_COMMAND_LEN - 2; j++) {
+            checksum += sim->command[j];
+        }
+        if (checksum == ((sim->command[5] << 8) | sim->command[6])) {
+            pms5003_sim_command(sim, sim->command[2], sim->command[4], now);
+        }
+    }
+}
+
+int pms5003_sim_read(pms5003_sim_t *sim, uint32_t now, uint8_t *buffer, size_t len)
+{
+    if (sim->frame_scheduled && (int32_t) (now - sim->frame_at) >= 0) {
+        pms5003_sim_send_frame(sim, now);
+        if (sim->awake && !sim->passive) {
+            sim->frame_at += PMS5003_SIM_FRAME_MS;
+            if ((int32_t) (now - sim->frame_at) >= 0) {
+                sim->frame_at = now + PMS5003_SIM_FRAME_MS;
+            }
+        } else {
+            sim->frame_scheduled = false;
+        }
+    }
+
+    size_t available = (size_t) sim->output_len;
+    int count = (int) (available < len ? available : len);
+    memcpy(buffer, sim->output, count);
+    sim->output_len -= count;
+    memmove(sim->output, sim->output + count, sim->output_len);
+    return count;
+}
+
+uint32_t pms5003_sim_next_output(const pms5003_sim_t *sim, uint32_t now)
+{
+    if (sim->output_len) {
+        return 0;
+    }
+    if (!sim->frame_scheduled) {
+        return PMS5003_SIM_IDLE;
+    }
+    int32_t wait = (int32_t) (sim->frame_at - now);
+    return wait > 0 ? (uint32_t) wait : 0;
+}
+
+/**
+ * @brief Parse a number with an optional sign and, with tenths, an optional single decimal
+ * @param cursor position in the text, advanced past the number
+ * @param end end of the text
+ * @param tenths whether to return the value in tenths
+ * @param value parsed value
+ * @return true if a number was found
+ */
+static bool pms5003_sim_parse_number(const char **cursor, const char *end, bool tenths, int32_t *value)
+{
+    const char *p = *cursor;
+    while (p < end && (*p == ' ' || *p == '\t')) {
+        p++;
+    }
+    bool negative = p < end && *p == '-';
+    if (negative) {
+        p++;
+    }
+    if (p >= end || *p < '0' || *p > '9') {
+        return false;
+    }
+    int32_t result = 0;
+    while (p < end && *p >= '0' && *p <= '9' && result < 100000000) {
+        result = result * 10 + (*p++ - '0');
+    }
+    if (tenths) {
+        result *= 10;
+        if (p + 1 < end && *p == '.' && p[1] >= '0' && p[1] <= '9') {
+            result += p[1] - '0';
+            p += 2;
+        }
+    }
+    while (p < end && (*p == ' ' || *p == '\t')) {
+        p++;
+    }
+    *value = negative ? -result : result;
+    *cursor = p;
+    return true;
+}
+
+int pms5003_sim_parse_trace(const char *text, size_t len, pms5003_sim_sample_t *samples, int max_samples)
+{
+    const char *end = text + len;
+    int count = 0;
+    for (const char *line = text; line < end && count < max_samples;) {
+        const char *line_end = memchr(line, '\n', end - line);
+        if (!line_end) {
+            line_end = end;
+        }
+
+        int32_t values[6];
+        const char *p = line;
+        int parsed = 0;
+        if (*p != '#') {
+            for (; parsed < 6; parsed++) {
+                if (!pms5003_sim_parse_number(&p, line_end, parsed >= 4, &values[parsed])) {
+                    break;
+                }
+                if (parsed < 5 && (p >= line_end || *p++ != ',')) {
+                    parsed++;
+                    break;
+                }
+            }
+        }
+        if (parsed == 6 && values[0] >= 0 && values[1] >= 0 && values[2] >= 0 && values[3] >= 0 && values[5] >= 0) {
+            samples[count].time = values[0];
+            samples[count].pm_1_0 = values[1];
+            samples[count].pm_2_5 = values[2];
+            samples[count].pm_10_0 = values[3];
+            samples[count].temperature = values[4];
+            samples[count].humidity = values[5];
+            count++;
+        }
+        line = line_end + 1;
+    }
+    return count;
+}
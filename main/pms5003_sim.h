@@ -0,0 +1,138 @@
+/* Airgradient Outdoor Sensor V1.1 firmware using ESP-IDF
+ * Copyright (C) 2023 Zach Strauss
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include "pms5003_frame.h"
+
+/**
+ * Longest trace pms5003_sim_parse_trace() is expected to fill
+ */
+#define PMS5003_SIM_TRACE_MAX (64)
+
+/**
+ * Bytes the simulated sensor can have waiting to go out
+ */
+#define PMS5003_SIM_OUTPUT_LEN (96)
+
+/**
+ * Returned by pms5003_sim_next_output() when nothing is scheduled
+ */
+#define PMS5003_SIM_IDLE (0xFFFFFFFF)
+
+/**
+ * One point of an air quality trace, values in between are interpolated
+ */
+typedef struct {
+    uint32_t time; /*!< seconds from the start of the trace */
+    uint16_t pm_1_0; /*!< PM1.0 in ug/m3, standard particle */
+    uint16_t pm_2_5; /*!< PM2.5 in ug/m3, standard particle */
+    uint16_t pm_10_0; /*!< PM10.0 in ug/m3, standard particle */
+    int16_t temperature; /*!< tenths of a degree C */
+    uint16_t humidity; /*!< tenths of a percent */
+} pms5003_sim_sample_t;
+
+/**
+ * Fault rates, each in chances per thousand
+ */
+typedef struct {
+    uint16_t byte_drop; /*!< each byte of a frame is lost */
+    uint16_t bad_checksum; /*!< a frame goes out with a corrupt checksum */
+    uint16_t stall; /*!< a read request is never answered */
+    uint16_t noise; /*!< junk bytes go out ahead of a frame */
+} pms5003_sim_faults_t;
+
+/**
+ * State of one simulated PMS5003T
+ * @details Follows the datasheet: the sensor starts awake in active mode, answers a passive read after a short
+ * delay, sends a frame every second in active mode, stays silent while asleep and for a while after waking, and its
+ * counts only reach the true value once the fan has spun up.
+ */
+typedef struct {
+    const pms5003_sim_sample_t *trace; /*!< air quality to replay, looped */
+    int trace_len; /*!< samples in trace */
+    pms5003_sim_faults_t faults; /*!< fault rates */
+    uint32_t random; /*!< xorshift state */
+
+    uint8_t command[7]; /*!< command bytes received so far */
+    int command_len; /*!< valid bytes in command */
+
+    bool awake; /*!< fan running */
+    bool passive; /*!< answers read requests instead of sending on its own */
+    uint32_t woken_at; /*!< when the fan was switched on, in ms */
+    bool frame_scheduled; /*!< a frame goes out at frame_at */
+    uint32_t frame_at; /*!< when the next frame goes out, in ms */
+
+    uint8_t output[PMS5003_SIM_OUTPUT_LEN]; /*!< bytes sent but not yet collected */
+    int output_len; /*!< valid bytes in output */
+} pms5003_sim_t;
+
+/**
+ * @brief Power up a simulated sensor
+ * @param sim simulator instance
+ * @param trace air quality to replay, must stay valid, NULL or empty for clean air
+ * @param trace_len samples in trace
+ * @param faults fault rates, NULL for none
+ * @param seed random seed, give each sensor its own so their noise differs
+ * @param now current time in ms
+ */
+void pms5003_sim_init(pms5003_sim_t *sim, const pms5003_sim_sample_t *trace, int trace_len,
+                      const pms5003_sim_faults_t *faults, uint32_t seed, uint32_t now);
+
+/**
+ * @brief Feed bytes written to the sensor's RX line
+ * @details Understands the read, sleep, wake, passive and active commands; anything else is ignored like the real
+ * sensor does
+ * @param sim simulator instance
+ * @param data bytes written
+ * @param len number of bytes
+ * @param now current time in ms
+ */
+void pms5003_sim_write(pms5003_sim_t *sim, const uint8_t *data, size_t len, uint32_t now);
+
+/**
+ * @brief Collect the bytes the sensor has sent by now
+ * @param sim simulator instance
+ * @param now current time in ms
+ * @param buffer destination
+ * @param len space in buffer, bytes that do not fit are kept for the next call
+ * @return number of bytes copied
+ */
+int pms5003_sim_read(pms5003_sim_t *sim, uint32_t now, uint8_t *buffer, size_t len);
+
+/**
+ * @brief Time until the sensor sends something
+ * @param sim simulator instance
+ * @param now current time in ms
+ * @return ms until bytes are ready to read, 0 if some are already, PMS5003_SIM_IDLE if none are scheduled
+ */
+uint32_t pms5003_sim_next_output(const pms5003_sim_t *sim, uint32_t now);
+
+/**
+ * @brief Parse an air quality trace
+ * @details One sample per line as "seconds,pm1.0,pm2.5,pm10.0,temperature,humidity" with temperature in degrees C
+ * and humidity in percent, each with up to one decimal. Lines starting with # and lines that do not parse are
+ * skipped. Samples must be in time order.
+ * @param text trace text, need not be NUL terminated
+ * @param len length of text
+ * @param samples destination
+ * @param max_samples capacity of samples
+ * @return number of samples filled
+ */
+int pms5003_sim_parse_trace(const char *text, size_t len, pms5003_sim_sample_t *samples, int max_samples);
@@ -0,0 +1,206 @@
+/* Airgradient Outdoor Sensor V1.1 firmware using ESP-IDF
+ * Copyright (C) 2023 Zach Strauss
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+#include <string.h>
+#include "pms5003_sim_uart.h"
+#include "pms5003_sim.h"
+#include "freertos/task.h"
+#include "esp_timer.h"
+#include "esp_log.h"
+#include "sdkconfig.h"
+
+#if CONFIG_PMS5003_SIMULATOR
+#define PMS5003_SIM_UART_RX_LEN (128)
+#define PMS5003_SIM_UART_MAX_WAIT_MS (1000)
+
+static const char *TAG = "PMS5003_sim";
+
+extern const char pms5003_sim_trace_start[] asm("_binary_pms5003_sim_trace_csv_start");
+extern const char pms5003_sim_trace_end[] asm("_binary_pms5003_sim_trace_csv_end");
+
+/**
+ * Simulated sensor attached to one UART port
+ */
+typedef struct {
+    bool installed; /*!< whether a driver attached to the port */
+    pms5003_sim_t sim; /*!< the sensor */
+    QueueHandle_t queue; /*!< UART event queue handed to the driver */
+    QueueHandle_t retired; /*!< queue of a deleted driver, freed by the sim task once it can no longer send to it */
+    uint8_t rx[PMS5003_SIM_UART_RX_LEN]; /*!< bytes sent by the sensor, not read by the driver yet */
+    size_t rx_len; /*!< valid bytes in rx */
+} pms5003_sim_uart_port_t;
+
+static pms5003_sim_uart_port_t sim_ports[UART_NUM_MAX];
+static pms5003_sim_sample_t sim_trace[PMS5003_SIM_TRACE_MAX];
+static int sim_trace_len = -1;
+static TaskHandle_t sim_task = NULL;
+static portMUX_TYPE sim_lock = portMUX_INITIALIZER_UNLOCKED;
+
+static const pms5003_sim_faults_t PMS5003_SIM_FAULTS = {
+        .byte_drop = CONFIG_PMS5003_SIM_BYTE_DROP,
+        .bad_checksum = CONFIG_PMS5003_SIM_BAD_CHECKSUM,
+        .stall = CONFIG_PMS5003_SIM_STALL,
+        .noise = CONFIG_PMS5003_SIM_NOISE,
+};
+
+static uint32_t pms5003_sim_uart_now(void)
+{
+    return (uint32_t) (esp_timer_get_time() / 1000);
+}
+
+static pms5003_sim_uart_port_t *pms5003_sim_uart_port(uart_port_t uart_port)
+{
+    if (uart_port < 0 || uart_port >= UART_NUM_MAX || !sim_ports[uart_port].installed) {
+        return NULL;
+    }
+    return &sim_ports[uart_port];
+}
+
+/**
+ * Move whatever the sensors have sent into the RX buffers and announce it, then sleep until the next send or write
+ */
+static void pms5003_sim_uart_task_entry(void *arg)
+{
+    while (1) {
+        uint32_t now = pms5003_sim_uart_now();
+        uint32_t wait = PMS5003_SIM_UART_MAX_WAIT_MS;
+        for (int i = 0; i < UART_NUM_MAX; i++) {
+            pms5003_sim_uart_port_t *port = &sim_ports[i];
+            uart_event_t event = {.type = UART_DATA};
+            QueueHandle_t queue = NULL;
+            QueueHandle_t retired;
+            taskENTER_CRITICAL(&sim_lock);
+            /* Past this point the port is uninstalled for good, so no earlier pass is still sending to its queue */
+            retired = port->retired;
+            port->retired = NULL;
+            if (port->installed) {
+                queue = port->queue;
+                event.size = pms5003_sim_read(&port->sim, now, port->rx + port->rx_len,
+                                              sizeof(port->rx) - port->rx_len);
+                port->rx_len += event.size;
+                uint32_t next = pms5003_sim_next_output(&port->sim, now);
+                if (next < wait) {
+                    wait = next;
+                }
+            }
+            taskEXIT_CRITICAL(&sim_lock);
+            if (retired) {
+                vQueueDelete(retired);
+            }
+            if (event.size) {
+                xQueueSend(queue, &event, 0);
+            }
+        }
+        TickType_t ticks = pdMS_TO_TICKS(wait);
+        ulTaskNotifyTake(pdTRUE, ticks ? ticks : 1);
+    }
+}
+
+esp_err_t pms5003_sim_uart_install(uart_port_t uart_port, int queue_size, QueueHandle_t *uart_queue)
+{
+    if (uart_port < 0 || uart_port >= UART_NUM_MAX || sim_ports[uart_port].installed) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    pms5003_sim_uart_port_t *port = &sim_ports[uart_port];
+    if (port->retired) {
+        /* The previous driver's queue has not been freed by the sim task yet */
+        return ESP_ERR_INVALID_STATE;
+    }
+
+    if (sim_trace_len < 0) {
+        sim_trace_len = pms5003_sim_parse_trace(pms5003_sim_trace_start, pms5003_sim_trace_end - pms5003_sim_trace_start,
+                                                sim_trace, PMS5003_SIM_TRACE_MAX);
+        ESP_LOGI(TAG, "loaded %d trace samples", sim_trace_len);
+    }
+
+    port->queue = xQueueCreate(queue_size, sizeof(uart_event_t));
+    if (!port->queue) {
+        return ESP_ERR_NO_MEM;
+    }
+    if (!sim_task && xTaskCreate(pms5003_sim_uart_task_entry, "PMS5003_sim", 2048, NULL, 3, &sim_task) != pdTRUE) {
+        vQueueDelete(port->queue);
+        return ESP_ERR_NO_MEM;
+    }
+
+    taskENTER_CRITICAL(&sim_lock);
+    pms5003_sim_init(&port->sim, sim_trace, sim_trace_len, &PMS5003_SIM_FAULTS, 0x9E3779B9u * (uart_port + 1),
+                     pms5003_sim_uart_now());
+    port->rx_len = 0;
+    port->installed = true;
+    taskEXIT_CRITICAL(&sim_lock);
+
+    *uart_queue = port->queue;
+    xTaskNotifyGive(sim_task);
+    ESP_LOGW(TAG, "uart %d is a simulated sensor", uart_port);
+    return ESP_OK;
+}
+
+esp_err_t pms5003_sim_uart_delete(uart_port_t uart_port)
+{
+    pms5003_sim_uart_port_t *port = pms5003_sim_uart_port(uart_port);
+    if (!port) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    /* The sim task may be about to send to the queue, so it frees the queue on its next pass */
+    taskENTER_CRITICAL(&sim_lock);
+    port->installed = false;
+    port->retired = port->queue;
+    port->queue = NULL;
+    taskEXIT_CRITICAL(&sim_lock);
+    xTaskNotifyGive(sim_task);
+    return ESP_OK;
+}
+
+int pms5003_sim_uart_write(uart_port_t uart_port, const void *src, size_t size)
+{
+    pms5003_sim_uart_port_t *port = pms5003_sim_uart_port(uart_port);
+    if (!port) {
+        return -1;
+    }
+    taskENTER_CRITICAL(&sim_lock);
+    pms5003_sim_write(&port->sim, src, size, pms5003_sim_uart_now());
+    taskEXIT_CRITICAL(&sim_lock);
+    xTaskNotifyGive(sim_task);
+    return (int) size;
+}
+
+int pms5003_sim_uart_read(uart_port_t uart_port, void *buf, uint32_t length)
+{
+    pms5003_sim_uart_port_t *port = pms5003_sim_uart_port(uart_port);
+    if (!port) {
+        return -1;
+    }
+    taskENTER_CRITICAL(&sim_lock);
+    size_t count = port->rx_len < length ? port->rx_len : length;
+    memcpy(buf, port->rx, count);
+    port->rx_len -= count;
+    memmove(port->rx, port->rx + count, port->rx_len);
+    taskEXIT_CRITICAL(&sim_lock);
+    return (int) count;
+}
+
+esp_err_t pms5003_sim_uart_flush(uart_port_t uart_port)
+{
+    pms5003_sim_uart_port_t *port = pms5003_sim_uart_port(uart_port);
+    if (!port) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    taskENTER_CRITICAL(&sim_lock);
+    port->rx_len = 0;
+    taskEXIT_CRITICAL(&sim_lock);
+    return ESP_OK;
+}
+#endif
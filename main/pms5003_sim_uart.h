@@ -0,0 +1,63 @@
+/* Airgradient Outdoor Sensor V1.1 firmware using ESP-IDF
+ * Copyright (C) 2023 Zach Strauss
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+#pragma once
+
+#include "driver/uart.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/queue.h"
+
+/**
+ * @brief Attach a simulated PMS5003T to a UART port in place of the UART driver
+ * @details Replays pms5003_sim_trace.csv with the fault rates configured under CONFIG_PMS5003_SIMULATOR. Bytes the
+ * sensor sends show up through pms5003_sim_uart_read() and are announced with UART_DATA events, like the UART driver
+ * does. All simulated sensors are served by one task, started with the first.
+ * @param uart_port port the sensor would be wired to
+ * @param queue_size length of the event queue
+ * @param uart_queue set to the event queue
+ * @return
+ *  - ESP_OK: attached
+ *  - ESP_ERR_INVALID_ARG: port out of range or already attached
+ *  - ESP_ERR_INVALID_STATE: the port was just detached and its old queue is not freed yet
+ *  - ESP_ERR_NO_MEM: queue or task creation failed
+ */
+esp_err_t pms5003_sim_uart_install(uart_port_t uart_port, int queue_size, QueueHandle_t *uart_queue);
+
+/**
+ * @brief Detach the simulated sensor from a port
+ * @details The event queue is freed by the sim task on its next pass, once it can no longer be sending to it
+ * @param uart_port port passed to pms5003_sim_uart_install()
+ * @return ESP_OK, ESP_ERR_INVALID_ARG if nothing was attached
+ */
+esp_err_t pms5003_sim_uart_delete(uart_port_t uart_port);
+
+/**
+ * @brief Send bytes to the simulated sensor, see uart_write_bytes()
+ * @return number of bytes written, -1 if nothing is attached to the port
+ */
+int pms5003_sim_uart_write(uart_port_t uart_port, const void *src, size_t size);
+
+/**
+ * @brief Take bytes the simulated sensor has sent without blocking, see uart_read_bytes()
+ * @return number of bytes read, -1 if nothing is attached to the port
+ */
+int pms5003_sim_uart_read(uart_port_t uart_port, void *buf, uint32_t length);
+
+/**
+ * @brief Drop bytes the simulated sensor has sent but were not read yet, see uart_flush()
+ * @return ESP_OK, ESP_ERR_INVALID_ARG if nothing is attached to the port
+ */
+esp_err_t pms5003_sim_uart_flush(uart_port_t uart_port);
@@ -23,6 +23,9 @@
 #include "freertos/task.h"
 #include "esp_log.h"
 #include "pms5003t.h"
+#include "latency_trace.h"
+#include "time_sync.h"
+#include "pms5003_sim_uart.h"
 #include "driver/uart.h"
 #include "esp_types.h"
 #include "esp_event.h"
@@ -31,12 +34,22 @@
 
 
 
-#define PMS5003_RUNTIME_PARSE_BUFFER_SIZE (2)
 #define PMS5003_UART_RX_BUFFER_SIZE (256)
 #define PMS5003_UART_TX_BUFFER_SIZE (0)
 #define PMS5003_EVENT_LOOP_QUEUE_SIZE CONFIG_PMS5003_UART_EVENT_QUEUE_LEN
 
-#define PMS5003_HEADER_SCAN_ATTEMPTS CONFIG_PMS5003_SOH_SCAN_LENGTH
+#if CONFIG_PMS5003_SIMULATOR
+/* A simulated sensor stands in for the UART driver */
+#define PMS5003_UART_WRITE(port, data, len) pms5003_sim_uart_write(port, data, len)
+#define PMS5003_UART_READ(port, buf, len) pms5003_sim_uart_read(port, buf, len)
+#define PMS5003_UART_FLUSH(port) pms5003_sim_uart_flush(port)
+#define PMS5003_UART_DELETE(port) pms5003_sim_uart_delete(port)
+#else
+#define PMS5003_UART_WRITE(port, data, len) uart_write_bytes(port, data, len)
+#define PMS5003_UART_READ(port, buf, len) uart_read_bytes(port, buf, len, 0)
+#define PMS5003_UART_FLUSH(port) uart_flush(port)
+#define PMS5003_UART_DELETE(port) uart_driver_delete(port)
+#endif
 
 static const char *TAG = "PMS5003_parser";
 ESP_EVENT_DEFINE_BASE(PMS5003_EVENT);
@@ -71,17 +84,22 @@ static const uint8_t PMS5003_CMD_ACTIVE[7] = {0x42, 0x4D, 0xE1, 0x00, 0x01, 0x01
  */
 typedef struct {
     uart_port_t uart_port; /*!< target UART */
-    uint8_t *buffer; /*!< buffer to read into */
+    pms5003_frame_parser_t parser; /*!< partial frame state carried between UART events */
     int read_len; /*!< return code from most recent read operation */
 
-    esp_event_loop_handle_t event_loop_handle; /*!< reference to the event loop used to kick readings out */
+#if CONFIG_PMS5003_REACTOR
+    esp_event_handler_t handler; /*!< reading handler, called directly from the I/O task */
+    void *handler_args; /*!< additional args passed to handler */
+#else
+    esp_event_loop_handle_t event_loop_handle; /*!< event loop readings are posted to, created by the first
+                                                    pms5003_add_handler(), NULL while readings go to a ring */
     TaskHandle_t task_handle; /*!< reference to the driver task */
+    reading_ring_t *ring; /*!< ring readings are parsed into instead of being posted, NULL to post them */
+    TaskHandle_t ring_consumer; /*!< task notified when the ring has readings */
+#endif
     QueueHandle_t queue_handle; /*!< reference to the queue used for UART data/events */
+    UBaseType_t queue_len; /*!< length of the UART data/event queue */
 
-    uint16_t checksum; /*!< running checksum of the current message being parsed */
-    uint16_t message_len; /*!< payload length of the current message being parsed */
-    int header_scan_attempts; /*!< bytes read searching for the SOM byte*/
-    int field_index; /*!< payload entry index of the current message being parsed */
     pms5003T_reading_t reading; /*!< buffer for incoming readings to be copied out the event loop after verification */
 
     pms5003_mode_t mode; /*!< current sensor operation mode */
@@ -90,165 +108,140 @@ typedef struct {
 } pms5003_runtime_t;
 
 /**
- * Read, validate, and parse an incoming measurement message from the sensor
+ * Feed whatever is waiting in the UART ring buffer through the frame parser without blocking
+ * @details Partial frames stay in the parser and are completed by the next UART_DATA event. Every
+ * complete frame that validates is handed out, so back-to-back frames are all handled from one event. With a
+ * reading ring attached frames are parsed straight into its free slot and the consumer is notified, otherwise they
+ * are posted to the event loop.
  * @param pms5003_runtime
- * @return
- *     0: No error
- *     -1: Unable to find message header
- *     -2: Checksum validation failed
- *     -3: Unable to read specified message length
+ * @param received_at latency trace stamp of the UART event
  */
-static int pms5003_read_measurement(pms5003_runtime_t *pms5003_runtime)
+static void pms5003_read_available(pms5003_runtime_t *pms5003_runtime, uint32_t received_at)
 {
-    pms5003_runtime->header_scan_attempts = 0;
-    while (pms5003_runtime->header_scan_attempts < PMS5003_HEADER_SCAN_ATTEMPTS) {
-        pms5003_runtime->read_len = uart_read_bytes(pms5003_runtime->uart_port, pms5003_runtime->buffer, 1, 100 / portTICK_PERIOD_MS);
-        if (pms5003_runtime->read_len && pms5003_runtime->buffer[0] == 0x42) {
-            pms5003_runtime->checksum = 0x42;
-            break;
+    size_t space;
+    uint8_t *target;
+    pms5003T_reading_t *reading = &pms5003_runtime->reading;
+    while (1) {
+#if !CONFIG_PMS5003_REACTOR
+        if (pms5003_runtime->ring) {
+            reading = reading_ring_reserve(pms5003_runtime->ring);
+            if (!reading) {
+                /* Parse into the scratch buffer so the stream stays in sync, the frame is dropped below */
+                reading = &pms5003_runtime->reading;
+            }
+        }
+#endif
+        target = pms5003_frame_parser_space(&pms5003_runtime->parser, &space);
+        pms5003_runtime->read_len = PMS5003_UART_READ(pms5003_runtime->uart_port, target, space);
+        if (pms5003_runtime->read_len <= 0) {
+            return;
         }
-        pms5003_runtime->header_scan_attempts++;
-    }
 
-    if (pms5003_runtime->header_scan_attempts >= PMS5003_HEADER_SCAN_ATTEMPTS) {
-        return -1;
-    }
+        int ret = pms5003_frame_parser_commit(&pms5003_runtime->parser, pms5003_runtime->read_len, reading);
+        if (ret == PMS5003_FRAME_INCOMPLETE) {
+            continue;
+        }
+        if (ret != 0) {
+            ESP_LOGW(TAG, "%d - read err %d", pms5003_runtime->uart_port, ret);
+            continue;
+        }
 
-    pms5003_runtime->read_len = uart_read_bytes(pms5003_runtime->uart_port, pms5003_runtime->buffer, 1, 100 / portTICK_PERIOD_MS);
-    if (pms5003_runtime->read_len && pms5003_runtime->buffer[0] == 0x4d) {
-        pms5003_runtime->checksum += 0x4d;
-        pms5003_runtime->read_len = uart_read_bytes(pms5003_runtime->uart_port, pms5003_runtime->buffer, 2,
-                                                    100 / portTICK_PERIOD_MS);
-        if (pms5003_runtime->read_len == 2) {
-            pms5003_runtime->checksum += pms5003_runtime->buffer[0];
-            pms5003_runtime->checksum += pms5003_runtime->buffer[1];
-            pms5003_runtime->message_len = (pms5003_runtime->buffer[0] << 8) | pms5003_runtime->buffer[1];
-            pms5003_runtime->field_index = 0;
-            while (pms5003_runtime->message_len > 2) {
-                pms5003_runtime->read_len = uart_read_bytes(pms5003_runtime->uart_port, pms5003_runtime->buffer, 2,
-                                                            100 / portTICK_PERIOD_MS);
-                if (pms5003_runtime->read_len) {
-                    pms5003_runtime->checksum += pms5003_runtime->buffer[0];
-                    pms5003_runtime->checksum += pms5003_runtime->buffer[1];
-                    switch (pms5003_runtime->field_index) {
-                        case 0:
-                            pms5003_runtime->reading.standard.pm_1_0 =
-                                    (pms5003_runtime->buffer[0] << 8) | pms5003_runtime->buffer[1];
-                            break;
-                        case 1:
-                            pms5003_runtime->reading.standard.pm_2_5 =
-                                    (pms5003_runtime->buffer[0] << 8) | pms5003_runtime->buffer[1];
-                            break;
-                        case 2:
-                            pms5003_runtime->reading.standard.pm_10_0 =
-                                    (pms5003_runtime->buffer[0] << 8) | pms5003_runtime->buffer[1];
-                            break;
-                        case 3:
-                            pms5003_runtime->reading.atmospheric.pm_1_0 =
-                                    (pms5003_runtime->buffer[0] << 8) | pms5003_runtime->buffer[1];
-                            break;
-                        case 4:
-                            pms5003_runtime->reading.atmospheric.pm_2_5 =
-                                    (pms5003_runtime->buffer[0] << 8) | pms5003_runtime->buffer[1];
-                            break;
-                        case 5:
-                            pms5003_runtime->reading.atmospheric.pm_10_0 =
-                                    (pms5003_runtime->buffer[0] << 8) | pms5003_runtime->buffer[1];
-                            break;
-                        case 6:
-                            pms5003_runtime->reading.raw_pm_0_3 =
-                                    (pms5003_runtime->buffer[0] << 8) | pms5003_runtime->buffer[1];
-                            break;
-                        case 7:
-                            pms5003_runtime->reading.raw_pm_0_5 =
-                                    (pms5003_runtime->buffer[0] << 8) | pms5003_runtime->buffer[1];
-                            break;
-                        case 8:
-                            pms5003_runtime->reading.raw_pm_1_0 =
-                                    (pms5003_runtime->buffer[0] << 8) | pms5003_runtime->buffer[1];
-                            break;
-                        case 9:
-                            pms5003_runtime->reading.raw_pm_2_5 =
-                                    (pms5003_runtime->buffer[0] << 8) | pms5003_runtime->buffer[1];
-                            break;
-                        case 10:
-                            pms5003_runtime->reading.temperature =
-                                    (pms5003_runtime->buffer[0] << 8) | pms5003_runtime->buffer[1];
-                            break;
-                        case 11:
-                            pms5003_runtime->reading.humidity =
-                                    (pms5003_runtime->buffer[0] << 8) | pms5003_runtime->buffer[1];
-                            break;
-                        case 12:
-                            pms5003_runtime->reading.voc =
-                                    (pms5003_runtime->buffer[0] << 8) | pms5003_runtime->buffer[1];
-                            break;
-                    }
-                    pms5003_runtime->field_index++;
-
-                }
-                pms5003_runtime->message_len -= 2;
-            }
-            pms5003_runtime->read_len = uart_read_bytes(pms5003_runtime->uart_port, pms5003_runtime->buffer, 2,
-                                                        100 / portTICK_PERIOD_MS);
-            if (pms5003_runtime->read_len) {
-                pms5003_runtime->checksum -= pms5003_runtime->buffer[0] << 8;
-                pms5003_runtime->checksum -= pms5003_runtime->buffer[1];
-            }
-            if (pms5003_runtime->checksum != 0) {
-                return -2;
+        reading->sensor_id = NULL;
+        reading->captured_at = time_sync_now();
+        reading->received_at = received_at;
+        LATENCY_TRACE_RECORD(LATENCY_STAGE_PARSE, received_at);
+        reading->stage_at = LATENCY_TRACE_NOW();
+#if CONFIG_PMS5003_REACTOR
+        if (pms5003_runtime->handler) {
+            /* No ring in between, so post and handoff both only cover getting to the direct call */
+            LATENCY_TRACE_RECORD(LATENCY_STAGE_POST, reading->stage_at);
+            pms5003_runtime->handler(pms5003_runtime->handler_args, PMS5003_EVENT, PMS5003T_READING, reading);
+        }
+#else
+        if (!pms5003_runtime->ring) {
+            if (pms5003_runtime->event_loop_handle) {
+                esp_event_post_to(pms5003_runtime->event_loop_handle, PMS5003_EVENT, PMS5003T_READING,
+                                  reading, sizeof(pms5003T_reading_t), 100 / portTICK_PERIOD_MS);
             }
-            pms5003_runtime->reading.sensor_id = NULL;
-            esp_event_post_to(pms5003_runtime->event_loop_handle, PMS5003_EVENT, PMS5003T_READING,
-                              &(pms5003_runtime->reading), sizeof(pms5003T_reading_t), 100 / portTICK_PERIOD_MS);
-            return 0;
+        } else if (reading == &pms5003_runtime->reading) {
+            atomic_fetch_add_explicit(&pms5003_runtime->ring->dropped, 1, memory_order_relaxed);
+            ESP_LOGW(TAG, "%d - dropped reading, ring full", pms5003_runtime->uart_port);
+            continue;
+        } else if (reading_ring_commit(pms5003_runtime->ring)) {
+            /* The consumer drains the ring before it waits again, so it only needs a notification once it is empty */
+            xTaskNotifyGive(pms5003_runtime->ring_consumer);
         }
+        LATENCY_TRACE_RECORD(LATENCY_STAGE_POST, reading->stage_at);
+#endif
+    }
+}
+
+static void pms5003_handle_uart_event(pms5003_runtime_t *pms5003_runtime, const uart_event_t *event)
+{
+    switch (event->type) {
+        case UART_DATA:
+            pms5003_read_available(pms5003_runtime, LATENCY_TRACE_NOW());
+            break;
+        case UART_FIFO_OVF:
+            ESP_LOGW(TAG, "%d HW FIFO Overflow", pms5003_runtime->uart_port);
+            PMS5003_UART_FLUSH(pms5003_runtime->uart_port);
+            pms5003_frame_parser_reset(&pms5003_runtime->parser);
+            xQueueReset(pms5003_runtime->queue_handle);
+            break;
+        case UART_BUFFER_FULL:
+            ESP_LOGW(TAG, "%d Ring Buffer Full", pms5003_runtime->uart_port);
+            PMS5003_UART_FLUSH(pms5003_runtime->uart_port);
+            pms5003_frame_parser_reset(&pms5003_runtime->parser);
+            xQueueReset(pms5003_runtime->queue_handle);
+            break;
+        case UART_BREAK:
+            ESP_LOGW(TAG, "%d Rx Break", pms5003_runtime->uart_port);
+            break;
+        case UART_PARITY_ERR:
+            ESP_LOGE(TAG, "%d Parity Error", pms5003_runtime->uart_port);
+            break;
+        case UART_FRAME_ERR:
+            ESP_LOGE(TAG, "%d Frame Error", pms5003_runtime->uart_port);
+            break;
+        default:
+            ESP_LOGW(TAG, "%d unknown uart event type: %d", pms5003_runtime->uart_port, event->type);
+            break;
     }
-    return -3;
 }
 
+#if CONFIG_PMS5003_REACTOR
+QueueHandle_t pms5003_get_event_queue(pms5003_handle_t pms_handle, UBaseType_t *length)
+{
+    pms5003_runtime_t *pms5003_runtime = (pms5003_runtime_t *)pms_handle;
+    *length = pms5003_runtime->queue_len;
+    return pms5003_runtime->queue_handle;
+}
+
+void pms5003_service(pms5003_handle_t pms_handle)
+{
+    pms5003_runtime_t *pms5003_runtime = (pms5003_runtime_t *)pms_handle;
+    uart_event_t event;
+    if (xQueueReceive(pms5003_runtime->queue_handle, &event, 0)) {
+        pms5003_handle_uart_event(pms5003_runtime, &event);
+    }
+}
+#else
 static void pms5003_task_entry(void *arg)
 {
     pms5003_runtime_t *pms5003_runtime = (pms5003_runtime_t *)arg;
     uart_event_t event;
     while (1) {
-        if (xQueueReceive(pms5003_runtime->queue_handle, &event, pdMS_TO_TICKS(1000))) {
-            switch (event.type) {
-                case UART_DATA:
-                    int ret = pms5003_read_measurement(pms5003_runtime);
-                    if (ret != 0) {
-                        ESP_LOGW(TAG, "%d - read err %d", pms5003_runtime->uart_port, ret);
-                    }
-                    break;
-                case UART_FIFO_OVF:
-                    ESP_LOGW(TAG, "%d HW FIFO Overflow", pms5003_runtime->uart_port);
-                    uart_flush(pms5003_runtime->uart_port);
-                    xQueueReset(pms5003_runtime->queue_handle);
-                    break;
-                case UART_BUFFER_FULL:
-                    ESP_LOGW(TAG, "%d Ring Buffer Full", pms5003_runtime->uart_port);
-                    uart_flush(pms5003_runtime->uart_port);
-                    xQueueReset(pms5003_runtime->queue_handle);
-                    break;
-                case UART_BREAK:
-                    ESP_LOGW(TAG, "%d Rx Break", pms5003_runtime->uart_port);
-                    break;
-                case UART_PARITY_ERR:
-                    ESP_LOGE(TAG, "%d Parity Error", pms5003_runtime->uart_port);
-                    break;
-                case UART_FRAME_ERR:
-                    ESP_LOGE(TAG, "%d Frame Error", pms5003_runtime->uart_port);
-                    break;
-                default:
-                    ESP_LOGW(TAG, "%d unknown uart event type: %d", pms5003_runtime->uart_port, event.type);
-                    break;
+        if (xQueueReceive(pms5003_runtime->queue_handle, &event, portMAX_DELAY)) {
+            pms5003_handle_uart_event(pms5003_runtime, &event);
+            /* Readings are only posted while handling UART events, so the loop has nothing to run in between */
+            if (pms5003_runtime->event_loop_handle) {
+                esp_event_loop_run(pms5003_runtime->event_loop_handle, 1);
             }
         }
-        esp_event_loop_run(pms5003_runtime->event_loop_handle, pdMS_TO_TICKS(50));
     }
     vTaskDelete(NULL);
 }
-
+#endif
 
 pms5003_handle_t pms5003_init(const pms5003_config_t *config)
 {
@@ -261,20 +254,26 @@ pms5003_handle_t pms5003_init(const pms5003_config_t *config)
     pms5003_runtime->sleep = SLEEP_AWAKE;
     pms5003_runtime->mode = MODE_ACTIVE;
 
-    pms5003_runtime->buffer = calloc(1, PMS5003_RUNTIME_PARSE_BUFFER_SIZE);
-    if (!pms5003_runtime->buffer) {
-        ESP_LOGE(TAG, "calloc for pms5003 runtime buffer failed");
-        goto error_buffer;
-    }
-
     pms5003_runtime->uart_port = config->uart.uart_port;
+#if CONFIG_PMS5003_SIMULATOR
+    if (pms5003_sim_uart_install(pms5003_runtime->uart_port, config->uart.event_queue_size,
+                                 &pms5003_runtime->queue_handle) != ESP_OK) {
+        ESP_LOGE(TAG, "simulated sensor install failed");
+        goto error_uart_install;
+    }
+#else
     uart_config_t uart_config = {
             .baud_rate = config->uart.baud_rate,
             .data_bits = config->uart.data_bits,
             .parity = config->uart.parity,
             .stop_bits = config->uart.stop_bits,
             .flow_ctrl = UART_HW_FLOWCTRL_DISABLE,
+#if CONFIG_PM_ENABLE
+            /* APB follows the CPU frequency under power management, XTAL keeps the baud rate stable */
+            .source_clk = UART_SCLK_XTAL,
+#else
             .source_clk = UART_SCLK_DEFAULT,
+#endif
     };
 
     if (uart_driver_install(pms5003_runtime->uart_port, PMS5003_UART_RX_BUFFER_SIZE, PMS5003_UART_TX_BUFFER_SIZE, config->uart.event_queue_size, &pms5003_runtime->queue_handle, 0) != ESP_OK) {
@@ -291,18 +290,22 @@ pms5003_handle_t pms5003_init(const pms5003_config_t *config)
         goto error_uart_config;
     }
 
-    uart_flush(pms5003_runtime->uart_port);
-
-    esp_event_loop_args_t event_loop_args = {
-            .queue_size = PMS5003_EVENT_LOOP_QUEUE_SIZE,
-            .task_name = NULL
-    };
-
-    if (esp_event_loop_create(&event_loop_args, &pms5003_runtime->event_loop_handle) != ESP_OK) {
-        ESP_LOGE(TAG, "event loop creation failed");
-        goto error_events;
+    /* Raise the RX interrupt once per full frame instead of per few bytes; the RX timeout still flushes
+     * partial frames and junk. The pattern detector can only match runs of one character, so it cannot
+     * be used to trigger on the two byte message header. */
+    if (uart_set_rx_full_threshold(pms5003_runtime->uart_port, PMS5003_FRAME_LEN) != ESP_OK) {
+        ESP_LOGE(TAG, "uart rx threshold config failed");
+        goto error_uart_config;
     }
+#endif
+
+    PMS5003_UART_FLUSH(pms5003_runtime->uart_port);
+    pms5003_runtime->queue_len = config->uart.event_queue_size;
 
+#if CONFIG_PMS5003_REACTOR
+    ESP_LOGI(TAG, "Initialized PMS5003 on uart %d for the I/O task", pms5003_runtime->uart_port);
+    return pms5003_runtime;
+#else
     BaseType_t taskErr = xTaskCreate(pms5003_task_entry, "PMS5003_sensor", 2048, pms5003_runtime,
                                      2, &pms5003_runtime->task_handle);
 
@@ -315,13 +318,12 @@ pms5003_handle_t pms5003_init(const pms5003_config_t *config)
     return pms5003_runtime;
 
     error_task_create:
-        esp_event_loop_delete(pms5003_runtime->event_loop_handle);
-    error_events:
+#endif
     error_uart_install:
-        uart_driver_delete(pms5003_runtime->uart_port);
+        PMS5003_UART_DELETE(pms5003_runtime->uart_port);
+#if !CONFIG_PMS5003_SIMULATOR
     error_uart_config:
-    error_buffer:
-        free(pms5003_runtime->buffer);
+#endif
     error_struct:
         free(pms5003_runtime);
     return NULL;
@@ -330,10 +332,13 @@ pms5003_handle_t pms5003_init(const pms5003_config_t *config)
 esp_err_t pms5003_deinit(pms5003_handle_t pms_handle)
 {
     pms5003_runtime_t *pms5003_runtime = (pms5003_runtime_t *)pms_handle;
+#if !CONFIG_PMS5003_REACTOR
     vTaskDelete(pms5003_runtime->task_handle);
-    esp_event_loop_delete(pms5003_runtime->event_loop_handle);
-    esp_err_t err = uart_driver_delete(pms5003_runtime->uart_port);
-    free(pms5003_runtime->buffer);
+    if (pms5003_runtime->event_loop_handle) {
+        esp_event_loop_delete(pms5003_runtime->event_loop_handle);
+    }
+#endif
+    esp_err_t err = PMS5003_UART_DELETE(pms5003_runtime->uart_port);
     free(pms5003_runtime);
     return err;
 }
@@ -341,20 +346,65 @@ esp_err_t pms5003_deinit(pms5003_handle_t pms_handle)
 esp_err_t pms5003_add_handler(pms5003_handle_t pms_handle, esp_event_handler_t event_handler, void *handler_args)
 {
     pms5003_runtime_t *pms5003_runtime = (pms5003_runtime_t *)pms_handle;
+#if CONFIG_PMS5003_REACTOR
+    if (pms5003_runtime->handler) {
+        return ESP_ERR_NO_MEM;
+    }
+    pms5003_runtime->handler_args = handler_args;
+    pms5003_runtime->handler = event_handler;
+    return ESP_OK;
+#else
+    /* Only created for handlers, a sensor feeding a reading ring never runs an event loop */
+    if (!pms5003_runtime->event_loop_handle) {
+        esp_event_loop_args_t event_loop_args = {
+                .queue_size = PMS5003_EVENT_LOOP_QUEUE_SIZE,
+                .task_name = NULL
+        };
+        esp_err_t err = esp_event_loop_create(&event_loop_args, &pms5003_runtime->event_loop_handle);
+        if (err != ESP_OK) {
+            ESP_LOGE(TAG, "event loop creation failed");
+            return err;
+        }
+    }
     return esp_event_handler_register_with(pms5003_runtime->event_loop_handle, PMS5003_EVENT, ESP_EVENT_ANY_ID,
                                            event_handler, handler_args);
+#endif
 }
 
+#if !CONFIG_PMS5003_REACTOR
+esp_err_t pms5003_set_reading_ring(pms5003_handle_t pms_handle, reading_ring_t *ring, TaskHandle_t consumer)
+{
+    pms5003_runtime_t *pms5003_runtime = (pms5003_runtime_t *)pms_handle;
+    if (pms5003_runtime->ring) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    pms5003_runtime->ring_consumer = consumer;
+    pms5003_runtime->ring = ring;
+    return ESP_OK;
+}
+#endif
+
 esp_err_t pms5003_remove_handler(pms5003_handle_t pms_handle, esp_event_handler_t event_handler)
 {
     pms5003_runtime_t *pms5003_runtime = (pms5003_runtime_t *)pms_handle;
+#if CONFIG_PMS5003_REACTOR
+    if (pms5003_runtime->handler != event_handler) {
+        return ESP_ERR_NOT_FOUND;
+    }
+    pms5003_runtime->handler = NULL;
+    return ESP_OK;
+#else
+    if (!pms5003_runtime->event_loop_handle) {
+        return ESP_ERR_NOT_FOUND;
+    }
     return esp_event_handler_unregister_with(pms5003_runtime->event_loop_handle, PMS5003_EVENT, ESP_EVENT_ANY_ID, event_handler);
+#endif
 }
 
 void pms5003_request_read(pms5003_handle_t pms_handle)
 {
     pms5003_runtime_t *pms5003_runtime = (pms5003_runtime_t *)pms_handle;
-    int write = uart_write_bytes(pms5003_runtime->uart_port, &PMS5003_CMD_READ, sizeof(PMS5003_CMD_READ));
+    int write = PMS5003_UART_WRITE(pms5003_runtime->uart_port, &PMS5003_CMD_READ, sizeof(PMS5003_CMD_READ));
     ESP_EARLY_LOGI(TAG, "reading uart %d %d", pms5003_runtime->uart_port, write);
 }
 
@@ -364,12 +414,12 @@ void pms5003_request_sleep(pms5003_handle_t pms_handle, pms5003_sleep_t state)
     int write;
     switch(state) {
         case SLEEP_SLEEP:
-            write = uart_write_bytes(pms5003_runtime->uart_port, &PMS5003_CMD_SLEEP, sizeof(PMS5003_CMD_SLEEP));
+            write = PMS5003_UART_WRITE(pms5003_runtime->uart_port, &PMS5003_CMD_SLEEP, sizeof(PMS5003_CMD_SLEEP));
             ESP_EARLY_LOGI(TAG, "sleeping uart %d %d", pms5003_runtime->uart_port, write);
             pms5003_runtime->sleep = SLEEP_SLEEP;
             break;
         case SLEEP_AWAKE:
-            write = uart_write_bytes(pms5003_runtime->uart_port, &PMS5003_CMD_WAKE, sizeof(PMS5003_CMD_WAKE));
+            write = PMS5003_UART_WRITE(pms5003_runtime->uart_port, &PMS5003_CMD_WAKE, sizeof(PMS5003_CMD_WAKE));
             ESP_EARLY_LOGI(TAG, "waking uart %d %d", pms5003_runtime->uart_port, write);
             pms5003_runtime->sleep = SLEEP_AWAKE;
             break;
@@ -382,12 +432,12 @@ void pms5003_request_mode(pms5003_handle_t pms_handle, pms5003_mode_t mode)
     int write;
     switch (mode) {
         case MODE_ACTIVE:
-            write = uart_write_bytes(pms5003_runtime->uart_port, &PMS5003_CMD_ACTIVE, sizeof(PMS5003_CMD_ACTIVE));
+            write = PMS5003_UART_WRITE(pms5003_runtime->uart_port, &PMS5003_CMD_ACTIVE, sizeof(PMS5003_CMD_ACTIVE));
             ESP_EARLY_LOGI(TAG, "activing uart %d %d", pms5003_runtime->uart_port, write);
             pms5003_runtime->mode = MODE_ACTIVE;
             break;
         case MODE_PASSIVE:
-            write = uart_write_bytes(pms5003_runtime->uart_port, &PMS5003_CMD_PASSIVE, sizeof(PMS5003_CMD_PASSIVE));
+            write = PMS5003_UART_WRITE(pms5003_runtime->uart_port, &PMS5003_CMD_PASSIVE, sizeof(PMS5003_CMD_PASSIVE));
             ESP_EARLY_LOGI(TAG, "passiving uart %d %d", pms5003_runtime->uart_port, write);
             pms5003_runtime->mode = MODE_PASSIVE;
             break;
@@ -18,37 +18,14 @@
 #pragma once
 
 #include "esp_types.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
 #include "esp_event.h"
 #include "esp_err.h"
 #include "driver/uart.h"
-
-/**
- * Particle concentrations in ug/m3
- */
-typedef struct {
-    uint16_t pm_1_0; /*!< PM1.0 */
-    uint16_t pm_2_5; /*!< PM2.5 */
-    uint16_t pm_10_0; /*!< PM10.0 */
-} pms5003_concentration_t;
-
-/**
- * Individual reading off the sensor
- */
-typedef struct {
-    pms5003_concentration_t standard; /*!< Concentration at standard particle */
-    pms5003_concentration_t atmospheric; /*!< Concentration under atmospheric conditions */
-
-    uint16_t raw_pm_0_3; /*!< Raw number of particles larger than 0.3um in 0.1L of air */
-    uint16_t raw_pm_0_5; /*!< Raw number of particles larger than 0.5um in 0.1L of air */
-    uint16_t raw_pm_1_0; /*!< Raw number of particles larger than 1.0um in 0.1L of air */
-    uint16_t raw_pm_2_5; /*!< Raw number of particles larger than 2.5um in 0.1L of air */
-
-    int16_t temperature; /*!< Temperature (in tenths of a degree C) */
-    uint16_t humidity; /*!< Relative Humidity (in tenths of a percent) */
-    uint16_t voc; /*!< */
-
-    char *sensor_id; /*!< Sensor name to report against */
-} pms5003T_reading_t;
+#include "sdkconfig.h"
+#include "pms5003_frame.h"
+#include "reading_ring.h"
 
 /**
  * Operation mode of the sensor
@@ -150,10 +127,12 @@ esp_err_t pms5003_deinit(pms5003_handle_t pms_handle);
 
 /**
  * @brief Attach a handler to the event loop for sensor readings
+ * @details The per-sensor event loop is created with the first handler. With CONFIG_PMS5003_REACTOR there is no
+ * per-sensor event loop; a single handler is called directly from the I/O task instead
  * @param pms_handle pointer to PMS5003T instance
  * @param event_handler handler function
  * @param handler_args additional args to pass along with event to handler
- * @return passed through from esp_event_handler_register_with
+ * @return passed through from esp_event_loop_create or esp_event_handler_register_with
  */
 esp_err_t pms5003_add_handler(pms5003_handle_t pms_handle, esp_event_handler_t event_handler, void *handler_args);
 
@@ -161,6 +140,37 @@ esp_err_t pms5003_add_handler(pms5003_handle_t pms_handle, esp_event_handler_t e
  * @brief Deattach a handler from the event loop
  * @param pms_handle pointer to PMS5003T instance
  * @param event_handler handler function
- * @return passed through from esp_event_handler_unregister_with
+ * @return passed through from esp_event_handler_unregister_with, ESP_ERR_NOT_FOUND if no handler was ever added
+ */
+esp_err_t pms5003_remove_handler(pms5003_handle_t pms_handle, esp_event_handler_t event_handler);
+
+#if !CONFIG_PMS5003_REACTOR
+/**
+ * @brief Hand readings to one consumer task through a ring instead of the event loop
+ * @details Readings are parsed straight into the ring's free slot and the consumer is woken with a task
+ * notification when the ring was empty. Handlers added with pms5003_add_handler() no longer see readings, and
+ * without handlers the driver never creates or runs an event loop. Readings that find the ring full are dropped
+ * and counted in its dropped field.
+ * @param pms_handle pointer to PMS5003T instance
+ * @param ring initialized ring, this driver instance becomes its only producer
+ * @param consumer task to notify with xTaskNotifyGive(), it must drain the ring every time it wakes
+ * @return ESP_OK, ESP_ERR_INVALID_STATE if a ring is already attached
+ */
+esp_err_t pms5003_set_reading_ring(pms5003_handle_t pms_handle, reading_ring_t *ring, TaskHandle_t consumer);
+#endif
+
+#if CONFIG_PMS5003_REACTOR
+/**
+ * @brief Get the queue the UART driver posts data/events to, for waiting on from the I/O task
+ * @param pms_handle pointer to PMS5003T instance
+ * @param length set to the length of the queue
+ * @return UART event queue
+ */
+QueueHandle_t pms5003_get_event_queue(pms5003_handle_t pms_handle, UBaseType_t *length);
+
+/**
+ * @brief Handle one pending UART event without blocking, parsing any frames it completes
+ * @param pms_handle pointer to PMS5003T instance
  */
-esp_err_t pms5003_remove_handler(pms5003_handle_t pms_handle, esp_event_handler_t event_handler);
\ No newline at end of file
+void pms5003_service(pms5003_handle_t pms_handle);
+#endif
@@ -0,0 +1,203 @@
+/* Airgradient Outdoor Sensor V1.1 firmware using ESP-IDF
+ * Copyright (C) 2023 Zach Strauss
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include "reading_aggregator.h"
+
+static void reading_bucket_reset(reading_bucket_t *bucket, uint32_t epoch)
+{
+    bucket->count = 0;
+    bucket->epoch = epoch;
+    for (int field = 0; field < PMS5003_FIELD_COUNT; field++) {
+        bucket->fields[field].sum = 0;
+        bucket->fields[field].sum_squares = 0;
+        bucket->fields[field].min = INT32_MAX;
+        bucket->fields[field].max = INT32_MIN;
+    }
+}
+
+static void reading_bucket_add(reading_bucket_t *bucket, const int32_t *values)
+{
+    bucket->count++;
+    for (int field = 0; field < PMS5003_FIELD_COUNT; field++) {
+        reading_moments_t *moments = &bucket->fields[field];
+        int32_t value = values[field];
+        moments->sum += value;
+        moments->sum_squares += (uint64_t)((int64_t)value * value);
+        if (value < moments->min) {
+            moments->min = value;
+        }
+        if (value > moments->max) {
+            moments->max = value;
+        }
+    }
+}
+
+static void reading_bucket_merge(reading_bucket_t *into, const reading_bucket_t *from)
+{
+    into->count += from->count;
+    for (int field = 0; field < PMS5003_FIELD_COUNT; field++) {
+        into->fields[field].sum += from->fields[field].sum;
+        into->fields[field].sum_squares += from->fields[field].sum_squares;
+        if (from->fields[field].min < into->fields[field].min) {
+            into->fields[field].min = from->fields[field].min;
+        }
+        if (from->fields[field].max > into->fields[field].max) {
+            into->fields[field].max = from->fields[field].max;
+        }
+    }
+}
+
+static uint32_t reading_isqrt(uint64_t value)
+{
+    uint64_t root = 0;
+    uint64_t bit = 1ULL << 62;
+    while (bit > value) {
+        bit >>= 2;
+    }
+    while (bit) {
+        if (value >= root + bit) {
+            value -= root + bit;
+            root = (root >> 1) + bit;
+        } else {
+            root >>= 1;
+        }
+        bit >>= 2;
+    }
+    return (uint32_t)root;
+}
+
+/**
+ * @brief Divide rounding half away from zero
+ */
+static int64_t reading_divide_rounded(int64_t dividend, uint32_t divisor)
+{
+    if (dividend < 0) {
+        return -((-dividend + divisor / 2) / divisor);
+    }
+    return (dividend + divisor / 2) / divisor;
+}
+
+/**
+ * @brief Population variance from exact sums
+ * @details n * sum_squares - sum^2 is exact while sum fits 32 bits and n * sum_squares fits 64 bits, i.e. for at
+ * least the first 65537 readings of a bucket. Past that the sum is split as q * n + r, so sum^2 / n is taken as
+ * q^2 * n + 2 * q * r + r^2 / n without forming sum^2. Only r^2 / n and the final division round down, so the
+ * result is at most one unit of variance short.
+ */
+static uint64_t reading_variance(const reading_moments_t *moments, uint32_t count)
+{
+    uint64_t sum_abs = moments->sum < 0 ? -moments->sum : moments->sum;
+    if (sum_abs <= UINT32_MAX && moments->sum_squares <= UINT64_MAX / count) {
+        uint64_t scaled = moments->sum_squares * count - sum_abs * sum_abs;
+        return scaled / ((uint64_t)count * count);
+    }
+    uint64_t quotient = sum_abs / count;
+    uint64_t remainder = sum_abs % count;
+    /* sum^2 / n never exceeds sum_squares, so none of the subtractions wrap */
+    uint64_t scaled = moments->sum_squares - quotient * quotient * count - 2 * quotient * remainder
+                      - remainder * remainder / count;
+    return scaled / count;
+}
+
+static void reading_bucket_summary(const reading_bucket_t *bucket, reading_summary_t *summary)
+{
+    uint16_t mean[PMS5003_FIELD_COUNT] = {0};
+    uint16_t min[PMS5003_FIELD_COUNT] = {0};
+    uint16_t max[PMS5003_FIELD_COUNT] = {0};
+    uint16_t stddev[PMS5003_FIELD_COUNT] = {0};
+
+    summary->count = bucket->count;
+    if (bucket->count) {
+        for (int field = 0; field < PMS5003_FIELD_COUNT; field++) {
+            const reading_moments_t *moments = &bucket->fields[field];
+            mean[field] = (uint16_t)reading_divide_rounded(moments->sum, bucket->count);
+            min[field] = (uint16_t)moments->min;
+            max[field] = (uint16_t)moments->max;
+            stddev[field] = (uint16_t)reading_isqrt(reading_variance(moments, bucket->count));
+        }
+    }
+    pms5003_reading_unpack(mean, &summary->mean);
+    pms5003_reading_unpack(min, &summary->min);
+    pms5003_reading_unpack(max, &summary->max);
+    pms5003_reading_unpack(stddev, &summary->stddev);
+}
+
+void reading_aggregator_init(reading_aggregator_t *aggregator, const uint32_t *lengths)
+{
+    reading_bucket_reset(&aggregator->burst, 0);
+    for (int window = 0; window < READING_WINDOW_COUNT; window++) {
+        reading_rolling_window_t *rolling = &aggregator->windows[window];
+        rolling->length = lengths[window];
+        rolling->slot_length = lengths[window] / READING_AGGREGATOR_SLOTS;
+        if (!rolling->slot_length) {
+            rolling->slot_length = 1;
+        }
+        for (int slot = 0; slot < READING_AGGREGATOR_SLOTS; slot++) {
+            reading_bucket_reset(&rolling->slots[slot], UINT32_MAX);
+        }
+    }
+}
+
+void reading_aggregator_add(reading_aggregator_t *aggregator, const pms5003T_reading_t *reading, uint32_t now)
+{
+    uint16_t fields[PMS5003_FIELD_COUNT];
+    int32_t values[PMS5003_FIELD_COUNT];
+    pms5003_reading_pack(reading, fields);
+    for (int field = 0; field < PMS5003_FIELD_COUNT; field++) {
+        values[field] = fields[field];
+    }
+    values[PMS5003_FIELD_TEMPERATURE] = (int16_t)fields[PMS5003_FIELD_TEMPERATURE];
+
+    reading_bucket_add(&aggregator->burst, values);
+    for (int window = 0; window < READING_WINDOW_COUNT; window++) {
+        reading_rolling_window_t *rolling = &aggregator->windows[window];
+        uint32_t epoch = now / rolling->slot_length;
+        reading_bucket_t *bucket = &rolling->slots[epoch % READING_AGGREGATOR_SLOTS];
+        if (bucket->epoch != epoch) {
+            reading_bucket_reset(bucket, epoch);
+        }
+        reading_bucket_add(bucket, values);
+    }
+}
+
+void reading_aggregator_burst_reset(reading_aggregator_t *aggregator)
+{
+    reading_bucket_reset(&aggregator->burst, 0);
+}
+
+void reading_aggregator_burst_summary(const reading_aggregator_t *aggregator, reading_summary_t *summary)
+{
+    summary->window = 0;
+    reading_bucket_summary(&aggregator->burst, summary);
+}
+
+void reading_aggregator_window_summary(const reading_aggregator_t *aggregator, reading_window_t window, uint32_t now,
+                                       reading_summary_t *summary)
+{
+    const reading_rolling_window_t *rolling = &aggregator->windows[window];
+    uint32_t epoch = now / rolling->slot_length;
+    reading_bucket_t merged;
+    reading_bucket_reset(&merged, epoch);
+    for (int slot = 0; slot < READING_AGGREGATOR_SLOTS; slot++) {
+        const reading_bucket_t *bucket = &rolling->slots[slot];
+        if (bucket->epoch <= epoch && epoch - bucket->epoch < READING_AGGREGATOR_SLOTS) {
+            reading_bucket_merge(&merged, bucket);
+        }
+    }
+    summary->window = rolling->length;
+    reading_bucket_summary(&merged, summary);
+}
@@ -0,0 +1,122 @@
+/* Airgradient Outdoor Sensor V1.1 firmware using ESP-IDF
+ * Copyright (C) 2023 Zach Strauss
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <stdint.h>
+#include "pms5003_frame.h"
+
+/**
+ * Sub-buckets per rolling window, a window summary covers between (slots - 1) / slots and all of its length
+ */
+#define READING_AGGREGATOR_SLOTS (4)
+
+/**
+ * Rolling windows kept alongside the per-burst aggregate
+ */
+typedef enum {
+    READING_WINDOW_SHORT, /*!< CONFIG_READING_WINDOW_SHORT seconds, 1 minute by default */
+    READING_WINDOW_MEDIUM, /*!< CONFIG_READING_WINDOW_MEDIUM seconds, 15 minutes by default */
+    READING_WINDOW_LONG, /*!< CONFIG_READING_WINDOW_LONG seconds, 1 hour by default */
+    READING_WINDOW_COUNT
+} reading_window_t;
+
+/**
+ * Running moments of one reading field
+ */
+typedef struct {
+    int64_t sum; /*!< sum of all values */
+    uint64_t sum_squares; /*!< sum of all squared values */
+    int32_t min; /*!< smallest value */
+    int32_t max; /*!< largest value */
+} reading_moments_t;
+
+/**
+ * Aggregate of every reading field over some span of time
+ */
+typedef struct {
+    uint32_t count; /*!< readings added */
+    uint32_t epoch; /*!< slot number this bucket was last reset for, unused by the burst bucket */
+    reading_moments_t fields[PMS5003_FIELD_COUNT]; /*!< moments per field, in pms5003_reading_pack() order */
+} reading_bucket_t;
+
+/**
+ * Rolling window made up of READING_AGGREGATOR_SLOTS buckets that are recycled as time moves on
+ */
+typedef struct {
+    uint32_t length; /*!< window length in seconds */
+    uint32_t slot_length; /*!< seconds covered by one bucket */
+    reading_bucket_t slots[READING_AGGREGATOR_SLOTS]; /*!< buckets, indexed by epoch modulo slot count */
+} reading_rolling_window_t;
+
+/**
+ * Per sensor aggregation state, fixed size no matter how many readings are added
+ */
+typedef struct {
+    reading_bucket_t burst; /*!< readings since the last reading_aggregator_burst_reset() */
+    reading_rolling_window_t windows[READING_WINDOW_COUNT]; /*!< rolling windows */
+} reading_aggregator_t;
+
+/**
+ * Statistics of every reading field over a window
+ */
+typedef struct {
+    uint32_t window; /*!< window length in seconds, 0 for a burst */
+    uint32_t count; /*!< readings the statistics cover */
+    pms5003T_reading_t mean; /*!< mean, rounded to nearest */
+    pms5003T_reading_t min; /*!< smallest value */
+    pms5003T_reading_t max; /*!< largest value */
+    pms5003T_reading_t stddev; /*!< population standard deviation, rounded down */
+} reading_summary_t;
+
+/**
+ * @brief Reset all windows and set their lengths
+ * @param aggregator aggregator instance
+ * @param lengths READING_WINDOW_COUNT window lengths in seconds
+ */
+void reading_aggregator_init(reading_aggregator_t *aggregator, const uint32_t *lengths);
+
+/**
+ * @brief Add a reading to the burst and every rolling window
+ * @param aggregator aggregator instance
+ * @param reading reading to add
+ * @param now monotonic time in seconds
+ */
+void reading_aggregator_add(reading_aggregator_t *aggregator, const pms5003T_reading_t *reading, uint32_t now);
+
+/**
+ * @brief Start a new burst
+ * @param aggregator aggregator instance
+ */
+void reading_aggregator_burst_reset(reading_aggregator_t *aggregator);
+
+/**
+ * @brief Summarize the readings added since the last burst reset
+ * @param aggregator aggregator instance
+ * @param summary destination, sensor_id of the contained readings is left untouched
+ */
+void reading_aggregator_burst_summary(const reading_aggregator_t *aggregator, reading_summary_t *summary);
+
+/**
+ * @brief Summarize the readings of a rolling window
+ * @param aggregator aggregator instance
+ * @param window window to summarize
+ * @param now monotonic time in seconds, buckets that have fallen out of the window are skipped
+ * @param summary destination, sensor_id of the contained readings is left untouched
+ */
+void reading_aggregator_window_summary(const reading_aggregator_t *aggregator, reading_window_t window, uint32_t now,
+                                       reading_summary_t *summary);
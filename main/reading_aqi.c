@@ -0,0 +1,97 @@
+/* Airgradient Outdoor Sensor V1.1 firmware using ESP-IDF
+ * Copyright (C) 2023 Zach Strauss
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include <stddef.h>
+#include "reading_aqi.h"
+
+/**
+ * Scale of the fixed point correction coefficients
+ */
+#define READING_AQI_ONE (1000000LL)
+
+/**
+ * One segment of the piecewise-linear AQI scale
+ */
+typedef struct {
+    uint16_t concentration_low; /*!< tenths of a ug/m3 */
+    uint16_t concentration_high; /*!< tenths of a ug/m3 */
+    uint16_t index_low;
+    uint16_t index_high;
+} reading_aqi_breakpoint_t;
+
+static const reading_aqi_breakpoint_t READING_AQI_PM_2_5[] = {
+        {0, 90, 0, 50},
+        {91, 354, 51, 100},
+        {355, 554, 101, 150},
+        {555, 1254, 151, 200},
+        {1255, 2254, 201, 300},
+        {2255, 3254, 301, 500},
+};
+#define READING_AQI_PM_2_5_COUNT (sizeof(READING_AQI_PM_2_5) / sizeof(READING_AQI_PM_2_5[0]))
+
+uint16_t reading_aqi_correct_pm_2_5(uint16_t pm_2_5_cf1, uint16_t humidity)
+{
+    int64_t x = pm_2_5_cf1;
+    int64_t humidity_term = 86200LL * humidity / 10; /* 0.0862 * RH */
+    int64_t corrected;
+
+    if (x < 30) {
+        corrected = 524000LL * x - humidity_term + 5750000LL;
+    } else if (x < 50) {
+        int64_t weight = 50000LL * x - 1500000LL; /* x / 20 - 3 / 2 */
+        int64_t slope = 524000LL + 262000LL * weight / READING_AQI_ONE;
+        corrected = slope * x - humidity_term + 5750000LL;
+    } else if (x < 210) {
+        corrected = 786000LL * x - humidity_term + 5750000LL;
+    } else if (x < 260) {
+        int64_t weight = 20000LL * x - 4200000LL; /* x / 50 - 21 / 5 */
+        int64_t rest = READING_AQI_ONE - weight;
+        int64_t slope = 786000LL - 96000LL * weight / READING_AQI_ONE;
+        corrected = slope * x
+                    - humidity_term * rest / READING_AQI_ONE
+                    + (2966000LL * weight + 5750000LL * rest) / READING_AQI_ONE
+                    + 884LL * x * x * weight / READING_AQI_ONE;
+    } else {
+        corrected = 2966000LL + 690000LL * x + 884LL * x * x;
+    }
+
+    if (corrected <= 0) {
+        return 0;
+    }
+    int64_t tenths = (corrected + READING_AQI_ONE / 20) / (READING_AQI_ONE / 10);
+    return tenths > UINT16_MAX ? UINT16_MAX : (uint16_t)tenths;
+}
+
+uint16_t reading_aqi_from_pm_2_5(uint16_t pm_2_5)
+{
+    for (size_t i = 0; i < READING_AQI_PM_2_5_COUNT; i++) {
+        const reading_aqi_breakpoint_t *breakpoint = &READING_AQI_PM_2_5[i];
+        if (pm_2_5 <= breakpoint->concentration_high) {
+            uint32_t span = breakpoint->concentration_high - breakpoint->concentration_low;
+            uint32_t offset = pm_2_5 - breakpoint->concentration_low;
+            uint32_t scaled = (breakpoint->index_high - breakpoint->index_low) * offset;
+            return breakpoint->index_low + (scaled + span / 2) / span;
+        }
+    }
+    return 500;
+}
+
+void reading_aqi_derive(pms5003T_reading_t *reading)
+{
+    reading->pm_2_5_corrected = reading_aqi_correct_pm_2_5(reading->standard.pm_2_5, reading->humidity);
+    reading->aqi = reading_aqi_from_pm_2_5(reading->pm_2_5_corrected);
+}
@@ -0,0 +1,48 @@
+/* Airgradient Outdoor Sensor V1.1 firmware using ESP-IDF
+ * Copyright (C) 2023 Zach Strauss
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <stdint.h>
+#include "pms5003_frame.h"
+
+/**
+ * @brief Correct a PM2.5 reading for relative humidity with the US EPA PurpleAir correction
+ * @details Uses the extended 2023 fit, which blends into a quadratic above 210 ug/m3 so smoke is not under-read.
+ * Evaluated in 64 bit fixed point.
+ * @param pm_2_5_cf1 PM2.5 at standard particle (CF=1) in ug/m3
+ * @param humidity relative humidity in tenths of a percent
+ * @return corrected PM2.5 in tenths of a ug/m3, never negative
+ */
+uint16_t reading_aqi_correct_pm_2_5(uint16_t pm_2_5_cf1, uint16_t humidity);
+
+/**
+ * @brief Convert a PM2.5 concentration to the US EPA Air Quality Index
+ * @details Uses the breakpoints of the 2024 PM2.5 NAAQS revision. The concentration is applied as is, no 24 hour
+ * or NowCast averaging is done here.
+ * @param pm_2_5 PM2.5 in tenths of a ug/m3
+ * @return AQI from 0 to 500, capped at 500
+ */
+uint16_t reading_aqi_from_pm_2_5(uint16_t pm_2_5);
+
+/**
+ * @brief Fill in the corrected PM2.5 and AQI of a reading from its standard particle PM2.5 and humidity
+ * @details Used for live readings and for readings replayed from the log, which only keeps the sensor fields, so
+ * both publish the same values
+ * @param reading reading to complete
+ */
+void reading_aqi_derive(pms5003T_reading_t *reading);
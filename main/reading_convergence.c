@@ -0,0 +1,59 @@
+/* Airgradient Outdoor Sensor V1.1 firmware using ESP-IDF
+ * Copyright (C) 2023 Zach Strauss
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include "reading_convergence.h"
+
+#define READING_CONVERGENCE_PM_FLOOR (2)
+#define READING_CONVERGENCE_COUNT_FLOOR (30)
+
+/**
+ * @brief Check a change against the tolerance, relative to the anchor value
+ */
+static bool reading_convergence_within(int anchor, int current, int floor, int tolerance_percent)
+{
+    int change = current > anchor ? current - anchor : anchor - current;
+    if (change <= floor) {
+        return true;
+    }
+    return change * 100 <= anchor * tolerance_percent;
+}
+
+void reading_convergence_init(reading_convergence_t *convergence, int tolerance_percent, int required)
+{
+    convergence->has_anchor = false;
+    convergence->stable = 0;
+    convergence->tolerance_percent = tolerance_percent;
+    convergence->required = required;
+}
+
+bool reading_convergence_add(reading_convergence_t *convergence, const pms5003T_reading_t *reading)
+{
+    if (convergence->has_anchor) {
+        const pms5003T_reading_t *anchor = &convergence->anchor;
+        if (reading_convergence_within(anchor->raw_pm_0_3, reading->raw_pm_0_3, READING_CONVERGENCE_COUNT_FLOOR,
+                                       convergence->tolerance_percent) &&
+            reading_convergence_within(anchor->atmospheric.pm_2_5, reading->atmospheric.pm_2_5,
+                                       READING_CONVERGENCE_PM_FLOOR, convergence->tolerance_percent)) {
+            convergence->stable++;
+            return convergence->stable >= convergence->required;
+        }
+    }
+    convergence->anchor = *reading;
+    convergence->has_anchor = true;
+    convergence->stable = 0;
+    return false;
+}
@@ -0,0 +1,52 @@
+/* Airgradient Outdoor Sensor V1.1 firmware using ESP-IDF
+ * Copyright (C) 2023 Zach Strauss
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <stdbool.h>
+#include "pms5003_frame.h"
+
+/**
+ * Tracks whether successive readings have settled
+ */
+typedef struct {
+    pms5003T_reading_t anchor; /*!< first reading of the current run of settled readings */
+    bool has_anchor; /*!< whether anchor holds a reading */
+    int stable; /*!< consecutive readings since the anchor within tolerance of it */
+    int tolerance_percent; /*!< largest change between readings that counts as settled */
+    int required; /*!< consecutive settled readings needed to converge */
+} reading_convergence_t;
+
+/**
+ * @brief Start tracking a new warm-up
+ * @param convergence convergence instance
+ * @param tolerance_percent largest change from the first reading of a run, relative to it, that counts as settled
+ * @param required consecutive settled readings needed to converge
+ */
+void reading_convergence_init(reading_convergence_t *convergence, int tolerance_percent, int required);
+
+/**
+ * @brief Add the next warm-up reading
+ * @details Fan flow settles the 0.3um count first and PM2.5 last, so both are compared. Each reading is compared
+ * against the first of the current run rather than the one before it, so a slow but steady rise does not pass as
+ * settled one small step at a time. Changes within a small noise floor always count as settled, so clean air
+ * converges.
+ * @param convergence convergence instance
+ * @param reading reading taken after the previous one
+ * @return true once the required number of consecutive readings have settled
+ */
+bool reading_convergence_add(reading_convergence_t *convergence, const pms5003T_reading_t *reading);
@@ -0,0 +1,48 @@
+/* Airgradient Outdoor Sensor V1.1 firmware using ESP-IDF
+ * Copyright (C) 2023 Zach Strauss
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include "reading_format.h"
+
+int reading_format_uint(char *buffer, uint32_t value)
+{
+    char digits[READING_FORMAT_UINT_MAX_LEN];
+    int count = 0;
+    do {
+        digits[count++] = (char)('0' + value % 10);
+        value /= 10;
+    } while (value);
+
+    for (int i = 0; i < count; i++) {
+        buffer[i] = digits[count - 1 - i];
+    }
+    buffer[count] = '\0';
+    return count;
+}
+
+int reading_format_tenths(char *buffer, int32_t tenths)
+{
+    int len = 0;
+    uint32_t magnitude = tenths < 0 ? -(uint32_t)tenths : (uint32_t)tenths;
+    if (tenths < 0) {
+        buffer[len++] = '-';
+    }
+    len += reading_format_uint(buffer + len, magnitude / 10);
+    buffer[len++] = '.';
+    buffer[len++] = (char)('0' + magnitude % 10);
+    buffer[len] = '\0';
+    return len;
+}
@@ -0,0 +1,47 @@
+/* Airgradient Outdoor Sensor V1.1 firmware using ESP-IDF
+ * Copyright (C) 2023 Zach Strauss
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <stdint.h>
+
+/**
+ * Longest output of reading_format_tenths(), without the terminator
+ */
+#define READING_FORMAT_TENTHS_MAX_LEN (12)
+
+/**
+ * Longest output of reading_format_uint(), without the terminator
+ */
+#define READING_FORMAT_UINT_MAX_LEN (10)
+
+/**
+ * @brief Write a tenths-scaled value as a decimal with one fractional digit, e.g. -53 as "-5.3"
+ * @details Integer only, so serialising a reading does not pull in float printf and its stack use
+ * @param buffer destination, at least READING_FORMAT_TENTHS_MAX_LEN + 1 bytes
+ * @param tenths value in tenths
+ * @return length written, not counting the terminator
+ */
+int reading_format_tenths(char *buffer, int32_t tenths);
+
+/**
+ * @brief Write an unsigned value in decimal
+ * @param buffer destination, at least READING_FORMAT_UINT_MAX_LEN + 1 bytes
+ * @param value value to write
+ * @return length written, not counting the terminator
+ */
+int reading_format_uint(char *buffer, uint32_t value);
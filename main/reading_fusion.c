@@ -0,0 +1,119 @@
+/* Airgradient Outdoor Sensor V1.1 firmware using ESP-IDF
+ * Copyright (C) 2023 Zach Strauss
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include <string.h>
+#include "reading_fusion.h"
+
+/**
+ * Per channel difference that is never treated as divergence, so near-zero readings are not flagged on noise
+ */
+static const int32_t READING_FUSION_FLOOR[PMS5003_FIELD_COUNT] = {
+        5, 5, 5, /* standard ug/m3 */
+        5, 5, 5, /* atmospheric ug/m3 */
+        100, 50, 20, 10, /* raw counts per 0.1L */
+        20, 50, /* tenths of a degree, tenths of a percent */
+        INT32_MAX /* voc is not populated by the PMS5003T */
+};
+
+static const char *const READING_FUSION_CHANNEL_NAME[PMS5003_FIELD_COUNT] = {
+        "standard/pm1.0", "standard/pm2.5", "standard/pm10.0",
+        "atmospheric/pm1.0", "atmospheric/pm2.5", "atmospheric/pm10.0",
+        "raw/0.3", "raw/0.5", "raw/1.0", "raw/2.5",
+        "temperature", "humidity", "voc"
+};
+
+void reading_fusion_init(reading_fusion_t *fusion, const char *sensor_a, const char *sensor_b, uint32_t pair_window,
+                         int divergence_percent)
+{
+    memset(fusion, 0, sizeof(reading_fusion_t));
+    fusion->sensor_ids[0] = sensor_a;
+    fusion->sensor_ids[1] = sensor_b;
+    fusion->pair_window = pair_window;
+    fusion->divergence_percent = divergence_percent;
+}
+
+static void reading_fusion_combine(const reading_fusion_t *fusion, reading_fusion_result_t *result)
+{
+    uint16_t a[PMS5003_FIELD_COUNT];
+    uint16_t b[PMS5003_FIELD_COUNT];
+    uint16_t fused[PMS5003_FIELD_COUNT];
+    int disagreement = 0;
+    int channels = 0;
+
+    pms5003_reading_pack(&fusion->readings[0], a);
+    pms5003_reading_pack(&fusion->readings[1], b);
+    result->divergent = 0;
+
+    for (int field = 0; field < PMS5003_FIELD_COUNT; field++) {
+        int32_t value_a = field == PMS5003_FIELD_TEMPERATURE ? (int16_t)a[field] : a[field];
+        int32_t value_b = field == PMS5003_FIELD_TEMPERATURE ? (int16_t)b[field] : b[field];
+        int32_t sum = value_a + value_b;
+        int32_t difference = value_a > value_b ? value_a - value_b : value_b - value_a;
+        fused[field] = (uint16_t)(sum >= 0 ? (sum + 1) / 2 : -((-sum + 1) / 2));
+
+        if (READING_FUSION_FLOOR[field] == INT32_MAX) {
+            continue;
+        }
+        int32_t magnitude = (sum < 0 ? -sum : sum) / 2;
+        if (magnitude < READING_FUSION_FLOOR[field]) {
+            magnitude = READING_FUSION_FLOOR[field];
+        }
+        int32_t percent = (int32_t)((int64_t)difference * 100 / magnitude);
+        if (difference > READING_FUSION_FLOOR[field] && percent > fusion->divergence_percent) {
+            result->divergent |= 1 << field;
+        }
+        disagreement += percent > 100 ? 100 : percent;
+        channels++;
+    }
+
+    pms5003_reading_unpack(fused, &result->fused);
+    result->agreement = (uint8_t)(100 - disagreement / channels);
+}
+
+bool reading_fusion_add(reading_fusion_t *fusion, const pms5003T_reading_t *reading, uint32_t now,
+                        reading_fusion_result_t *result)
+{
+    int index;
+    for (index = 0; index < 2; index++) {
+        if (fusion->sensor_ids[index] == reading->sensor_id || strcmp(fusion->sensor_ids[index], reading->sensor_id) == 0) {
+            break;
+        }
+    }
+    if (index == 2) {
+        return false;
+    }
+
+    fusion->readings[index] = *reading;
+    fusion->received_at[index] = now;
+    fusion->pending[index] = true;
+
+    int other = 1 - index;
+    if (!fusion->pending[other] || now - fusion->received_at[other] > fusion->pair_window) {
+        fusion->pending[other] = false;
+        return false;
+    }
+
+    reading_fusion_combine(fusion, result);
+    fusion->pending[0] = false;
+    fusion->pending[1] = false;
+    return true;
+}
+
+const char *reading_fusion_channel_name(int field)
+{
+    return READING_FUSION_CHANNEL_NAME[field];
+}
@@ -0,0 +1,74 @@
+/* Airgradient Outdoor Sensor V1.1 firmware using ESP-IDF
+ * Copyright (C) 2023 Zach Strauss
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "pms5003_frame.h"
+
+/**
+ * Readings from the two sensors that have not been paired yet
+ */
+typedef struct {
+    const char *sensor_ids[2]; /*!< names of the paired sensors */
+    pms5003T_reading_t readings[2]; /*!< latest unpaired reading per sensor */
+    uint32_t received_at[2]; /*!< when each reading arrived, in seconds */
+    bool pending[2]; /*!< whether readings holds an unpaired reading */
+    uint32_t pair_window; /*!< longest gap in seconds between two readings that are still paired */
+    int divergence_percent; /*!< relative difference above which a channel diverges */
+} reading_fusion_t;
+
+/**
+ * Outcome of pairing one reading from each sensor
+ */
+typedef struct {
+    pms5003T_reading_t fused; /*!< per channel mean of both readings */
+    uint8_t agreement; /*!< 100 when the sensors agree on every channel, down to 0 */
+    uint16_t divergent; /*!< bit per channel, in pms5003_reading_pack() order, set where the sensors disagree */
+} reading_fusion_result_t;
+
+/**
+ * @brief Set up pairing for two sensors
+ * @param fusion fusion instance
+ * @param sensor_a name of the first sensor
+ * @param sensor_b name of the second sensor
+ * @param pair_window longest gap in seconds between two readings that are still paired
+ * @param divergence_percent difference, relative to the channel mean, above which a channel is flagged
+ */
+void reading_fusion_init(reading_fusion_t *fusion, const char *sensor_a, const char *sensor_b, uint32_t pair_window,
+                         int divergence_percent);
+
+/**
+ * @brief Offer a reading for pairing
+ * @details A reading is paired with the other sensor's latest reading if that arrived within the pair window,
+ * otherwise it waits for the other sensor. Readings from sensors other than the two configured are ignored.
+ * @param fusion fusion instance
+ * @param reading reading from one of the sensors
+ * @param now monotonic time in seconds
+ * @param result destination for the fused reading, sensor_id of fused is left untouched
+ * @return true if a pair was completed and result filled
+ */
+bool reading_fusion_add(reading_fusion_t *fusion, const pms5003T_reading_t *reading, uint32_t now,
+                        reading_fusion_result_t *result);
+
+/**
+ * @brief Get the name of a channel for reporting divergence
+ * @param field channel in pms5003_reading_pack() order
+ * @return channel name matching the per-topic publish layout
+ */
+const char *reading_fusion_channel_name(int field);
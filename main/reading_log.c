@@ -0,0 +1,321 @@
+/* Airgradient Outdoor Sensor V1.1 firmware using ESP-IDF
+ * Copyright (C) 2023 Zach Strauss
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include "reading_log.h"
+#include "esp_partition.h"
+#include "esp_log.h"
+
+#define READING_LOG_SECTOR_SIZE (4096)
+#define READING_LOG_ERASED_SEQUENCE (0xFFFFFFFF)
+#define READING_LOG_STATE_PENDING (0xFF)
+#define READING_LOG_STATE_FORWARDED (0x00)
+#define READING_LOG_NO_SECTOR (0xFFFFFFFF)
+
+static const char *TAG = "Reading log";
+
+/**
+ * On-flash layout of one stored reading
+ */
+typedef struct {
+    uint32_t sequence; /*!< append counter, all ones while the slot is erased */
+    char sensor_id[READING_LOG_SENSOR_ID_LEN]; /*!< sensor name, not necessarily NUL terminated */
+    uint16_t fields[PMS5003_FIELD_COUNT]; /*!< reading data in wire order */
+    uint32_t captured_at; /*!< capture time of the reading, see PMS5003_CAPTURED_EPOCH_MIN */
+    uint16_t crc; /*!< CRC-16/CCITT over everything above */
+    uint8_t state; /*!< READING_LOG_STATE_PENDING until forwarded, outside the CRC so it can be cleared in place */
+} reading_log_record_t;
+
+#define READING_LOG_RECORDS_PER_SECTOR (READING_LOG_SECTOR_SIZE / sizeof(reading_log_record_t))
+
+/**
+ * Holder for runtime state of a reading log instance
+ */
+typedef struct {
+    const esp_partition_t *partition; /*!< flash partition backing the log */
+    uint32_t slot_count; /*!< total record slots in the partition */
+    uint32_t head; /*!< next slot to write */
+    uint32_t tail; /*!< oldest slot that may still be pending, equal to head when nothing is */
+    uint32_t next_sequence; /*!< sequence number for the next append */
+    uint32_t boot_sequence; /*!< first sequence appended since boot, earlier records count uptime from another boot */
+    uint32_t pending; /*!< readings written but not yet forwarded */
+    uint32_t dropped; /*!< pending readings lost to the ring wrapping */
+} reading_log_runtime_t;
+
+static uint16_t reading_log_crc(const reading_log_record_t *record)
+{
+    const uint8_t *data = (const uint8_t *)record;
+    uint16_t crc = 0xFFFF;
+    for (int i = 0; i < offsetof(reading_log_record_t, crc); i++) {
+        crc ^= data[i] << 8;
+        for (int bit = 0; bit < 8; bit++) {
+            crc = (crc & 0x8000) ? (crc << 1) ^ 0x1021 : crc << 1;
+        }
+    }
+    return crc;
+}
+
+static size_t reading_log_slot_offset(uint32_t slot)
+{
+    return (slot / READING_LOG_RECORDS_PER_SECTOR) * READING_LOG_SECTOR_SIZE +
+           (slot % READING_LOG_RECORDS_PER_SECTOR) * sizeof(reading_log_record_t);
+}
+
+static uint32_t reading_log_next_slot(reading_log_runtime_t *runtime, uint32_t slot)
+{
+    return (slot + 1) % runtime->slot_count;
+}
+
+/**
+ * Read a slot back from flash
+ * @return true if the slot holds a complete, valid record
+ */
+static bool reading_log_read_slot(reading_log_runtime_t *runtime, uint32_t slot, reading_log_record_t *record)
+{
+    if (esp_partition_read(runtime->partition, reading_log_slot_offset(slot), record, sizeof(*record)) != ESP_OK) {
+        return false;
+    }
+    return record->sequence != READING_LOG_ERASED_SEQUENCE && record->crc == reading_log_crc(record);
+}
+
+static bool reading_log_slot_erased(const reading_log_record_t *record)
+{
+    const uint8_t *data = (const uint8_t *)record;
+    for (int i = 0; i < sizeof(*record); i++) {
+        if (data[i] != 0xFF) {
+            return false;
+        }
+    }
+    return true;
+}
+
+/**
+ * Rebuild head, tail and pending count from what is in flash
+ * @details The newest sector is the one whose first record has the highest sequence; head is the first erased slot
+ * after its last valid record. Readings are forwarded in order, so the tail is the first valid pending record
+ * walking forward from the oldest sector.
+ */
+static void reading_log_recover(reading_log_runtime_t *runtime)
+{
+    reading_log_record_t record;
+    uint32_t sector_count = runtime->slot_count / READING_LOG_RECORDS_PER_SECTOR;
+    uint32_t newest_sector = READING_LOG_NO_SECTOR;
+    uint32_t oldest_sector = READING_LOG_NO_SECTOR;
+    uint32_t newest_sequence = 0;
+    uint32_t oldest_sequence = 0;
+
+    for (uint32_t sector = 0; sector < sector_count; sector++) {
+        if (!reading_log_read_slot(runtime, sector * READING_LOG_RECORDS_PER_SECTOR, &record)) {
+            continue;
+        }
+        if (newest_sector == READING_LOG_NO_SECTOR || record.sequence > newest_sequence) {
+            newest_sector = sector;
+            newest_sequence = record.sequence;
+        }
+        if (oldest_sector == READING_LOG_NO_SECTOR || record.sequence < oldest_sequence) {
+            oldest_sector = sector;
+            oldest_sequence = record.sequence;
+        }
+    }
+
+    runtime->head = 0;
+    runtime->tail = 0;
+    runtime->next_sequence = 0;
+    runtime->pending = 0;
+    if (newest_sector == READING_LOG_NO_SECTOR) {
+        return;
+    }
+
+    uint32_t slot = newest_sector * READING_LOG_RECORDS_PER_SECTOR;
+    for (int i = 0; i < READING_LOG_RECORDS_PER_SECTOR; i++, slot++) {
+        if (reading_log_read_slot(runtime, slot, &record)) {
+            runtime->next_sequence = record.sequence + 1;
+        } else if (reading_log_slot_erased(&record)) {
+            break;
+        }
+        /* anything else is a write torn by a reset, skip over it */
+    }
+    runtime->head = slot % runtime->slot_count;
+
+    bool tail_found = false;
+    for (slot = oldest_sector * READING_LOG_RECORDS_PER_SECTOR; slot != runtime->head;
+         slot = reading_log_next_slot(runtime, slot)) {
+        if (reading_log_read_slot(runtime, slot, &record) && record.state == READING_LOG_STATE_PENDING) {
+            if (!tail_found) {
+                runtime->tail = slot;
+                tail_found = true;
+            }
+            runtime->pending++;
+        }
+    }
+    if (!tail_found) {
+        runtime->tail = runtime->head;
+    }
+}
+
+/**
+ * Erase the sector the head is entering, dropping any pending readings still in it
+ */
+static esp_err_t reading_log_prepare_sector(reading_log_runtime_t *runtime)
+{
+    reading_log_record_t record;
+    uint32_t first = runtime->head;
+    uint32_t last = first + READING_LOG_RECORDS_PER_SECTOR;
+
+    if (runtime->pending && runtime->tail >= first && runtime->tail < last) {
+        for (uint32_t slot = runtime->tail; slot < last; slot++) {
+            if (reading_log_read_slot(runtime, slot, &record) && record.state == READING_LOG_STATE_PENDING) {
+                runtime->pending--;
+                runtime->dropped++;
+            }
+        }
+        runtime->tail = last % runtime->slot_count;
+        ESP_LOGW(TAG, "log full, dropped %lu pending readings so far", (unsigned long)runtime->dropped);
+    }
+
+    return esp_partition_erase_range(runtime->partition, reading_log_slot_offset(first), READING_LOG_SECTOR_SIZE);
+}
+
+reading_log_handle_t reading_log_init(const char *partition_label)
+{
+    reading_log_runtime_t *runtime = calloc(1, sizeof(reading_log_runtime_t));
+    if (!runtime) {
+        ESP_LOGE(TAG, "calloc for reading log runtime struct failed");
+        goto error_struct;
+    }
+
+    runtime->partition = esp_partition_find_first(ESP_PARTITION_TYPE_DATA, ESP_PARTITION_SUBTYPE_ANY,
+                                                  partition_label);
+    if (!runtime->partition) {
+        ESP_LOGE(TAG, "partition %s not found", partition_label);
+        goto error_partition;
+    }
+
+    /* At least two sectors so wrapping never erases the only sector holding data */
+    uint32_t sector_count = runtime->partition->size / READING_LOG_SECTOR_SIZE;
+    if (sector_count < 2) {
+        ESP_LOGE(TAG, "partition %s too small", partition_label);
+        goto error_partition;
+    }
+    runtime->slot_count = sector_count * READING_LOG_RECORDS_PER_SECTOR;
+
+    reading_log_recover(runtime);
+    runtime->boot_sequence = runtime->next_sequence;
+    ESP_LOGI(TAG, "Opened reading log, %lu of %lu slots pending", (unsigned long)runtime->pending,
+             (unsigned long)runtime->slot_count);
+    return runtime;
+
+    error_partition:
+    free(runtime);
+    error_struct:
+    return NULL;
+}
+
+esp_err_t reading_log_append(reading_log_handle_t log_handle, const pms5003T_reading_t *reading)
+{
+    reading_log_runtime_t *runtime = (reading_log_runtime_t *)log_handle;
+    reading_log_record_t record;
+    esp_err_t err;
+
+    if (runtime->head % READING_LOG_RECORDS_PER_SECTOR == 0) {
+        err = reading_log_prepare_sector(runtime);
+        if (err != ESP_OK) {
+            return err;
+        }
+    }
+
+    memset(&record, 0, sizeof(record));
+    record.sequence = runtime->next_sequence;
+    strncpy(record.sensor_id, reading->sensor_id, READING_LOG_SENSOR_ID_LEN);
+    pms5003_reading_pack(reading, record.fields);
+    record.captured_at = reading->captured_at;
+    record.crc = reading_log_crc(&record);
+    record.state = READING_LOG_STATE_PENDING;
+
+    err = esp_partition_write(runtime->partition, reading_log_slot_offset(runtime->head), &record, sizeof(record));
+    if (err != ESP_OK) {
+        return err;
+    }
+
+    if (runtime->pending == 0) {
+        runtime->tail = runtime->head;
+    }
+    runtime->head = reading_log_next_slot(runtime, runtime->head);
+    runtime->next_sequence++;
+    runtime->pending++;
+    return ESP_OK;
+}
+
+int reading_log_peek(reading_log_handle_t log_handle, reading_log_entry_t *entries, int max_entries)
+{
+    reading_log_runtime_t *runtime = (reading_log_runtime_t *)log_handle;
+    reading_log_record_t record;
+    int count = 0;
+
+    for (uint32_t slot = runtime->tail; slot != runtime->head && count < max_entries;
+         slot = reading_log_next_slot(runtime, slot)) {
+        if (!reading_log_read_slot(runtime, slot, &record) || record.state != READING_LOG_STATE_PENDING) {
+            continue;
+        }
+        reading_log_entry_t *entry = &entries[count++];
+        entry->sequence = record.sequence;
+        memcpy(entry->sensor_id, record.sensor_id, READING_LOG_SENSOR_ID_LEN);
+        entry->sensor_id[READING_LOG_SENSOR_ID_LEN - 1] = '\0';
+        pms5003_reading_unpack(record.fields, &entry->reading);
+        entry->reading.sensor_id = entry->sensor_id;
+        entry->reading.captured_at = record.captured_at;
+        if (record.captured_at < PMS5003_CAPTURED_EPOCH_MIN &&
+            (int32_t)(record.sequence - runtime->boot_sequence) < 0) {
+            entry->reading.captured_at = 0;
+        }
+    }
+    return count;
+}
+
+esp_err_t reading_log_consume(reading_log_handle_t log_handle, uint32_t last_sequence)
+{
+    reading_log_runtime_t *runtime = (reading_log_runtime_t *)log_handle;
+    reading_log_record_t record;
+    const uint8_t forwarded = READING_LOG_STATE_FORWARDED;
+    uint32_t slot;
+
+    for (slot = runtime->tail; slot != runtime->head; slot = reading_log_next_slot(runtime, slot)) {
+        if (!reading_log_read_slot(runtime, slot, &record) || record.state != READING_LOG_STATE_PENDING) {
+            continue;
+        }
+        if ((int32_t)(record.sequence - last_sequence) > 0) {
+            break;
+        }
+        esp_err_t err = esp_partition_write(runtime->partition,
+                                            reading_log_slot_offset(slot) + offsetof(reading_log_record_t, state),
+                                            &forwarded, sizeof(forwarded));
+        if (err != ESP_OK) {
+            runtime->tail = slot;
+            return err;
+        }
+        runtime->pending--;
+    }
+    runtime->tail = runtime->pending ? slot : runtime->head;
+    return ESP_OK;
+}
+
+uint32_t reading_log_pending(reading_log_handle_t log_handle)
+{
+    reading_log_runtime_t *runtime = (reading_log_runtime_t *)log_handle;
+    return runtime->pending;
+}
@@ -0,0 +1,85 @@
+/* Airgradient Outdoor Sensor V1.1 firmware using ESP-IDF
+ * Copyright (C) 2023 Zach Strauss
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include "esp_err.h"
+#include "pms5003_frame.h"
+
+#define READING_LOG_SENSOR_ID_LEN (8)
+
+/**
+ * Reading read back out of the log
+ */
+typedef struct {
+    uint32_t sequence; /*!< position of the entry in the log, increases by one per append */
+    char sensor_id[READING_LOG_SENSOR_ID_LEN]; /*!< sensor name the reading was made against */
+    pms5003T_reading_t reading; /*!< stored reading, its sensor_id points at the entry's own copy */
+} reading_log_entry_t;
+
+/**
+ * Pointer to an initialized reading log instance
+ */
+typedef void *reading_log_handle_t;
+
+/**
+ * @brief Open the reading log on a flash partition and recover its head and tail from the stored records
+ * @details The log is an append-only ring of fixed size records over every sector of the partition. Once full,
+ * the oldest sector is erased to make room, so the log never grows past the partition. Instances are not
+ * thread-safe, all calls for one log should come from the same task.
+ * @param partition_label label of the data partition to use
+ * @return pointer to reading log instance, NULL if the partition is missing or too small
+ */
+reading_log_handle_t reading_log_init(const char *partition_label);
+
+/**
+ * @brief Append a reading to the log as pending
+ * @param log_handle pointer to reading log instance
+ * @param reading reading to store
+ * @return
+ *  - ESP_OK: stored
+ *  - other: passed through from the flash erase/write
+ */
+esp_err_t reading_log_append(reading_log_handle_t log_handle, const pms5003T_reading_t *reading);
+
+/**
+ * @brief Copy out the oldest pending readings without removing them
+ * @details Capture times counted from an earlier boot can no longer be resolved and come back as 0
+ * @param log_handle pointer to reading log instance
+ * @param entries destination for the readings, oldest first
+ * @param max_entries capacity of entries
+ * @return number of entries filled
+ */
+int reading_log_peek(reading_log_handle_t log_handle, reading_log_entry_t *entries, int max_entries);
+
+/**
+ * @brief Mark every pending reading up to and including a sequence number as forwarded
+ * @details Forwarded state is written to flash, so consumed readings are not replayed after a reboot
+ * @param log_handle pointer to reading log instance
+ * @param last_sequence sequence of the newest reading that was forwarded
+ * @return
+ *  - ESP_OK: marked
+ *  - other: passed through from the flash write
+ */
+esp_err_t reading_log_consume(reading_log_handle_t log_handle, uint32_t last_sequence);
+
+/**
+ * @brief Get the number of readings waiting to be forwarded
+ * @param log_handle pointer to reading log instance
+ * @return pending reading count
+ */
+uint32_t reading_log_pending(reading_log_handle_t log_handle);
@@ -0,0 +1,94 @@
+/* Airgradient Outdoor Sensor V1.1 firmware using ESP-IDF
+ * Copyright (C) 2023 Zach Strauss
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include "reading_reducer.h"
+
+/**
+ * Order two values without a branch, the core's branch mispredictions would otherwise make the cost data dependent
+ */
+static inline void reading_reducer_compare_exchange(int32_t *a, int32_t *b)
+{
+    int32_t low = *a;
+    int32_t high = *b;
+    int32_t swap = -(int32_t)(high < low);
+    int32_t diff = (low ^ high) & swap;
+    *a = low ^ diff;
+    *b = high ^ diff;
+}
+
+void reading_reducer_sort(int32_t *values, int count)
+{
+    for (int pass = 0; pass < count; pass++) {
+        for (int i = pass & 1; i + 1 < count; i += 2) {
+            reading_reducer_compare_exchange(&values[i], &values[i + 1]);
+        }
+    }
+}
+
+/**
+ * @brief Mean of a run of values, rounding half away from zero
+ */
+static int32_t reading_reducer_mean(const int32_t *values, int count)
+{
+    int32_t sum = 0;
+    for (int i = 0; i < count; i++) {
+        sum += values[i];
+    }
+    if (sum < 0) {
+        return -((-sum + count / 2) / count);
+    }
+    return (sum + count / 2) / count;
+}
+
+void reading_reduce(const uint16_t (*fields)[PMS5003_FIELD_COUNT], int count, reading_reduction_t reduction,
+                    int trim_percent, pms5003T_reading_t *result)
+{
+    int32_t column[READING_REDUCER_MAX_COUNT];
+    uint16_t reduced[PMS5003_FIELD_COUNT];
+
+    if (count > READING_REDUCER_MAX_COUNT) {
+        count = READING_REDUCER_MAX_COUNT;
+    }
+    int trim = count * trim_percent / 100;
+    if (count - 2 * trim < 1) {
+        trim = (count - 1) / 2;
+    }
+
+    for (int field = 0; field < PMS5003_FIELD_COUNT; field++) {
+        for (int i = 0; i < count; i++) {
+            column[i] = field == PMS5003_FIELD_TEMPERATURE ? (int16_t)fields[i][field] : fields[i][field];
+        }
+
+        int32_t value;
+        switch (reduction) {
+            case READING_REDUCE_MEDIAN:
+                reading_reducer_sort(column, count);
+                value = reading_reducer_mean(&column[(count - 1) / 2], 2 - (count & 1));
+                break;
+            case READING_REDUCE_TRIMMED_MEAN:
+                reading_reducer_sort(column, count);
+                value = reading_reducer_mean(&column[trim], count - 2 * trim);
+                break;
+            case READING_REDUCE_MEAN:
+            default:
+                value = reading_reducer_mean(column, count);
+                break;
+        }
+        reduced[field] = (uint16_t)value;
+    }
+    pms5003_reading_unpack(reduced, result);
+}
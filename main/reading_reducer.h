@@ -0,0 +1,55 @@
+/* Airgradient Outdoor Sensor V1.1 firmware using ESP-IDF
+ * Copyright (C) 2023 Zach Strauss
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include "pms5003_frame.h"
+
+/**
+ * Most readings a single reduction accepts
+ */
+#define READING_REDUCER_MAX_COUNT (32)
+
+/**
+ * How a burst of readings is reduced to the one that gets published
+ */
+typedef enum {
+    READING_REDUCE_MEAN, /*!< mean of every reading */
+    READING_REDUCE_MEDIAN, /*!< middle reading per field, mean of the middle two for an even count */
+    READING_REDUCE_TRIMMED_MEAN /*!< mean after dropping a fraction of the smallest and largest readings per field */
+} reading_reduction_t;
+
+/**
+ * @brief Sort values ascending with an odd-even transposition network
+ * @details The network makes the same count * (count - 1) / 2 branch free compare-exchanges whatever the input,
+ * so the cost of a burst is fixed by its length
+ * @param values values to sort in place
+ * @param count number of values
+ */
+void reading_reducer_sort(int32_t *values, int count);
+
+/**
+ * @brief Reduce a burst of readings field by field
+ * @param fields readings of the burst, each packed once with pms5003_reading_pack()
+ * @param count number of readings, 1 to READING_REDUCER_MAX_COUNT, any beyond are ignored
+ * @param reduction reducer to apply
+ * @param trim_percent percentage of readings dropped from each end per field for READING_REDUCE_TRIMMED_MEAN, at
+ * least one reading is always kept
+ * @param result destination, sensor_id is left untouched
+ */
+void reading_reduce(const uint16_t (*fields)[PMS5003_FIELD_COUNT], int count, reading_reduction_t reduction,
+                    int trim_percent, pms5003T_reading_t *result);
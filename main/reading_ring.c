@@ -0,0 +1,62 @@
+/* Airgradient Outdoor Sensor V1.1 firmware using ESP-IDF
+ * Copyright (C) 2023 Zach Strauss
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+#include "reading_ring.h"
+
+#define READING_RING_MASK (READING_RING_CAPACITY - 1)
+
+_Static_assert((READING_RING_CAPACITY & READING_RING_MASK) == 0, "ring capacity must be a power of two");
+
+void reading_ring_init(reading_ring_t *ring)
+{
+    atomic_init(&ring->head, 0);
+    atomic_init(&ring->tail, 0);
+    atomic_init(&ring->dropped, 0);
+}
+
+pms5003T_reading_t *reading_ring_reserve(reading_ring_t *ring)
+{
+    unsigned head = atomic_load_explicit(&ring->head, memory_order_relaxed);
+    unsigned tail = atomic_load_explicit(&ring->tail, memory_order_acquire);
+    if (head - tail >= READING_RING_CAPACITY) {
+        return NULL;
+    }
+    return &ring->slots[head & READING_RING_MASK];
+}
+
+bool reading_ring_commit(reading_ring_t *ring)
+{
+    unsigned head = atomic_load_explicit(&ring->head, memory_order_relaxed);
+    /* Sequentially consistent store then load, paired with the consumer's release then peek: either the consumer
+     * sees this slot before it stops, or this sees the ring drained and wakes it */
+    atomic_store(&ring->head, head + 1);
+    return atomic_load(&ring->tail) == head;
+}
+
+const pms5003T_reading_t *reading_ring_peek(reading_ring_t *ring)
+{
+    unsigned tail = atomic_load_explicit(&ring->tail, memory_order_relaxed);
+    if (atomic_load(&ring->head) == tail) {
+        return NULL;
+    }
+    return &ring->slots[tail & READING_RING_MASK];
+}
+
+void reading_ring_release(reading_ring_t *ring)
+{
+    unsigned tail = atomic_load_explicit(&ring->tail, memory_order_relaxed);
+    atomic_store(&ring->tail, tail + 1);
+}
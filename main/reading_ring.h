@@ -0,0 +1,75 @@
+/* Airgradient Outdoor Sensor V1.1 firmware using ESP-IDF
+ * Copyright (C) 2023 Zach Strauss
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+#pragma once
+
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include "pms5003_frame.h"
+
+/**
+ * Slots per ring, a power of two. A burst asks for one reading at a time, so a consumer is never more than a
+ * couple of readings behind.
+ */
+#define READING_RING_CAPACITY (4)
+
+/**
+ * Fixed capacity single producer, single consumer ring of readings
+ * @details Lock free: head is only written by the producer and tail only by the consumer. The producer fills a
+ * slot in place and publishes it with reading_ring_commit(), the consumer reads it in place and hands it back with
+ * reading_ring_release(), so a reading is never copied on its way through.
+ */
+typedef struct {
+    pms5003T_reading_t slots[READING_RING_CAPACITY];
+    atomic_uint head; /*!< slots committed, only advanced by the producer */
+    atomic_uint tail; /*!< slots released, only advanced by the consumer */
+    _Atomic uint32_t dropped; /*!< readings the producer found no free slot for, counted with relaxed adds */
+} reading_ring_t;
+
+/**
+ * @brief Empty a ring
+ * @param ring ring instance
+ */
+void reading_ring_init(reading_ring_t *ring);
+
+/**
+ * @brief Producer: get the next free slot to fill
+ * @details Calling it again before committing returns the same slot
+ * @param ring ring instance
+ * @return slot to write the reading into, NULL if the consumer has fallen behind and the ring is full
+ */
+pms5003T_reading_t *reading_ring_reserve(reading_ring_t *ring);
+
+/**
+ * @brief Producer: publish the slot returned by reading_ring_reserve() to the consumer
+ * @param ring ring instance
+ * @return true if the consumer may have found the ring empty and stopped, so it needs waking
+ */
+bool reading_ring_commit(reading_ring_t *ring);
+
+/**
+ * @brief Consumer: get the oldest committed reading
+ * @param ring ring instance
+ * @return reading, valid until reading_ring_release(), NULL if the ring is empty
+ */
+const pms5003T_reading_t *reading_ring_peek(reading_ring_t *ring);
+
+/**
+ * @brief Consumer: hand the slot returned by reading_ring_peek() back to the producer
+ * @param ring ring instance
+ */
+void reading_ring_release(reading_ring_t *ring);
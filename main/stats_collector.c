@@ -15,6 +15,8 @@
  * along with this program.  If not, see <https://www.gnu.org/licenses/>.
  */
 
+#include <stddef.h>
+#include <string.h>
 #include "stats_collector.h"
 
 #include "esp_event.h"
@@ -24,32 +26,116 @@
 #include "esp_event.h"
 #include "esp_err.h"
 #include "esp_log.h"
+#include "esp_system.h"
+#include "esp_heap_caps.h"
 #include "sdkconfig.h"
 
 static const char *TAG = "Stats collector";
 ESP_EVENT_DEFINE_BASE(STATS_COLLECTOR_EVENT);
 
+#define STATS_COLLECTOR_INTERVAL_MS (30000)
+
+/**
+ * Counters of a task at the previous snapshot
+ */
+typedef struct {
+    UBaseType_t task_number;
+    uint32_t run_time;
+    uint32_t stack_high_water;
+} stats_collector_previous_t;
+
 typedef struct {
     TaskStatus_t *task_status_buffer;
+    stats_collector_snapshot_t snapshot;
+    stats_collector_previous_t previous[STATS_COLLECTOR_TASK_LIST_SIZE];
+    int previous_count;
+    uint32_t previous_total_run_time;
     esp_event_loop_handle_t event_loop;
     TaskHandle_t task_handle;
 } stats_collector_runtime_t;
 
+#if configUSE_TRACE_FACILITY
+static const stats_collector_previous_t *stats_collector_find_previous(const stats_collector_runtime_t *runtime,
+                                                                       UBaseType_t task_number) {
+    for (int i = 0; i < runtime->previous_count; i++) {
+        if (runtime->previous[i].task_number == task_number) {
+            return &runtime->previous[i];
+        }
+    }
+    return NULL;
+}
+
+/**
+ * @brief Turn a task list into a snapshot of deltas against the previous one, then remember it
+ */
+static void stats_collector_snapshot(stats_collector_runtime_t *runtime, int task_count, uint32_t total_run_time) {
+    stats_collector_snapshot_t *snapshot = &runtime->snapshot;
+    uint32_t elapsed = total_run_time - runtime->previous_total_run_time;
+
+    snapshot->free_heap = esp_get_free_heap_size();
+    snapshot->minimum_free_heap = esp_get_minimum_free_heap_size();
+    snapshot->largest_free_block = heap_caps_get_largest_free_block(MALLOC_CAP_8BIT);
+    snapshot->task_count = task_count;
+    snapshot->idle_permille = 0;
+
+    for (int task_index = 0; task_index < task_count; task_index++) {
+        const TaskStatus_t *status = &runtime->task_status_buffer[task_index];
+        stats_collector_task_t *task = &snapshot->tasks[task_index];
+        const stats_collector_previous_t *previous = stats_collector_find_previous(runtime, status->xTaskNumber);
+        uint32_t run_time = status->ulRunTimeCounter - (previous ? previous->run_time : 0);
+
+        strncpy(task->name, status->pcTaskName, sizeof(task->name) - 1);
+        task->name[sizeof(task->name) - 1] = '\0';
+        task->cpu_permille = elapsed ? (uint16_t) ((uint64_t) run_time * 1000 / elapsed) : 0;
+        task->stack_high_water = status->usStackHighWaterMark;
+        task->stack_high_water_change = previous ? (int32_t) status->usStackHighWaterMark -
+                                                   (int32_t) previous->stack_high_water : 0;
+        if (!strncmp(status->pcTaskName, "IDLE", 4)) {
+            snapshot->idle_permille += task->cpu_permille;
+        }
+    }
+
+    for (int task_index = 0; task_index < task_count; task_index++) {
+        runtime->previous[task_index].task_number = runtime->task_status_buffer[task_index].xTaskNumber;
+        runtime->previous[task_index].run_time = runtime->task_status_buffer[task_index].ulRunTimeCounter;
+        runtime->previous[task_index].stack_high_water = runtime->task_status_buffer[task_index].usStackHighWaterMark;
+    }
+    runtime->previous_count = task_count;
+    runtime->previous_total_run_time = total_run_time;
+}
+#endif
+
 static void stats_collector_task_entry(void *arg) {
 #if configUSE_TRACE_FACILITY
     stats_collector_runtime_t *runtime = (stats_collector_runtime_t *) arg;
     while (1) {
-        vTaskDelay(30000 / portTICK_PERIOD_MS);
+        vTaskDelay(STATS_COLLECTOR_INTERVAL_MS / portTICK_PERIOD_MS);
+        uint32_t total_run_time = 0;
         int currentTasks = uxTaskGetSystemState(runtime->task_status_buffer,
                                                 STATS_COLLECTOR_TASK_LIST_SIZE,
-                                                NULL);
-        for (int task_index = 0; task_index < currentTasks; task_index++) {
-            ESP_LOGI(TAG, "(%d) %s - %d | Stack: %lu | runtime: %lu",
-                     runtime->task_status_buffer[task_index].xTaskNumber,
-                     runtime->task_status_buffer[task_index].pcTaskName,
-                     runtime->task_status_buffer[task_index].eCurrentState,
-                     runtime->task_status_buffer[task_index].usStackHighWaterMark,
-                     runtime->task_status_buffer[task_index].ulRunTimeCounter);
+                                                &total_run_time);
+        stats_collector_snapshot(runtime, currentTasks, total_run_time);
+
+        const stats_collector_snapshot_t *snapshot = &runtime->snapshot;
+        for (int task_index = 0; task_index < snapshot->task_count; task_index++) {
+            ESP_LOGD(TAG, "%s | CPU: %d.%d%% | Stack: %lu (%+ld)",
+                     snapshot->tasks[task_index].name,
+                     snapshot->tasks[task_index].cpu_permille / 10,
+                     snapshot->tasks[task_index].cpu_permille % 10,
+                     (unsigned long) snapshot->tasks[task_index].stack_high_water,
+                     (long) snapshot->tasks[task_index].stack_high_water_change);
+        }
+        ESP_LOGI(TAG, "Idle: %d.%d%% | Heap free: %lu | minimum free: %lu | largest block: %lu",
+                 snapshot->idle_permille / 10, snapshot->idle_permille % 10,
+                 (unsigned long) snapshot->free_heap,
+                 (unsigned long) snapshot->minimum_free_heap,
+                 (unsigned long) snapshot->largest_free_block);
+
+        if (runtime->event_loop) {
+            size_t size = offsetof(stats_collector_snapshot_t, tasks) +
+                          snapshot->task_count * sizeof(stats_collector_task_t);
+            esp_event_post_to(runtime->event_loop, STATS_COLLECTOR_EVENT, TASK_STATE, (void *) snapshot, size,
+                              100 / portTICK_PERIOD_MS);
         }
     }
 #endif
@@ -73,7 +159,7 @@ stats_collector_handle_t stats_collector_init(esp_event_loop_handle_t event_loop
     }
 
 
-    BaseType_t taskErr = xTaskCreate(stats_collector_task_entry, "stats_collector", 2048, runtime,
+    BaseType_t taskErr = xTaskCreate(stats_collector_task_entry, "stats_collector", 3072, runtime,
                                      2, &runtime->task_handle);
 
     if (taskErr != pdTRUE) {
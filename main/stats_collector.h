@@ -18,6 +18,7 @@
 #pragma once
 
 #include "esp_event.h"
+#include "freertos/FreeRTOS.h"
 
 #define STATS_COLLECTOR_TASK_LIST_SIZE (32)
 
@@ -27,12 +28,43 @@ ESP_EVENT_DECLARE_BASE(STATS_COLLECTOR_EVENT);
  * Collector thrown events
  */
 typedef enum {
-    TASK_STATE /*!< State of a task */
+    TASK_STATE /*!< Snapshot of every task and the heap, event data is a stats_collector_snapshot_t */
 } stats_collector_event_id_t;
 
+/**
+ * Resource use of one task between two snapshots
+ */
+typedef struct {
+    char name[configMAX_TASK_NAME_LEN]; /*!< task name */
+    uint16_t cpu_permille; /*!< share of CPU time since the previous snapshot, in tenths of a percent */
+    uint32_t stack_high_water; /*!< least stack the task has ever had free, in bytes */
+    int32_t stack_high_water_change; /*!< change of stack_high_water since the previous snapshot, negative when the
+                                          task has come closer to overflowing */
+} stats_collector_task_t;
+
+/**
+ * Snapshot posted as TASK_STATE, only the first task_count entries of tasks are posted
+ */
+typedef struct {
+    uint32_t free_heap; /*!< free heap in bytes */
+    uint32_t minimum_free_heap; /*!< least free heap since boot in bytes */
+    uint32_t largest_free_block; /*!< largest allocation that can currently succeed, in bytes */
+    uint16_t idle_permille; /*!< share of CPU time spent in the idle task, including light sleep, since the previous
+                                 snapshot, in tenths of a percent */
+    uint32_t task_count; /*!< entries used in tasks */
+    stats_collector_task_t tasks[STATS_COLLECTOR_TASK_LIST_SIZE]; /*!< per task use */
+} stats_collector_snapshot_t;
+
 /**
  * Pointer to an initialized stats collector instance
  */
 typedef void *stats_collector_handle_t;
 
+/**
+ * @brief Start collecting task and heap statistics every 30 s
+ * @details Requires CONFIG_FREERTOS_USE_TRACE_FACILITY, CPU shares also need
+ * CONFIG_FREERTOS_GENERATE_RUN_TIME_STATS
+ * @param event_loop loop to post TASK_STATE events to
+ * @return collector handle, NULL if the trace facility is disabled or on failure
+ */
 stats_collector_handle_t stats_collector_init(esp_event_loop_handle_t event_loop);
\ No newline at end of file
@@ -0,0 +1,68 @@
+/* Airgradient Outdoor Sensor V1.1 firmware using ESP-IDF
+ * Copyright (C) 2023 Zach Strauss
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+#include <time.h>
+#include "time_sync.h"
+#include "pms5003_frame.h"
+#include "esp_netif_sntp.h"
+#include "esp_timer.h"
+#include "esp_log.h"
+#include "sdkconfig.h"
+
+static const char *TAG = "Time sync";
+
+/**
+ * Seconds since boot, counted from 1 so 0 can stand for unknown
+ */
+static uint32_t time_sync_uptime(void)
+{
+    return (uint32_t) (esp_timer_get_time() / 1000000) + 1;
+}
+
+static void time_sync_notify(struct timeval *tv)
+{
+    ESP_LOGI(TAG, "clock set to %lld", (long long) tv->tv_sec);
+}
+
+void time_sync_init(void)
+{
+    esp_sntp_config_t config = ESP_NETIF_SNTP_DEFAULT_CONFIG(CONFIG_TIME_SYNC_SERVER);
+    config.sync_cb = time_sync_notify;
+    if (esp_netif_sntp_init(&config) != ESP_OK) {
+        ESP_LOGE(TAG, "SNTP init failed, readings carry time since boot only");
+    }
+}
+
+uint32_t time_sync_now(void)
+{
+    time_t now = time(NULL);
+    if (now >= PMS5003_CAPTURED_EPOCH_MIN) {
+        return (uint32_t) now;
+    }
+    return time_sync_uptime();
+}
+
+uint32_t time_sync_resolve(uint32_t captured_at)
+{
+    if (captured_at >= PMS5003_CAPTURED_EPOCH_MIN || !captured_at) {
+        return captured_at;
+    }
+    time_t now = time(NULL);
+    if (now < PMS5003_CAPTURED_EPOCH_MIN) {
+        return 0;
+    }
+    return (uint32_t) now - (time_sync_uptime() - captured_at);
+}
@@ -0,0 +1,40 @@
+/* Airgradient Outdoor Sensor V1.1 firmware using ESP-IDF
+ * Copyright (C) 2023 Zach Strauss
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+#pragma once
+
+#include <stdint.h>
+
+/**
+ * @brief Start keeping the wall clock in sync over SNTP
+ * @details Does not wait for the first sync. Until the clock is set, capture times fall back to seconds since boot
+ * and are resolved to Unix time once it is. Call after the network interface is initialized.
+ */
+void time_sync_init(void);
+
+/**
+ * @brief Current time for stamping a capture
+ * @return Unix time in s once the clock is set, otherwise seconds since boot counted from 1, see
+ * PMS5003_CAPTURED_EPOCH_MIN
+ */
+uint32_t time_sync_now(void);
+
+/**
+ * @brief Turn a capture time into Unix time
+ * @param captured_at time taken with time_sync_now() during this boot, or 0
+ * @return Unix time in s, 0 if captured_at is 0 or is seconds since boot and the clock is not set yet
+ */
+uint32_t time_sync_resolve(uint32_t captured_at);
@@ -0,0 +1,286 @@
+/* Airgradient Outdoor Sensor V1.1 firmware using ESP-IDF
+ * Copyright (C) 2023 Zach Strauss
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+#include <string.h>
+#include "wifi_link.h"
+#include "freertos/FreeRTOS.h"
+#include "esp_wifi.h"
+#include "esp_netif.h"
+#include "esp_event.h"
+#include "esp_timer.h"
+#include "esp_random.h"
+#include "esp_log.h"
+#include "nvs.h"
+#include "sdkconfig.h"
+
+#define OAG_WIFI_SSID      CONFIG_ESP_WIFI_SSID
+#define OAG_WIFI_PASS      CONFIG_ESP_WIFI_PASSWORD
+
+#define WIFI_LINK_MIN_BACKOFF_MS CONFIG_WIFI_RECONNECT_MIN_BACKOFF
+#define WIFI_LINK_MAX_BACKOFF_MS (CONFIG_WIFI_RECONNECT_MAX_BACKOFF * 1000)
+#define WIFI_LINK_NVS_NAMESPACE "wifi_link"
+#define WIFI_LINK_NVS_AP_KEY "ap"
+
+#if CONFIG_ESP_WPA3_SAE_PWE_HUNT_AND_PECK
+#define ESP_WIFI_SAE_MODE WPA3_SAE_PWE_HUNT_AND_PECK
+#define OAG_H2E_IDENTIFIER ""
+#elif CONFIG_ESP_WPA3_SAE_PWE_HASH_TO_ELEMENT
+#define ESP_WIFI_SAE_MODE WPA3_SAE_PWE_HASH_TO_ELEMENT
+#define OAG_H2E_IDENTIFIER CONFIG_ESP_WIFI_PW_ID
+#elif CONFIG_ESP_WPA3_SAE_PWE_BOTH
+#define ESP_WIFI_SAE_MODE WPA3_SAE_PWE_BOTH
+#define OAG_H2E_IDENTIFIER CONFIG_ESP_WIFI_PW_ID
+#endif
+
+#if CONFIG_ESP_WIFI_AUTH_OPEN
+#define ESP_WIFI_SCAN_AUTH_MODE_THRESHOLD WIFI_AUTH_OPEN
+#elif CONFIG_ESP_WIFI_AUTH_WEP
+#define ESP_WIFI_SCAN_AUTH_MODE_THRESHOLD WIFI_AUTH_WEP
+#elif CONFIG_ESP_WIFI_AUTH_WPA_PSK
+#define ESP_WIFI_SCAN_AUTH_MODE_THRESHOLD WIFI_AUTH_WPA_PSK
+#elif CONFIG_ESP_WIFI_AUTH_WPA2_PSK
+#define ESP_WIFI_SCAN_AUTH_MODE_THRESHOLD WIFI_AUTH_WPA2_PSK
+#elif CONFIG_ESP_WIFI_AUTH_WPA_WPA2_PSK
+#define ESP_WIFI_SCAN_AUTH_MODE_THRESHOLD WIFI_AUTH_WPA_WPA2_PSK
+#elif CONFIG_ESP_WIFI_AUTH_WPA3_PSK
+#define ESP_WIFI_SCAN_AUTH_MODE_THRESHOLD WIFI_AUTH_WPA3_PSK
+#elif CONFIG_ESP_WIFI_AUTH_WPA2_WPA3_PSK
+#define ESP_WIFI_SCAN_AUTH_MODE_THRESHOLD WIFI_AUTH_WPA2_WPA3_PSK
+#elif CONFIG_ESP_WIFI_AUTH_WAPI_PSK
+#define ESP_WIFI_SCAN_AUTH_MODE_THRESHOLD WIFI_AUTH_WAPI_PSK
+#endif
+
+static const char *TAG = "Wifi link";
+
+/**
+ * Access point of the last good connection, as cached in NVS
+ */
+typedef struct {
+    uint8_t bssid[6]; /*!< MAC address of the access point */
+    uint8_t channel; /*!< primary channel */
+} wifi_link_ap_t;
+
+static esp_netif_t *wifi_netif;
+static esp_timer_handle_t wifi_retry_timer;
+static wifi_config_t wifi_config;
+static wifi_link_ap_t wifi_cached_ap;
+static bool wifi_has_cached_ap = false;
+static bool wifi_using_cached_ap = false; /*!< whether wifi_config is locked to the cached access point */
+static bool wifi_connected = false;
+static int wifi_retry_count = 0;
+static int64_t wifi_associated_at;
+static wifi_link_timing_t wifi_timing;
+static bool wifi_timing_fresh = false;
+static portMUX_TYPE wifi_timing_lock = portMUX_INITIALIZER_UNLOCKED;
+
+static void wifi_link_load_ap(void)
+{
+    nvs_handle_t nvs;
+    if (nvs_open(WIFI_LINK_NVS_NAMESPACE, NVS_READONLY, &nvs) != ESP_OK) {
+        return;
+    }
+    size_t len = sizeof(wifi_cached_ap);
+    wifi_has_cached_ap = nvs_get_blob(nvs, WIFI_LINK_NVS_AP_KEY, &wifi_cached_ap, &len) == ESP_OK &&
+                         len == sizeof(wifi_cached_ap);
+    nvs_close(nvs);
+}
+
+/**
+ * @brief Cache the access point just connected to, only writing flash when it changed
+ */
+static void wifi_link_save_ap(void)
+{
+    wifi_ap_record_t record;
+    if (esp_wifi_sta_get_ap_info(&record) != ESP_OK) {
+        return;
+    }
+    wifi_link_ap_t ap = {.channel = record.primary};
+    memcpy(ap.bssid, record.bssid, sizeof(ap.bssid));
+    if (wifi_has_cached_ap && !memcmp(&ap, &wifi_cached_ap, sizeof(ap))) {
+        return;
+    }
+
+    nvs_handle_t nvs;
+    if (nvs_open(WIFI_LINK_NVS_NAMESPACE, NVS_READWRITE, &nvs) != ESP_OK) {
+        ESP_LOGW(TAG, "caching access point failed");
+        return;
+    }
+    if (nvs_set_blob(nvs, WIFI_LINK_NVS_AP_KEY, &ap, sizeof(ap)) == ESP_OK && nvs_commit(nvs) == ESP_OK) {
+        wifi_cached_ap = ap;
+        wifi_has_cached_ap = true;
+        ESP_LOGI(TAG, "cached access point on channel %d", ap.channel);
+    }
+    nvs_close(nvs);
+}
+
+/**
+ * @brief Point the station at the cached access point, or let it scan for the SSID
+ */
+static void wifi_link_use_cached_ap(bool use)
+{
+    wifi_using_cached_ap = use && wifi_has_cached_ap;
+    wifi_config.sta.bssid_set = wifi_using_cached_ap;
+    wifi_config.sta.channel = wifi_using_cached_ap ? wifi_cached_ap.channel : 0;
+    if (wifi_using_cached_ap) {
+        memcpy(wifi_config.sta.bssid, wifi_cached_ap.bssid, sizeof(wifi_config.sta.bssid));
+    }
+    esp_wifi_set_config(WIFI_IF_STA, &wifi_config);
+}
+
+/**
+ * @brief Delay before the next attempt: doubles per failed attempt up to the maximum, the lower half of it random
+ * so devices that lost the same access point do not all retry together
+ */
+static uint32_t wifi_link_backoff_ms(int retry)
+{
+    uint32_t delay = WIFI_LINK_MAX_BACKOFF_MS;
+    if (retry <= 16 && (WIFI_LINK_MIN_BACKOFF_MS << (retry - 1)) < WIFI_LINK_MAX_BACKOFF_MS) {
+        delay = WIFI_LINK_MIN_BACKOFF_MS << (retry - 1);
+    }
+    return delay / 2 + esp_random() % (delay / 2 + 1);
+}
+
+static void wifi_link_retry(void *arg)
+{
+    esp_wifi_connect();
+}
+
+#if CONFIG_WIFI_STATIC_IP
+static void wifi_link_set_static_ip(void)
+{
+    esp_netif_ip_info_t ip_info = {
+            .ip.addr = esp_ip4addr_aton(CONFIG_WIFI_STATIC_IP_ADDRESS),
+            .netmask.addr = esp_ip4addr_aton(CONFIG_WIFI_STATIC_IP_NETMASK),
+            .gw.addr = esp_ip4addr_aton(CONFIG_WIFI_STATIC_IP_GATEWAY),
+    };
+    if (esp_netif_set_ip_info(wifi_netif, &ip_info) != ESP_OK) {
+        ESP_LOGE(TAG, "setting static IP failed");
+        return;
+    }
+    esp_netif_dns_info_t dns = {
+            .ip.u_addr.ip4.addr = esp_ip4addr_aton(CONFIG_WIFI_STATIC_IP_DNS),
+            .ip.type = ESP_IPADDR_TYPE_V4,
+    };
+    esp_netif_set_dns_info(wifi_netif, ESP_NETIF_DNS_MAIN, &dns);
+}
+#endif
+
+static void wifi_event_handler(void* arg, esp_event_base_t event_base, int32_t event_id, void* event_data) {
+    if (event_base == WIFI_EVENT && event_id == WIFI_EVENT_STA_START) {
+        wifi_timing.started_at = esp_timer_get_time();
+        wifi_timing.attempts = 1;
+        esp_wifi_connect();
+    } else if (event_base == WIFI_EVENT && event_id == WIFI_EVENT_STA_CONNECTED) {
+        wifi_associated_at = esp_timer_get_time();
+#if CONFIG_WIFI_STATIC_IP
+        /* Setting the address on an associated interface posts IP_EVENT_STA_GOT_IP */
+        wifi_link_set_static_ip();
+#endif
+    } else if (event_base == WIFI_EVENT && event_id == WIFI_EVENT_STA_DISCONNECTED) {
+        if (wifi_connected) {
+            wifi_connected = false;
+            wifi_timing.started_at = esp_timer_get_time();
+            wifi_timing.attempts = 0;
+            ESP_LOGI(TAG, "Wifi connection lost");
+            /* Go straight back to the access point that was just saved instead of scanning */
+            wifi_link_use_cached_ap(true);
+        } else if (wifi_using_cached_ap) {
+            ESP_LOGI(TAG, "cached access point unreachable, scanning");
+            wifi_link_use_cached_ap(false);
+        }
+        uint32_t delay = wifi_link_backoff_ms(++wifi_retry_count);
+        ESP_LOGI(TAG, "Wifi connection failed, retry %d in %lu ms", wifi_retry_count, (unsigned long) delay);
+        wifi_timing.attempts++;
+        esp_timer_start_once(wifi_retry_timer, (uint64_t) delay * 1000);
+    } else if (event_base == IP_EVENT && event_id == IP_EVENT_STA_GOT_IP) {
+        ip_event_got_ip_t *event = (ip_event_got_ip_t *) event_data;
+        ESP_LOGI(TAG, "Connected to wifi with IP Address:" IPSTR, IP2STR(&event->ip_info.ip));
+        int64_t now = esp_timer_get_time();
+        taskENTER_CRITICAL(&wifi_timing_lock);
+        wifi_timing.cached_ap = wifi_using_cached_ap;
+        wifi_timing.associate_ms = (uint32_t) ((wifi_associated_at - wifi_timing.started_at) / 1000);
+        wifi_timing.ip_ms = (uint32_t) ((now - wifi_associated_at) / 1000);
+        wifi_timing.connected_at = now;
+        wifi_timing_fresh = true;
+        taskEXIT_CRITICAL(&wifi_timing_lock);
+
+        wifi_connected = true;
+        wifi_retry_count = 0;
+        wifi_link_save_ap();
+    }
+}
+
+void wifi_link_init(void) {
+    ESP_ERROR_CHECK(esp_netif_init());
+
+    ESP_ERROR_CHECK(esp_event_loop_create_default());
+    wifi_netif = esp_netif_create_default_wifi_sta();
+#if CONFIG_WIFI_STATIC_IP
+    esp_netif_dhcpc_stop(wifi_netif);
+#endif
+
+    wifi_init_config_t cfg = WIFI_INIT_CONFIG_DEFAULT();
+    ESP_ERROR_CHECK(esp_wifi_init(&cfg));
+
+    esp_timer_create_args_t retry_timer_args = {
+            .callback = wifi_link_retry,
+            .name = "wifi_retry",
+    };
+    ESP_ERROR_CHECK(esp_timer_create(&retry_timer_args, &wifi_retry_timer));
+
+    esp_event_handler_instance_t instance_any_id;
+    esp_event_handler_instance_t instance_got_ip;
+
+    ESP_ERROR_CHECK(esp_event_handler_instance_register(WIFI_EVENT, ESP_EVENT_ANY_ID, &wifi_event_handler, NULL, &instance_any_id));
+    ESP_ERROR_CHECK(esp_event_handler_instance_register(IP_EVENT, IP_EVENT_STA_GOT_IP, &wifi_event_handler, NULL, &instance_got_ip));
+
+    wifi_config = (wifi_config_t) {
+            .sta = {
+                    .ssid = OAG_WIFI_SSID,
+                    .password = OAG_WIFI_PASS,
+                    /* Authmode threshold resets to WPA2 as default if password matches WPA2 standards (pasword len => 8).
+                     * If you want to connect the device to deprecated WEP/WPA networks, Please set the threshold value
+                     * to WIFI_AUTH_WEP/WIFI_AUTH_WPA_PSK and set the password with length and format matching to
+                     * WIFI_AUTH_WEP/WIFI_AUTH_WPA_PSK standards.
+                     */
+                    .threshold.authmode = ESP_WIFI_SCAN_AUTH_MODE_THRESHOLD,
+                    .sae_pwe_h2e = ESP_WIFI_SAE_MODE,
+                    .sae_h2e_identifier = OAG_H2E_IDENTIFIER,
+#if CONFIG_POWER_SAVE
+                    .listen_interval = CONFIG_POWER_SAVE_LISTEN_INTERVAL,
+#endif
+            },
+    };
+
+    /* Start Wi-Fi in station mode */
+    ESP_ERROR_CHECK(esp_wifi_set_mode(WIFI_MODE_STA));
+    wifi_link_load_ap();
+    wifi_link_use_cached_ap(true);
+    ESP_ERROR_CHECK(esp_wifi_start());
+#if CONFIG_POWER_SAVE
+    /* Only wake the radio every listen interval beacons between uploads, frames to send wake it right away */
+    esp_wifi_set_ps(WIFI_PS_MAX_MODEM);
+#endif
+}
+
+bool wifi_link_take_timing(wifi_link_timing_t *timing) {
+    taskENTER_CRITICAL(&wifi_timing_lock);
+    bool fresh = wifi_timing_fresh;
+    *timing = wifi_timing;
+    wifi_timing_fresh = false;
+    taskEXIT_CRITICAL(&wifi_timing_lock);
+    return fresh;
+}
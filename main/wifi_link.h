@@ -0,0 +1,47 @@
+/* Airgradient Outdoor Sensor V1.1 firmware using ESP-IDF
+ * Copyright (C) 2023 Zach Strauss
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+
+/**
+ * How the last connection came up, for working out how long the radio stays on per connection
+ */
+typedef struct {
+    uint32_t attempts; /*!< connection attempts it took */
+    bool cached_ap; /*!< connected straight to the access point cached in NVS, without a scan */
+    int64_t started_at; /*!< esp_timer time the radio started or the previous connection was lost */
+    uint32_t associate_ms; /*!< started_at to associated with the access point */
+    uint32_t ip_ms; /*!< associated to IP address assigned */
+    int64_t connected_at; /*!< esp_timer time the IP address was assigned */
+} wifi_link_timing_t;
+
+/**
+ * @brief Bring up the station interface and start connecting
+ * @details Connects straight to the access point and channel cached from the last good connection, skipping the
+ * scan, and falls back to a full scan if that fails. A lost connection is retried forever with exponential backoff
+ * and jitter. Returns without waiting for the connection. Requires NVS to be initialized.
+ */
+void wifi_link_init(void);
+
+/**
+ * @brief Take the timing of the connection that came up most recently
+ * @param timing filled with the timing
+ * @return true the first time it is called for a connection, false otherwise
+ */
+bool wifi_link_take_timing(wifi_link_timing_t *timing);
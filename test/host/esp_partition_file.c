@@ -0,0 +1,123 @@
+/* Airgradient Outdoor Sensor V1.1 firmware using ESP-IDF
+ * Copyright (C) 2023 Zach Strauss
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include "esp_partition_file.h"
+
+#define ESP_PARTITION_FILE_SECTOR_SIZE (4096)
+#define ESP_PARTITION_FILE_NO_TEAR ((size_t)-1)
+
+static esp_partition_t partition;
+static FILE *file;
+static size_t tear_after = ESP_PARTITION_FILE_NO_TEAR;
+
+const esp_partition_t *esp_partition_file_create(const char *label, size_t size)
+{
+    uint8_t erased[ESP_PARTITION_FILE_SECTOR_SIZE];
+    memset(erased, 0xFF, sizeof(erased));
+
+    esp_partition_file_close();
+    file = tmpfile();
+    for (size_t offset = 0; offset < size; offset += sizeof(erased)) {
+        fwrite(erased, 1, sizeof(erased), file);
+    }
+    fflush(file);
+
+    memset(&partition, 0, sizeof(partition));
+    partition.type = ESP_PARTITION_TYPE_DATA;
+    partition.subtype = ESP_PARTITION_SUBTYPE_ANY;
+    partition.size = size;
+    partition.erase_size = ESP_PARTITION_FILE_SECTOR_SIZE;
+    strncpy(partition.label, label, sizeof(partition.label) - 1);
+    tear_after = ESP_PARTITION_FILE_NO_TEAR;
+    return &partition;
+}
+
+void esp_partition_file_tear_next_write(size_t bytes)
+{
+    tear_after = bytes;
+}
+
+void esp_partition_file_close(void)
+{
+    if (file) {
+        fclose(file);
+        file = NULL;
+    }
+}
+
+const esp_partition_t *esp_partition_find_first(esp_partition_type_t type, esp_partition_subtype_t subtype,
+                                                const char *label)
+{
+    if (!file || type != partition.type || strcmp(label, partition.label) != 0) {
+        return NULL;
+    }
+    return &partition;
+}
+
+esp_err_t esp_partition_read(const esp_partition_t *part, size_t src_offset, void *dst, size_t size)
+{
+    if (src_offset + size > part->size) {
+        return ESP_ERR_INVALID_SIZE;
+    }
+    return pread(fileno(file), dst, size, src_offset) == (ssize_t)size ? ESP_OK : ESP_FAIL;
+}
+
+esp_err_t esp_partition_write(const esp_partition_t *part, size_t dst_offset, const void *src, size_t size)
+{
+    uint8_t current[ESP_PARTITION_FILE_SECTOR_SIZE];
+    const uint8_t *data = src;
+    esp_err_t ret = ESP_OK;
+
+    if (dst_offset + size > part->size || size > sizeof(current)) {
+        return ESP_ERR_INVALID_SIZE;
+    }
+    if (tear_after != ESP_PARTITION_FILE_NO_TEAR) {
+        size = tear_after < size ? tear_after : size;
+        tear_after = ESP_PARTITION_FILE_NO_TEAR;
+        ret = ESP_FAIL;
+    }
+
+    if (pread(fileno(file), current, size, dst_offset) != (ssize_t)size) {
+        return ESP_FAIL;
+    }
+    for (size_t i = 0; i < size; i++) {
+        current[i] &= data[i];
+    }
+    if (pwrite(fileno(file), current, size, dst_offset) != (ssize_t)size) {
+        return ESP_FAIL;
+    }
+    return ret;
+}
+
+esp_err_t esp_partition_erase_range(const esp_partition_t *part, size_t offset, size_t size)
+{
+    uint8_t erased[ESP_PARTITION_FILE_SECTOR_SIZE];
+    memset(erased, 0xFF, sizeof(erased));
+
+    if (offset % sizeof(erased) || size % sizeof(erased) || offset + size > part->size) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    for (size_t done = 0; done < size; done += sizeof(erased)) {
+        if (pwrite(fileno(file), erased, sizeof(erased), offset + done) != (ssize_t)sizeof(erased)) {
+            return ESP_FAIL;
+        }
+    }
+    return ESP_OK;
+}
@@ -0,0 +1,41 @@
+/* Airgradient Outdoor Sensor V1.1 firmware using ESP-IDF
+ * Copyright (C) 2023 Zach Strauss
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+#pragma once
+
+#include <stddef.h>
+#include "esp_partition.h"
+
+/**
+ * @brief Back the partition with the given label by a fresh, erased temporary file
+ * @details Writes behave like NOR flash: they can only clear bits, and only an erase sets them again.
+ * The file outlives reading_log_init, so opening the log again models a reboot.
+ * @param label partition label esp_partition_find_first should answer to
+ * @param size partition size, a multiple of the 4 KiB sector
+ * @return the partition
+ */
+const esp_partition_t *esp_partition_file_create(const char *label, size_t size);
+
+/**
+ * @brief Tear the next write as a reset part way through it would
+ * @param bytes number of bytes of the next write that reach the file before it fails
+ */
+void esp_partition_file_tear_next_write(size_t bytes);
+
+/**
+ * @brief Close the backing file
+ */
+void esp_partition_file_close(void);
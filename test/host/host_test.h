@@ -0,0 +1,83 @@
+/* Airgradient Outdoor Sensor V1.1 firmware using ESP-IDF
+ * Copyright (C) 2023 Zach Strauss
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+#pragma once
+
+#include <stdint.h>
+#include <stdio.h>
+#include <time.h>
+
+/**
+ * Shared helpers for the host tests: a failure counter, timers and a seeded generator
+ */
+
+static int host_test_failures;
+
+/**
+ * Record a failed check without stopping the test
+ */
+#define HOST_CHECK(cond) do { \
+        if (!(cond)) { \
+            fprintf(stderr, "%s:%d: check failed: %s\n", __FILE__, __LINE__, #cond); \
+            host_test_failures++; \
+        } \
+    } while (0)
+
+/**
+ * @return process exit status for the checks recorded so far
+ */
+static inline int host_test_result(void)
+{
+    if (host_test_failures) {
+        fprintf(stderr, "%d check(s) failed\n", host_test_failures);
+    }
+    return host_test_failures ? 1 : 0;
+}
+
+/**
+ * @return CPU time consumed by this process in ns
+ */
+static inline uint64_t host_test_cpu_ns(void)
+{
+    struct timespec now;
+    clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &now);
+    return (uint64_t)now.tv_sec * 1000000000u + now.tv_nsec;
+}
+
+/**
+ * @return monotonic wall clock time in ns
+ */
+static inline uint64_t host_test_wall_ns(void)
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint64_t)now.tv_sec * 1000000000u + now.tv_nsec;
+}
+
+/**
+ * xorshift32, so every run sees the same streams
+ * @param state generator state, must not be 0
+ * @return next pseudo-random value
+ */
+static inline uint32_t host_test_random(uint32_t *state)
+{
+    uint32_t x = *state;
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    *state = x;
+    return x;
+}
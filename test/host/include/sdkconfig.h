@@ -0,0 +1,58 @@
+/* Airgradient Outdoor Sensor V1.1 firmware using ESP-IDF
+ * Copyright (C) 2023 Zach Strauss
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+#pragma once
+
+/* Kconfig defaults for the host build, see main/Kconfig.projbuild. Tests may override them with definitions. */
+
+#define CONFIG_PMS5003_SOH_SCAN_LENGTH 33
+
+#ifndef CONFIG_PMS5003_MANAGER_SPINUP_TIME
+#define CONFIG_PMS5003_MANAGER_SPINUP_TIME 30
+#endif
+#ifndef CONFIG_PMS5003_MANAGER_SLEEP_TIME
+#define CONFIG_PMS5003_MANAGER_SLEEP_TIME 260
+#endif
+#ifndef CONFIG_PMS5003_MANAGER_READ_COUNT
+#define CONFIG_PMS5003_MANAGER_READ_COUNT 10
+#endif
+#ifndef CONFIG_PMS5003_SPINUP_MIN_TIME
+#define CONFIG_PMS5003_SPINUP_MIN_TIME 8
+#endif
+#ifndef CONFIG_PMS5003_SPINUP_SAMPLE_INTERVAL
+#define CONFIG_PMS5003_SPINUP_SAMPLE_INTERVAL 2300
+#endif
+#ifndef CONFIG_PMS5003_SPINUP_TOLERANCE
+#define CONFIG_PMS5003_SPINUP_TOLERANCE 5
+#endif
+#ifndef CONFIG_PMS5003_SPINUP_STABLE_COUNT
+#define CONFIG_PMS5003_SPINUP_STABLE_COUNT 3
+#endif
+#if !CONFIG_PMS5003_SCHEDULE_ALIGN
+#define CONFIG_PMS5003_SCHEDULE_STAGGER 1
+#endif
+#ifndef CONFIG_PMS5003_ADAPTIVE_MIN_SLEEP
+#define CONFIG_PMS5003_ADAPTIVE_MIN_SLEEP 60
+#endif
+#ifndef CONFIG_PMS5003_ADAPTIVE_MAX_SLEEP
+#define CONFIG_PMS5003_ADAPTIVE_MAX_SLEEP 450
+#endif
+#ifndef CONFIG_PMS5003_ADAPTIVE_FAST_CHANGE
+#define CONFIG_PMS5003_ADAPTIVE_FAST_CHANGE 50
+#endif
+#ifndef CONFIG_PMS5003_ADAPTIVE_STABLE_CHANGE
+#define CONFIG_PMS5003_ADAPTIVE_STABLE_CHANGE 10
+#endif
@@ -0,0 +1,125 @@
+/* Airgradient Outdoor Sensor V1.1 firmware using ESP-IDF
+ * Copyright (C) 2023 Zach Strauss
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+#include <stdbool.h>
+#include <string.h>
+#include "host_test.h"
+#include "latency_trace.h"
+
+/**
+ * Drives the latency trace from a test clock: stage histograms, percentiles, taking and clearing them and the
+ * 32 bit wrap of stamps, then times one record so the cost of a probe is known.
+ */
+
+#define BENCH_RECORDS (2000000)
+
+static int64_t clock_us;
+static bool clock_real;
+
+int64_t esp_timer_get_time(void)
+{
+    return clock_real ? (int64_t)(host_test_wall_ns() / 1000) : clock_us;
+}
+
+static void test_stages(void)
+{
+    latency_histogram_t histograms[LATENCY_STAGE_COUNT];
+    latency_trace_take(histograms);
+
+    /* 100 parses of 1 to 100 us, and one slow delivery */
+    for (int i = 1; i <= 100; i++) {
+        uint32_t since = LATENCY_TRACE_NOW();
+        clock_us += i;
+        LATENCY_TRACE_RECORD(LATENCY_STAGE_PARSE, since);
+    }
+    uint32_t since = LATENCY_TRACE_NOW();
+    clock_us += 3000000;
+    LATENCY_TRACE_RECORD(LATENCY_STAGE_DELIVER, since);
+
+    latency_trace_take(histograms);
+    const latency_histogram_t *parse = &histograms[LATENCY_STAGE_PARSE];
+    HOST_CHECK(parse->count == 100);
+    HOST_CHECK(parse->sum == 5050);
+    HOST_CHECK(parse->max == 100);
+    HOST_CHECK(parse->buckets[0] == 1);
+    HOST_CHECK(parse->buckets[6] == 37);
+    /* 50th sample is 50 us, in the 32-63 us bucket */
+    HOST_CHECK(latency_histogram_percentile(parse, 50) == 63);
+    HOST_CHECK(latency_histogram_percentile(parse, 100) == 100);
+    HOST_CHECK(latency_histogram_used_buckets(parse) == 7);
+
+    HOST_CHECK(histograms[LATENCY_STAGE_DELIVER].count == 1);
+    HOST_CHECK(histograms[LATENCY_STAGE_DELIVER].max == 3000000);
+    HOST_CHECK(histograms[LATENCY_STAGE_ACK].count == 0);
+    HOST_CHECK(latency_histogram_percentile(&histograms[LATENCY_STAGE_ACK], 99) == 0);
+
+    /* Taking the histograms starts new ones */
+    latency_trace_take(histograms);
+    for (int stage = 0; stage < LATENCY_STAGE_COUNT; stage++) {
+        HOST_CHECK(histograms[stage].count == 0);
+    }
+}
+
+static void test_wrap(void)
+{
+    latency_histogram_t histograms[LATENCY_STAGE_COUNT];
+    /* Stamps are 32 bit microseconds and wrap every 71 minutes */
+    clock_us = ((int64_t)1 << 32) - 10;
+    uint32_t since = LATENCY_TRACE_NOW();
+    clock_us += 25;
+    LATENCY_TRACE_RECORD(LATENCY_STAGE_TOTAL, since);
+    latency_trace_take(histograms);
+    HOST_CHECK(histograms[LATENCY_STAGE_TOTAL].count == 1);
+    HOST_CHECK(histograms[LATENCY_STAGE_TOTAL].max == 25);
+}
+
+static void test_stage_names(void)
+{
+    for (int stage = 0; stage < LATENCY_STAGE_COUNT; stage++) {
+        const char *name = latency_trace_stage_name(stage);
+        HOST_CHECK(name != NULL && strlen(name) > 0);
+        for (int other = 0; other < stage; other++) {
+            HOST_CHECK(strcmp(name, latency_trace_stage_name(other)) != 0);
+        }
+    }
+    HOST_CHECK(strcmp(latency_trace_stage_name(LATENCY_STAGE_PARSE), "parse") == 0);
+    HOST_CHECK(strcmp(latency_trace_stage_name(LATENCY_STAGE_ACK), "ack") == 0);
+}
+
+static void bench_record(void)
+{
+    latency_histogram_t histograms[LATENCY_STAGE_COUNT];
+    clock_real = true;
+    uint64_t start = host_test_cpu_ns();
+    for (int i = 0; i < BENCH_RECORDS; i++) {
+        LATENCY_TRACE_RECORD(i % LATENCY_STAGE_COUNT, LATENCY_TRACE_NOW());
+    }
+    uint64_t cpu = host_test_cpu_ns() - start;
+    clock_real = false;
+    latency_trace_take(histograms);
+    printf("stamp and record       %7d records %6.1f ns/record, clock read included\n", BENCH_RECORDS,
+           (double)cpu / BENCH_RECORDS);
+    HOST_CHECK(histograms[LATENCY_STAGE_PARSE].count == (BENCH_RECORDS + LATENCY_STAGE_COUNT - 1) / LATENCY_STAGE_COUNT);
+}
+
+int main(void)
+{
+    test_stages();
+    test_wrap();
+    test_stage_names();
+    bench_record();
+    return host_test_result();
+}
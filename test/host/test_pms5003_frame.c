@@ -0,0 +1,280 @@
+/* Airgradient Outdoor Sensor V1.1 firmware using ESP-IDF
+ * Copyright (C) 2023 Zach Strauss
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+#include <stdlib.h>
+#include <string.h>
+#include "host_test.h"
+#include "pms5003_frame.h"
+
+/**
+ * Fuzz and throughput harness for the frame parser.
+ *
+ * Builds a byte stream of valid frames mixed with truncated frames, frames with a corrupted byte and
+ * runs of junk, then feeds it through the parser in UART sized chunks the same way pms5003_read_available
+ * does. Every valid frame must come out once and in order, and almost nothing else may be accepted.
+ */
+
+#define STREAM_EVENTS (20000)
+#define STREAM_MAX_LEN (STREAM_EVENTS * (PMS5003_FRAME_LEN + 40))
+#define BENCH_FRAMES (200000)
+
+typedef enum {
+    STREAM_VALID,
+    STREAM_TRUNCATED,
+    STREAM_CORRUPTED,
+    STREAM_JUNK,
+    STREAM_CASE_COUNT,
+} stream_case_t;
+
+typedef struct {
+    uint8_t *bytes;
+    size_t len;
+    uint16_t (*expected)[PMS5003_FIELD_COUNT]; /*!< packed fields of every valid frame, in stream order */
+    int expected_count;
+    int cases[STREAM_CASE_COUNT];
+} stream_t;
+
+typedef struct {
+    int accepted;
+    int false_accepts;
+    int false_rejects;
+    int errors[5]; /*!< parser error returns, indexed by -ret */
+    uint64_t cpu_ns;
+} parse_result_t;
+
+static void random_reading(uint32_t *rng, pms5003T_reading_t *reading)
+{
+    uint16_t fields[PMS5003_FIELD_COUNT];
+    for (int i = 0; i < PMS5003_FIELD_COUNT; i++) {
+        fields[i] = host_test_random(rng) & 0xFFFF;
+    }
+    memset(reading, 0, sizeof(*reading));
+    pms5003_reading_unpack(fields, reading);
+}
+
+static void stream_build(stream_t *stream, uint32_t seed, bool clean)
+{
+    uint32_t rng = seed;
+    stream->bytes = malloc(STREAM_MAX_LEN);
+    stream->expected = malloc(sizeof(*stream->expected) * STREAM_EVENTS);
+    stream->len = 0;
+    stream->expected_count = 0;
+    memset(stream->cases, 0, sizeof(stream->cases));
+
+    for (int event = 0; event < STREAM_EVENTS; event++) {
+        stream_case_t which = clean ? STREAM_VALID : host_test_random(&rng) % STREAM_CASE_COUNT;
+        uint8_t *out = stream->bytes + stream->len;
+        pms5003T_reading_t reading;
+        stream->cases[which]++;
+
+        switch (which) {
+        case STREAM_VALID:
+            random_reading(&rng, &reading);
+            pms5003_frame_encode(&reading, out);
+            pms5003_reading_pack(&reading, stream->expected[stream->expected_count++]);
+            stream->len += PMS5003_FRAME_LEN;
+            break;
+        case STREAM_TRUNCATED:
+            random_reading(&rng, &reading);
+            pms5003_frame_encode(&reading, out);
+            stream->len += 1 + host_test_random(&rng) % (PMS5003_FRAME_LEN - 1);
+            break;
+        case STREAM_CORRUPTED: {
+            random_reading(&rng, &reading);
+            pms5003_frame_encode(&reading, out);
+            /* Any single byte change after the header is caught by the length or checksum check */
+            int index = 2 + host_test_random(&rng) % (PMS5003_FRAME_LEN - 2);
+            out[index] ^= 1 + host_test_random(&rng) % 0xFF;
+            stream->len += PMS5003_FRAME_LEN;
+            break;
+        }
+        case STREAM_JUNK: {
+            int len = 1 + host_test_random(&rng) % 40;
+            for (int i = 0; i < len; i++) {
+                out[i] = host_test_random(&rng) & 0xFF;
+            }
+            stream->len += len;
+            break;
+        }
+        default:
+            break;
+        }
+    }
+}
+
+static void stream_free(stream_t *stream)
+{
+    free(stream->bytes);
+    free(stream->expected);
+}
+
+/**
+ * Feed a stream through the parser
+ * @param stream
+ * @param max_chunk largest number of bytes handed over per read, 0 for as much as the parser takes
+ * @param seed chunk size generator seed
+ * @param result
+ */
+static void stream_parse(const stream_t *stream, size_t max_chunk, uint32_t seed, parse_result_t *result)
+{
+    pms5003_frame_parser_t parser;
+    pms5003_frame_parser_reset(&parser);
+    memset(result, 0, sizeof(*result));
+    uint32_t rng = seed;
+    int next = 0;
+
+    uint64_t start = host_test_cpu_ns();
+    size_t pos = 0;
+    while (pos < stream->len) {
+        size_t space;
+        uint8_t *dest = pms5003_frame_parser_space(&parser, &space);
+        size_t len = space;
+        if (max_chunk && len > 1) {
+            size_t chunk = 1 + host_test_random(&rng) % max_chunk;
+            len = chunk < len ? chunk : len;
+        }
+        if (len > stream->len - pos) {
+            len = stream->len - pos;
+        }
+        memcpy(dest, stream->bytes + pos, len);
+        pos += len;
+
+        pms5003T_reading_t reading;
+        int ret = pms5003_frame_parser_commit(&parser, len, &reading);
+        if (ret < 0) {
+            result->errors[-ret]++;
+            continue;
+        }
+        if (ret != 0) {
+            continue;
+        }
+
+        uint16_t fields[PMS5003_FIELD_COUNT];
+        pms5003_reading_pack(&reading, fields);
+        int match = next;
+        while (match < stream->expected_count && memcmp(fields, stream->expected[match], sizeof(fields)) != 0) {
+            match++;
+        }
+        if (match == stream->expected_count) {
+            result->false_accepts++;
+            continue;
+        }
+        result->false_rejects += match - next;
+        result->accepted++;
+        next = match + 1;
+    }
+    result->cpu_ns = host_test_cpu_ns() - start;
+    result->false_rejects += stream->expected_count - next;
+}
+
+static void report(const char *name, const stream_t *stream, const parse_result_t *result)
+{
+    double seconds = result->cpu_ns / 1e9;
+    printf("%-22s %7d frames %9.0f frames/s %7.1f ns/frame  false accept %.4f%%  false reject %.4f%%"
+           "  errors hdr %d sum %d len %d\n",
+           name, result->accepted, result->accepted / seconds,
+           result->accepted ? (double)result->cpu_ns / result->accepted : 0.0,
+           100.0 * result->false_accepts / (result->accepted + result->false_accepts + 1e-9),
+           100.0 * result->false_rejects / (stream->expected_count + 1e-9),
+           result->errors[1], result->errors[2], result->errors[4]);
+}
+
+static void test_mixed_stream(void)
+{
+    stream_t stream;
+    stream_build(&stream, 0x5003, false);
+    printf("mixed stream: %d valid, %d truncated, %d corrupted, %d junk runs, %zu bytes\n",
+           stream.cases[STREAM_VALID], stream.cases[STREAM_TRUNCATED], stream.cases[STREAM_CORRUPTED],
+           stream.cases[STREAM_JUNK], stream.len);
+
+    static const size_t chunks[] = {0, 1, 7, 64};
+    for (size_t i = 0; i < sizeof(chunks) / sizeof(chunks[0]); i++) {
+        parse_result_t result;
+        char name[32];
+        snprintf(name, sizeof(name), "mixed, chunk <= %zu", chunks[i]);
+        stream_parse(&stream, chunks[i], 0xC0FFEE + i, &result);
+        report(name, &stream, &result);
+        /*
+         * The additive checksum cannot catch everything: a frame cut one byte short and followed by the
+         * next header's 0x42 passes 1 time in 256, so a handful of false accepts are expected here
+         */
+        HOST_CHECK(result.false_accepts * 1000 < stream.expected_count);
+        HOST_CHECK(result.false_rejects == 0);
+        HOST_CHECK(result.accepted == stream.expected_count);
+        HOST_CHECK(result.errors[2] + result.errors[4] >= stream.cases[STREAM_CORRUPTED]);
+    }
+    stream_free(&stream);
+}
+
+static void test_back_to_back(void)
+{
+    stream_t stream;
+    stream_build(&stream, 0xA1F, true);
+
+    parse_result_t result;
+    stream_parse(&stream, 0, 0, &result);
+    report("back-to-back", &stream, &result);
+    HOST_CHECK(result.accepted == STREAM_EVENTS);
+    HOST_CHECK(result.false_rejects == 0);
+    HOST_CHECK(result.errors[1] + result.errors[2] + result.errors[4] == 0);
+    stream_free(&stream);
+}
+
+static void test_decode_errors(void)
+{
+    pms5003T_reading_t reading = {0};
+    uint8_t frame[PMS5003_FRAME_LEN];
+    pms5003_frame_encode(&reading, frame);
+    HOST_CHECK(pms5003_frame_decode(frame, &reading) == 0);
+
+    frame[1] = 0;
+    HOST_CHECK(pms5003_frame_decode(frame, &reading) == -1);
+    pms5003_frame_encode(&reading, frame);
+    frame[3]++;
+    HOST_CHECK(pms5003_frame_decode(frame, &reading) == -4);
+    pms5003_frame_encode(&reading, frame);
+    frame[PMS5003_FRAME_LEN - 1]++;
+    HOST_CHECK(pms5003_frame_decode(frame, &reading) == -2);
+}
+
+static void bench_decode(void)
+{
+    uint32_t rng = 0xBEEF;
+    uint8_t frame[PMS5003_FRAME_LEN];
+    pms5003T_reading_t reading;
+    random_reading(&rng, &reading);
+    pms5003_frame_encode(&reading, frame);
+
+    uint32_t sink = 0;
+    uint64_t start = host_test_cpu_ns();
+    for (int i = 0; i < BENCH_FRAMES; i++) {
+        frame[4] = i & 0x7F;
+        frame[PMS5003_FRAME_LEN - 1] = 0;
+        sink += pms5003_frame_decode(frame, &reading) + reading.standard.pm_1_0;
+    }
+    uint64_t cpu = host_test_cpu_ns() - start;
+    printf("decode only            %7d frames %9.0f frames/s %7.1f ns/frame (sink %u)\n",
+           BENCH_FRAMES, BENCH_FRAMES / (cpu / 1e9), (double)cpu / BENCH_FRAMES, sink);
+}
+
+int main(void)
+{
+    test_decode_errors();
+    test_back_to_back();
+    test_mixed_stream();
+    bench_decode();
+    return host_test_result();
+}
@@ -0,0 +1,181 @@
+/* Airgradient Outdoor Sensor V1.1 firmware using ESP-IDF
+ * Copyright (C) 2023 Zach Strauss
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "host_test.h"
+#include "pms5003_frame.h"
+#include "sdkconfig.h"
+
+/**
+ * Benchmark of whole-frame reads against the byte-by-byte read loop the driver used to have.
+ *
+ * Both readers pull the same back-to-back frame stream out of a file, one read() per uart_read_bytes call,
+ * so the syscall count and CPU time per frame compare the two read patterns directly.
+ */
+
+#define BENCH_FRAMES (100000)
+#define LEGACY_HEADER_SCAN_ATTEMPTS CONFIG_PMS5003_SOH_SCAN_LENGTH
+
+static int uart_fd;
+static unsigned long uart_reads;
+
+/**
+ * Stand-in for uart_read_bytes, one read() per call
+ */
+static int uart_read(uint8_t *buffer, size_t len)
+{
+    uart_reads++;
+    ssize_t ret = read(uart_fd, buffer, len);
+    return ret < 0 ? 0 : (int)ret;
+}
+
+/**
+ * The read loop from before frame-at-a-time parsing: one read per header byte, then 2 bytes per field
+ * @return 0 on success, -1 no header, -2 bad checksum, -3 short read
+ */
+static int legacy_read_measurement(pms5003T_reading_t *reading)
+{
+    uint8_t buffer[2];
+    uint16_t checksum = 0;
+    int attempts = 0;
+    while (attempts < LEGACY_HEADER_SCAN_ATTEMPTS) {
+        if (uart_read(buffer, 1) && buffer[0] == 0x42) {
+            checksum = 0x42;
+            break;
+        }
+        attempts++;
+    }
+    if (attempts >= LEGACY_HEADER_SCAN_ATTEMPTS) {
+        return -1;
+    }
+
+    if (!uart_read(buffer, 1) || buffer[0] != 0x4d) {
+        return -3;
+    }
+    checksum += 0x4d;
+    if (uart_read(buffer, 2) != 2) {
+        return -3;
+    }
+    checksum += buffer[0] + buffer[1];
+    int message_len = (buffer[0] << 8) | buffer[1];
+    uint16_t fields[PMS5003_FIELD_COUNT];
+    int field_index = 0;
+    while (message_len > 2) {
+        if (uart_read(buffer, 2)) {
+            checksum += buffer[0] + buffer[1];
+            if (field_index < PMS5003_FIELD_COUNT) {
+                fields[field_index] = (buffer[0] << 8) | buffer[1];
+            }
+            field_index++;
+        }
+        message_len -= 2;
+    }
+    if (uart_read(buffer, 2)) {
+        checksum -= buffer[0] << 8;
+        checksum -= buffer[1];
+    }
+    if (checksum != 0) {
+        return -2;
+    }
+    pms5003_reading_unpack(fields, reading);
+    return 0;
+}
+
+/**
+ * Whole-frame read, the way pms5003_read_available drives the parser
+ */
+static int frame_read_measurement(pms5003_frame_parser_t *parser, pms5003T_reading_t *reading)
+{
+    int ret;
+    do {
+        size_t space;
+        uint8_t *dest = pms5003_frame_parser_space(parser, &space);
+        int len = uart_read(dest, space);
+        if (len == 0) {
+            return -3;
+        }
+        ret = pms5003_frame_parser_commit(parser, len, reading);
+    } while (ret == PMS5003_FRAME_INCOMPLETE);
+    return ret;
+}
+
+typedef struct {
+    int frames;
+    unsigned long reads;
+    uint64_t cpu_ns;
+    uint32_t pm_sum;
+} bench_result_t;
+
+static void bench(bool legacy, bench_result_t *result)
+{
+    pms5003_frame_parser_t parser;
+    pms5003_frame_parser_reset(&parser);
+    lseek(uart_fd, 0, SEEK_SET);
+    uart_reads = 0;
+    memset(result, 0, sizeof(*result));
+
+    uint64_t start = host_test_cpu_ns();
+    for (int i = 0; i < BENCH_FRAMES; i++) {
+        pms5003T_reading_t reading;
+        int ret = legacy ? legacy_read_measurement(&reading) : frame_read_measurement(&parser, &reading);
+        if (ret == 0) {
+            result->frames++;
+            result->pm_sum += reading.standard.pm_2_5;
+        }
+    }
+    result->cpu_ns = host_test_cpu_ns() - start;
+    result->reads = uart_reads;
+    printf("%-12s %6d frames %5.1f reads/frame %7.0f ns CPU/frame\n", legacy ? "byte loop" : "whole frame",
+           result->frames, (double)result->reads / result->frames, (double)result->cpu_ns / result->frames);
+}
+
+int main(void)
+{
+    FILE *stream = tmpfile();
+    uint32_t rng = 0x1A2B;
+    uint32_t expected_sum = 0;
+    for (int i = 0; i < BENCH_FRAMES; i++) {
+        pms5003T_reading_t reading = {0};
+        reading.standard.pm_2_5 = host_test_random(&rng) & 0x3FF;
+        reading.raw_pm_0_3 = host_test_random(&rng) & 0xFFFF;
+        expected_sum += reading.standard.pm_2_5;
+        uint8_t frame[PMS5003_FRAME_LEN];
+        pms5003_frame_encode(&reading, frame);
+        fwrite(frame, 1, sizeof(frame), stream);
+    }
+    fflush(stream);
+    uart_fd = fileno(stream);
+
+    bench_result_t legacy, whole;
+    bench(true, &legacy);
+    bench(false, &whole);
+    printf("whole frame reads: %.1fx fewer reads, %.1fx less CPU per frame\n",
+           (double)legacy.reads / whole.reads, (double)legacy.cpu_ns / whole.cpu_ns);
+
+    HOST_CHECK(legacy.frames == BENCH_FRAMES);
+    HOST_CHECK(whole.frames == BENCH_FRAMES);
+    HOST_CHECK(legacy.pm_sum == expected_sum);
+    HOST_CHECK(whole.pm_sum == expected_sum);
+    HOST_CHECK(legacy.reads == 17ul * BENCH_FRAMES);
+    HOST_CHECK(whole.reads == BENCH_FRAMES);
+    HOST_CHECK(whole.cpu_ns < legacy.cpu_ns);
+
+    fclose(stream);
+    return host_test_result();
+}
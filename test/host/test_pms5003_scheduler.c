@@ -0,0 +1,245 @@
+/* Airgradient Outdoor Sensor V1.1 firmware using ESP-IDF
+ * Copyright (C) 2023 Zach Strauss
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+#include <math.h>
+#include <string.h>
+#include "host_test.h"
+#include "pms5003_scheduler.h"
+#include "sdkconfig.h"
+
+/**
+ * Trace simulation of the adaptive sleep time.
+ *
+ * Two staggered sensors run against 24 hours of clean air with a smoke event every 4 hours, once on the
+ * scheduler and once on the fixed grid the scheduler used before. Reports fan time and how long after each
+ * event starts a burst first sees it.
+ */
+
+#define SIM_SENSORS (2)
+#define SIM_HOURS (24)
+#define SIM_EVENT_INTERVAL (4 * 3600)
+#define SIM_EVENT_LENGTH (30 * 60)
+#define SIM_EVENT_COUNT (SIM_HOURS * 3600 / SIM_EVENT_INTERVAL)
+#define SIM_BURST_TIME CONFIG_PMS5003_MANAGER_READ_COUNT
+#define SIM_CLEAN_PM (8)
+#define SIM_SMOKE_PM (120)
+#define SIM_DETECT_PM (35)
+#define SIM_FIXED_CYCLE (CONFIG_PMS5003_MANAGER_SPINUP_TIME + CONFIG_PMS5003_MANAGER_SLEEP_TIME)
+
+static TickType_t sim_ticks;
+
+TickType_t xTaskGetTickCount(void)
+{
+    return sim_ticks;
+}
+
+/**
+ * A manager that takes a tick between registering and asking for its first wake still wakes at once, and a slot
+ * given back after a failed start leaves the next registration the same slot and cycle start
+ */
+static void test_first_wake(void)
+{
+    sim_ticks = 1000;
+    int slot = pms5003_scheduler_register();
+    HOST_CHECK(slot == 0);
+    HOST_CHECK(pms5003_scheduler_next_wake(slot, sim_ticks + 1) == sim_ticks + 1);
+    /* The second wake is back on the grid */
+    TickType_t cycle = pdMS_TO_TICKS((CONFIG_PMS5003_MANAGER_SPINUP_TIME + CONFIG_PMS5003_MANAGER_SLEEP_TIME) * 1000);
+    HOST_CHECK(pms5003_scheduler_next_wake(slot, sim_ticks + 2) == sim_ticks + cycle);
+
+    int failed = pms5003_scheduler_register();
+    HOST_CHECK(failed == 1);
+    pms5003_scheduler_release(slot);
+    pms5003_scheduler_release(failed);
+    HOST_CHECK(pms5003_scheduler_register() == 1);
+    pms5003_scheduler_release(1);
+    pms5003_scheduler_release(slot);
+    HOST_CHECK(pms5003_scheduler_register() == 0);
+    pms5003_scheduler_release(0);
+    sim_ticks = 0;
+}
+
+/**
+ * Start of smoke event index, offset a little further into the cycle each time
+ */
+static uint32_t event_start(int index)
+{
+    return 1800 + index * SIM_EVENT_INTERVAL + index * 37;
+}
+
+/**
+ * PM2.5 of the trace at a time in seconds: clean air with a little noise, smoke ramps up over two minutes
+ */
+static double trace_pm_2_5(uint32_t t, uint32_t *rng)
+{
+    double pm = SIM_CLEAN_PM + (host_test_random(rng) % 5) / 2.0 - 1.0;
+    for (int event = 0; event < SIM_EVENT_COUNT; event++) {
+        uint32_t start = event_start(event);
+        if (t >= start && t < start + SIM_EVENT_LENGTH) {
+            double ramp = (t - start) / 120.0;
+            pm += (SIM_SMOKE_PM - SIM_CLEAN_PM) * (ramp < 1 ? ramp : 1);
+        }
+    }
+    return pm;
+}
+
+typedef struct {
+    uint32_t fan_s; /*!< fan on time over every sensor */
+    uint32_t bursts;
+    uint32_t latency[SIM_EVENT_COUNT]; /*!< seconds from each event start to the end of the first burst seeing it */
+} sim_result_t;
+
+/**
+ * Take a burst of one reading a second at the end of spin-up
+ * @return mean PM2.5 of the burst
+ */
+static uint16_t sim_burst(uint32_t burst_start, uint32_t *rng, uint16_t *stddev)
+{
+    double sum = 0, sum_squares = 0;
+    for (int i = 0; i < SIM_BURST_TIME; i++) {
+        double pm = trace_pm_2_5(burst_start + i, rng);
+        sum += pm;
+        sum_squares += pm * pm;
+    }
+    double mean = sum / SIM_BURST_TIME;
+    double variance = sum_squares / SIM_BURST_TIME - mean * mean;
+    *stddev = (uint16_t)sqrt(variance > 0 ? variance : 0);
+    return (uint16_t)(mean + 0.5);
+}
+
+static void sim_detect(uint32_t burst_end, uint16_t pm_2_5, sim_result_t *result)
+{
+    if (pm_2_5 < SIM_DETECT_PM) {
+        return;
+    }
+    for (int event = 0; event < SIM_EVENT_COUNT; event++) {
+        uint32_t start = event_start(event);
+        if (burst_end >= start && burst_end < start + SIM_EVENT_LENGTH && !result->latency[event]) {
+            result->latency[event] = burst_end - start;
+        }
+    }
+}
+
+/**
+ * Run both sensors on the scheduler, waking the one due first each time
+ */
+static void sim_adaptive(sim_result_t *result)
+{
+    int slots[SIM_SENSORS];
+    TickType_t wake[SIM_SENSORS];
+    uint32_t rng = 0x013;
+    memset(result, 0, sizeof(*result));
+
+    sim_ticks = 0;
+    for (int sensor = 0; sensor < SIM_SENSORS; sensor++) {
+        slots[sensor] = pms5003_scheduler_register();
+    }
+    for (int sensor = 0; sensor < SIM_SENSORS; sensor++) {
+        wake[sensor] = pms5003_scheduler_next_wake(slots[sensor], 0);
+    }
+    HOST_CHECK(pms5003_scheduler_slot_spacing() ==
+               (CONFIG_PMS5003_MANAGER_SPINUP_TIME + CONFIG_PMS5003_MANAGER_SLEEP_TIME) / SIM_SENSORS);
+
+    while (true) {
+        int sensor = wake[0] <= wake[1] ? 0 : 1;
+        uint32_t start = wake[sensor] / configTICK_RATE_HZ;
+        if (start >= SIM_HOURS * 3600) {
+            break;
+        }
+        pms5003_scheduler_fan(slots[sensor], true, wake[sensor]);
+        uint32_t burst_start = start + CONFIG_PMS5003_MANAGER_SPINUP_TIME;
+        uint32_t end = burst_start + SIM_BURST_TIME;
+
+        uint16_t stddev;
+        uint16_t pm_2_5 = sim_burst(burst_start, &rng, &stddev);
+        sim_detect(end, pm_2_5, result);
+        result->bursts++;
+
+        TickType_t now = pdMS_TO_TICKS(end * 1000);
+        pms5003_scheduler_decision_t decision;
+        pms5003_scheduler_report(slots[sensor], pm_2_5, stddev, &decision);
+        pms5003_scheduler_fan(slots[sensor], false, now);
+        wake[sensor] = pms5003_scheduler_next_wake(slots[sensor], now);
+    }
+
+    pms5003_scheduler_fan_stats_t stats;
+    pms5003_scheduler_take_fan_stats(pdMS_TO_TICKS(SIM_HOURS * 3600 * 1000), &stats);
+    result->fan_s = stats.fan_on_ms / 1000;
+    HOST_CHECK(stats.max_fans_on == 1);
+}
+
+/**
+ * Run both sensors on the fixed grid of spin-up plus sleep time, half a cycle apart
+ */
+static void sim_fixed(sim_result_t *result)
+{
+    uint32_t rng = 0x013;
+    memset(result, 0, sizeof(*result));
+    for (uint32_t cycle_start = 0; cycle_start < SIM_HOURS * 3600; cycle_start += SIM_FIXED_CYCLE) {
+        for (int sensor = 0; sensor < SIM_SENSORS; sensor++) {
+            uint32_t start = cycle_start + SIM_FIXED_CYCLE / SIM_SENSORS * sensor;
+            uint32_t burst_start = start + CONFIG_PMS5003_MANAGER_SPINUP_TIME;
+            uint16_t stddev;
+            uint16_t pm_2_5 = sim_burst(burst_start, &rng, &stddev);
+            sim_detect(burst_start + SIM_BURST_TIME, pm_2_5, result);
+            result->bursts++;
+            result->fan_s += CONFIG_PMS5003_MANAGER_SPINUP_TIME + SIM_BURST_TIME;
+        }
+    }
+}
+
+/**
+ * Print a run and get its detection latencies
+ * @return mean detection latency in seconds
+ */
+static uint32_t report(const char *name, const sim_result_t *result, uint32_t *worst)
+{
+    uint32_t sum = 0;
+    *worst = 0;
+    for (int event = 0; event < SIM_EVENT_COUNT; event++) {
+        HOST_CHECK(result->latency[event] > 0);
+        sum += result->latency[event];
+        *worst = result->latency[event] > *worst ? result->latency[event] : *worst;
+    }
+    printf("%-9s %5u bursts, fan %5.2f h, detection latency mean %3u s worst %3u s\n", name, result->bursts,
+           result->fan_s / 3600.0, sum / SIM_EVENT_COUNT, *worst);
+    return sum / SIM_EVENT_COUNT;
+}
+
+int main(void)
+{
+    static sim_result_t fixed, adaptive;
+    uint32_t fixed_worst, adaptive_worst;
+    test_first_wake();
+    sim_fixed(&fixed);
+    sim_adaptive(&adaptive);
+    uint32_t fixed_mean = report("fixed", &fixed, &fixed_worst);
+    uint32_t adaptive_mean = report("adaptive", &adaptive, &adaptive_worst);
+    printf("adaptive: %.2f fan hours saved per day (%d%%), min sleep %d s, max sleep %d s\n",
+           ((int32_t)fixed.fan_s - (int32_t)adaptive.fan_s) / 3600.0,
+           (int)(100 - 100 * (uint64_t)adaptive.fan_s / fixed.fan_s), CONFIG_PMS5003_ADAPTIVE_MIN_SLEEP,
+           CONFIG_PMS5003_ADAPTIVE_MAX_SLEEP);
+
+    /*
+     * The default maximum trades fan time against detection latency, see PMS5003_ADAPTIVE_MAX_SLEEP: it has to
+     * save fan time without detecting smoke much later than the fixed cycle
+     */
+    HOST_CHECK(adaptive.fan_s * 5 < fixed.fan_s * 4);
+    HOST_CHECK(adaptive_mean * 4 <= fixed_mean * 5);
+    HOST_CHECK(adaptive_worst <= (CONFIG_PMS5003_MANAGER_SPINUP_TIME + CONFIG_PMS5003_ADAPTIVE_MAX_SLEEP) /
+                                 SIM_SENSORS + CONFIG_PMS5003_MANAGER_SPINUP_TIME + SIM_BURST_TIME + 120);
+    return host_test_result();
+}
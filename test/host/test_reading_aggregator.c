@@ -0,0 +1,213 @@
+/* Airgradient Outdoor Sensor V1.1 firmware using ESP-IDF
+ * Copyright (C) 2023 Zach Strauss
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+#include <math.h>
+#include <string.h>
+#include "host_test.h"
+#include "reading_aggregator.h"
+
+/**
+ * Aggregator tests with saturated and extreme field values, where 16 bit sums used to wrap
+ */
+
+static const uint32_t window_lengths[READING_WINDOW_COUNT] = {60, 900, 3600};
+
+static void fill_reading(uint16_t value, pms5003T_reading_t *reading)
+{
+    uint16_t fields[PMS5003_FIELD_COUNT];
+    for (int i = 0; i < PMS5003_FIELD_COUNT; i++) {
+        fields[i] = value;
+    }
+    memset(reading, 0, sizeof(*reading));
+    pms5003_reading_unpack(fields, reading);
+}
+
+/**
+ * @return true if every packed field of reading equals value
+ */
+static bool all_fields(const pms5003T_reading_t *reading, uint16_t value)
+{
+    uint16_t fields[PMS5003_FIELD_COUNT];
+    pms5003_reading_pack(reading, fields);
+    for (int i = 0; i < PMS5003_FIELD_COUNT; i++) {
+        if (fields[i] != value) {
+            return false;
+        }
+    }
+    return true;
+}
+
+static void test_saturated_burst(void)
+{
+    static reading_aggregator_t aggregator;
+    reading_aggregator_init(&aggregator, window_lengths);
+
+    pms5003T_reading_t reading;
+    fill_reading(0xFFFF, &reading);
+    for (int i = 0; i < 10; i++) {
+        reading_aggregator_add(&aggregator, &reading, i);
+    }
+    reading_summary_t summary;
+    reading_aggregator_burst_summary(&aggregator, &summary);
+    HOST_CHECK(summary.window == 0);
+    HOST_CHECK(summary.count == 10);
+    HOST_CHECK(summary.mean.raw_pm_0_3 == 0xFFFF);
+    HOST_CHECK(summary.mean.standard.pm_10_0 == 0xFFFF);
+    HOST_CHECK(summary.min.raw_pm_0_3 == 0xFFFF);
+    HOST_CHECK(summary.max.raw_pm_0_3 == 0xFFFF);
+    HOST_CHECK(summary.stddev.raw_pm_0_3 == 0);
+    /* 0xFFFF is -1 as a temperature, it must not be averaged as 65535 */
+    HOST_CHECK(summary.mean.temperature == -1);
+
+    reading_aggregator_burst_reset(&aggregator);
+    reading_aggregator_burst_summary(&aggregator, &summary);
+    HOST_CHECK(summary.count == 0);
+    HOST_CHECK(all_fields(&summary.mean, 0));
+}
+
+static void test_heavy_smoke_counts(void)
+{
+    static reading_aggregator_t aggregator;
+    reading_aggregator_init(&aggregator, window_lengths);
+
+    /* Ten counts above 6553 wrapped a 16 bit sum */
+    pms5003T_reading_t reading;
+    fill_reading(0, &reading);
+    uint32_t sum = 0;
+    for (int i = 0; i < 10; i++) {
+        reading.raw_pm_0_3 = 6554 + i * 5000;
+        sum += reading.raw_pm_0_3;
+        reading_aggregator_add(&aggregator, &reading, 0);
+    }
+    reading_summary_t summary;
+    reading_aggregator_burst_summary(&aggregator, &summary);
+    HOST_CHECK(summary.mean.raw_pm_0_3 == (sum + 5) / 10);
+    HOST_CHECK(summary.min.raw_pm_0_3 == 6554);
+    HOST_CHECK(summary.max.raw_pm_0_3 == 6554 + 9 * 5000);
+    HOST_CHECK((uint16_t)sum / 10 != summary.mean.raw_pm_0_3);
+}
+
+static void test_alternating_extremes(int count)
+{
+    static reading_aggregator_t aggregator;
+    reading_aggregator_init(&aggregator, window_lengths);
+
+    pms5003T_reading_t low, high;
+    fill_reading(0, &low);
+    fill_reading(0xFFFF, &high);
+    low.temperature = INT16_MIN;
+    high.temperature = INT16_MAX;
+    for (int i = 0; i < count; i++) {
+        reading_aggregator_add(&aggregator, i % 2 ? &high : &low, 0);
+    }
+
+    reading_summary_t summary;
+    reading_aggregator_burst_summary(&aggregator, &summary);
+    printf("%d alternating readings: mean %u stddev %u, temperature mean %d stddev %u\n", count,
+           summary.mean.raw_pm_0_3, summary.stddev.raw_pm_0_3, summary.mean.temperature, summary.stddev.temperature);
+    HOST_CHECK(summary.count == (uint32_t)count);
+    HOST_CHECK(summary.mean.raw_pm_0_3 == 32768);
+    HOST_CHECK(summary.min.raw_pm_0_3 == 0);
+    HOST_CHECK(summary.max.raw_pm_0_3 == 0xFFFF);
+    /* The exact deviation is 32767.5, past 65537 readings the variance may be one unit short */
+    HOST_CHECK(summary.stddev.raw_pm_0_3 == 32767);
+    HOST_CHECK(summary.mean.temperature == -1 || summary.mean.temperature == 0);
+    HOST_CHECK(summary.min.temperature == INT16_MIN);
+    HOST_CHECK(summary.max.temperature == INT16_MAX);
+    HOST_CHECK(summary.stddev.temperature == 32767);
+}
+
+/**
+ * Particle counts in the thousands against a floating point reference, up to counts where the variance can no
+ * longer be formed from exact sums: around 74000 readings for values near 57000, a million near 4000
+ */
+static void test_long_window_deviation(int count)
+{
+    static reading_aggregator_t aggregator;
+    reading_aggregator_init(&aggregator, window_lengths);
+
+    pms5003T_reading_t reading;
+    fill_reading(0, &reading);
+    uint32_t rng = 0xA66;
+    double sum = 0;
+    double sum_squares = 0;
+    for (int i = 0; i < count; i++) {
+        reading.raw_pm_0_3 = 3000 + host_test_random(&rng) % 2001;
+        reading.raw_pm_2_5 = 55000 + host_test_random(&rng) % 5001;
+        /* Mean 60000.9, where truncating the mean first made up a deviation of about 330 */
+        reading.raw_pm_1_0 = i % 10 ? 60001 : 60000;
+        sum += reading.raw_pm_0_3;
+        sum_squares += (double)reading.raw_pm_0_3 * reading.raw_pm_0_3;
+        reading_aggregator_add(&aggregator, &reading, 0);
+    }
+    double mean = sum / count;
+    double reference = sqrt(sum_squares / count - mean * mean);
+
+    reading_summary_t summary;
+    reading_aggregator_burst_summary(&aggregator, &summary);
+    printf("%d readings: around 4000 mean %u stddev %u, reference mean %.2f stddev %.2f; "
+           "around 57500 stddev %u; 60000.9 stddev %u\n", count, summary.mean.raw_pm_0_3, summary.stddev.raw_pm_0_3,
+           mean, reference, summary.stddev.raw_pm_2_5, summary.stddev.raw_pm_1_0);
+    HOST_CHECK(summary.mean.raw_pm_0_3 == (uint16_t)lround(mean));
+    /* The integer square root rounds down */
+    HOST_CHECK(fabs(summary.stddev.raw_pm_0_3 - reference) < 1.0);
+    /* Uniform over 5000 counts, the deviation is about 5000 / sqrt(12) */
+    HOST_CHECK(fabs(summary.stddev.raw_pm_2_5 - 5000 / sqrt(12)) < 10);
+    HOST_CHECK(summary.stddev.raw_pm_1_0 == 0);
+}
+
+static void test_rolling_windows(void)
+{
+    static reading_aggregator_t aggregator;
+    reading_aggregator_init(&aggregator, window_lengths);
+
+    pms5003T_reading_t old_reading, new_reading;
+    fill_reading(0xFFFF, &old_reading);
+    fill_reading(1000, &new_reading);
+    for (int i = 0; i < 100; i++) {
+        reading_aggregator_add(&aggregator, &old_reading, i % 10);
+    }
+    reading_aggregator_add(&aggregator, &new_reading, 100);
+
+    reading_summary_t summary;
+    reading_aggregator_window_summary(&aggregator, READING_WINDOW_SHORT, 100, &summary);
+    HOST_CHECK(summary.window == 60);
+    HOST_CHECK(summary.count == 1);
+    HOST_CHECK(all_fields(&summary.mean, 1000));
+
+    reading_aggregator_window_summary(&aggregator, READING_WINDOW_MEDIUM, 100, &summary);
+    HOST_CHECK(summary.count == 101);
+    HOST_CHECK(summary.max.raw_pm_0_3 == 0xFFFF);
+    HOST_CHECK(summary.min.raw_pm_0_3 == 1000);
+    HOST_CHECK(summary.mean.raw_pm_0_3 == (100 * 65535 + 1000 + 50) / 101);
+
+    reading_aggregator_window_summary(&aggregator, READING_WINDOW_LONG, 3700, &summary);
+    HOST_CHECK(summary.count == 0);
+}
+
+int main(void)
+{
+    test_saturated_burst();
+    test_heavy_smoke_counts();
+    test_alternating_extremes(10);
+    test_alternating_extremes(200000);
+    test_long_window_deviation(1000);
+    test_long_window_deviation(70000);
+    test_long_window_deviation(300000);
+    test_long_window_deviation(1200000);
+    test_rolling_windows();
+    return host_test_result();
+}
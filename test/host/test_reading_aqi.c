@@ -0,0 +1,127 @@
+/* Airgradient Outdoor Sensor V1.1 firmware using ESP-IDF
+ * Copyright (C) 2023 Zach Strauss
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+#include <stdlib.h>
+#include "host_test.h"
+#include "reading_aqi.h"
+
+/**
+ * Checks of the humidity correction and AQI against reference points worked out from the US EPA formulas
+ */
+
+typedef struct {
+    uint16_t pm_2_5; /*!< tenths of a ug/m3 */
+    uint16_t aqi;
+} aqi_point_t;
+
+/* 2024 PM2.5 breakpoints: both ends of every category, and points inside worked out by hand */
+static const aqi_point_t aqi_points[] = {
+        {0, 0}, {90, 50},
+        {91, 51}, {120, 56}, {350, 99}, {354, 100},
+        {355, 101}, {550, 149}, {554, 150},
+        {555, 151}, {1254, 200},
+        {1255, 201}, {2254, 300},
+        {2255, 301}, {2755, 401}, {3254, 500},
+        {3255, 500}, {UINT16_MAX, 500},
+};
+
+typedef struct {
+    uint16_t pm_2_5_cf1; /*!< ug/m3 */
+    uint16_t humidity; /*!< tenths of a percent */
+    uint16_t corrected; /*!< tenths of a ug/m3 */
+} correction_point_t;
+
+/* One point per segment of the extended 2023 PurpleAir correction, worked out in floating point */
+static const correction_point_t correction_points[] = {
+        {0, 1000, 0}, /* 5.75 - 8.62 clamps to 0 */
+        {20, 500, 119}, /* 0.524 * 20 - 0.0862 * 50 + 5.75 = 11.92 */
+        {40, 500, 276}, /* (0.786 * 0.5 + 0.524 * 0.5) * 40 - 4.31 + 5.75 = 27.64 */
+        {100, 400, 809}, /* 0.786 * 100 - 3.448 + 5.75 = 80.902 */
+        {235, 300, 2009}, /* halfway through the blend into the smoke fit, 200.904 */
+        {300, 500, 2895}, /* 2.966 + 0.69 * 300 + 8.84e-4 * 300^2 = 289.526 */
+};
+
+static void test_aqi_breakpoints(void)
+{
+    for (size_t i = 0; i < sizeof(aqi_points) / sizeof(aqi_points[0]); i++) {
+        uint16_t aqi = reading_aqi_from_pm_2_5(aqi_points[i].pm_2_5);
+        if (aqi != aqi_points[i].aqi) {
+            printf("PM2.5 %u.%u: AQI %u, expected %u\n", aqi_points[i].pm_2_5 / 10, aqi_points[i].pm_2_5 % 10, aqi,
+                   aqi_points[i].aqi);
+        }
+        HOST_CHECK(aqi == aqi_points[i].aqi);
+    }
+
+    uint16_t previous = 0;
+    for (uint32_t pm_2_5 = 0; pm_2_5 <= 5000; pm_2_5++) {
+        uint16_t aqi = reading_aqi_from_pm_2_5(pm_2_5);
+        HOST_CHECK(aqi >= previous);
+        previous = aqi;
+    }
+}
+
+static void test_correction(void)
+{
+    for (size_t i = 0; i < sizeof(correction_points) / sizeof(correction_points[0]); i++) {
+        const correction_point_t *point = &correction_points[i];
+        uint16_t corrected = reading_aqi_correct_pm_2_5(point->pm_2_5_cf1, point->humidity);
+        if (corrected != point->corrected) {
+            printf("CF1 %u at RH %u: %u, expected %u\n", point->pm_2_5_cf1, point->humidity, corrected,
+                   point->corrected);
+        }
+        HOST_CHECK(corrected == point->corrected);
+    }
+
+    /* The fit is continuous where its segments meet, a 1 ug/m3 step across a join moves it by under 2 ug/m3 */
+    static const uint16_t joins[] = {30, 50, 210, 260};
+    for (size_t i = 0; i < sizeof(joins) / sizeof(joins[0]); i++) {
+        for (uint16_t humidity = 0; humidity <= 1000; humidity += 250) {
+            int below = reading_aqi_correct_pm_2_5(joins[i] - 1, humidity);
+            int at = reading_aqi_correct_pm_2_5(joins[i], humidity);
+            HOST_CHECK(at >= below);
+            HOST_CHECK(at - below < 20);
+        }
+    }
+
+    HOST_CHECK(reading_aqi_correct_pm_2_5(UINT16_MAX, 0) == UINT16_MAX);
+}
+
+static void test_logged_reading_matches_live(void)
+{
+    pms5003T_reading_t live = {0};
+    live.standard.pm_2_5 = 100;
+    live.humidity = 400;
+    reading_aqi_derive(&live);
+    HOST_CHECK(live.pm_2_5_corrected == 809);
+    HOST_CHECK(live.aqi == reading_aqi_from_pm_2_5(809));
+
+    /* The reading log keeps only the packed sensor fields */
+    uint16_t fields[PMS5003_FIELD_COUNT];
+    pms5003T_reading_t logged = {0};
+    pms5003_reading_pack(&live, fields);
+    pms5003_reading_unpack(fields, &logged);
+    reading_aqi_derive(&logged);
+    HOST_CHECK(logged.pm_2_5_corrected == live.pm_2_5_corrected);
+    HOST_CHECK(logged.aqi == live.aqi);
+}
+
+int main(void)
+{
+    test_aqi_breakpoints();
+    test_correction();
+    test_logged_reading_matches_live();
+    return host_test_result();
+}
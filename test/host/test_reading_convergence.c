@@ -0,0 +1,160 @@
+/* Airgradient Outdoor Sensor V1.1 firmware using ESP-IDF
+ * Copyright (C) 2023 Zach Strauss
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+#include "host_test.h"
+#include "reading_convergence.h"
+#include "sdkconfig.h"
+
+/**
+ * Warm-up replay tests for adaptive spin-up.
+ *
+ * Replays warm-up curves through the same sampling the manager does: nothing before the minimum spin-up time,
+ * then a reading every sample interval until the readings converge or the full spin-up time has passed.
+ * The curves follow a fan coming up to speed, counts rising from about a third of the true value with a time
+ * constant set by the fan, plus measurement noise.
+ */
+
+#define SPINUP_MAX_MS (CONFIG_PMS5003_MANAGER_SPINUP_TIME * 1000)
+#define SPINUP_MIN_MS (CONFIG_PMS5003_SPINUP_MIN_TIME * 1000)
+
+typedef struct {
+    const char *name;
+    uint16_t pm_2_5; /*!< settled PM2.5 */
+    uint16_t raw_pm_0_3; /*!< settled 0.3um count */
+    double counts_tau; /*!< time constant of the 0.3um count in s */
+    double pm_tau; /*!< time constant of PM2.5 in s */
+    int noise_percent; /*!< peak measurement noise */
+    bool settles; /*!< whether the burst should mostly start before the full spin-up time */
+} warmup_curve_t;
+
+static const warmup_curve_t curves[] = {
+        {"clean air, new fan", 6, 900, 2.0, 2.0, 1, true},
+        {"urban, typical fan", 40, 6000, 4.0, 5.0, 2, true},
+        {"pm2.5 settles last", 25, 4000, 2.0, 7.0, 1, true},
+        {"smoke, worn fan", 180, 30000, 12.0, 14.0, 2, false},
+        {"gusty, never settles", 30, 5000, 3.0, 3.0, 15, false},
+};
+
+static uint16_t curve_value(uint16_t settled, double tau, int noise_percent, double t, uint32_t *rng)
+{
+    double value = settled * (1.0 - 0.7 * exp(-t / tau));
+    double noise = ((int)(host_test_random(rng) % (2 * noise_percent + 1)) - noise_percent) / 100.0;
+    return (uint16_t)(value * (1.0 + noise) + 0.5);
+}
+
+typedef struct {
+    uint32_t burst_at; /*!< ms after wake the burst starts */
+    bool settled; /*!< whether convergence started it rather than the full spin-up time */
+    uint16_t pm_2_5; /*!< PM2.5 of the first burst reading */
+} warmup_result_t;
+
+static void replay(const warmup_curve_t *curve, uint32_t seed, warmup_result_t *result)
+{
+    reading_convergence_t convergence;
+    reading_convergence_init(&convergence, CONFIG_PMS5003_SPINUP_TOLERANCE, CONFIG_PMS5003_SPINUP_STABLE_COUNT);
+    uint32_t rng = seed;
+
+    for (uint32_t now = SPINUP_MIN_MS;; now += CONFIG_PMS5003_SPINUP_SAMPLE_INTERVAL) {
+        if (now >= SPINUP_MAX_MS) {
+            result->burst_at = now;
+            result->settled = false;
+            break;
+        }
+        pms5003T_reading_t reading = {0};
+        reading.atmospheric.pm_2_5 = curve_value(curve->pm_2_5, curve->pm_tau, curve->noise_percent, now / 1000.0, &rng);
+        reading.raw_pm_0_3 = curve_value(curve->raw_pm_0_3, curve->counts_tau, curve->noise_percent, now / 1000.0,
+                                         &rng);
+        if (reading_convergence_add(&convergence, &reading)) {
+            result->burst_at = now;
+            result->settled = true;
+            break;
+        }
+    }
+    result->pm_2_5 = curve_value(curve->pm_2_5, curve->pm_tau, 0, result->burst_at / 1000.0, &rng);
+}
+
+static void test_warmup_curves(void)
+{
+    uint64_t spinup_ms = 0;
+    int runs = 0;
+    for (size_t i = 0; i < sizeof(curves) / sizeof(curves[0]); i++) {
+        const warmup_curve_t *curve = &curves[i];
+        uint32_t earliest = UINT32_MAX, latest = 0;
+        int settled = 0;
+        for (uint32_t seed = 1; seed <= 50; seed++) {
+            warmup_result_t result;
+            replay(curve, seed * 7919, &result);
+            spinup_ms += result.burst_at;
+            runs++;
+            earliest = result.burst_at < earliest ? result.burst_at : earliest;
+            latest = result.burst_at > latest ? result.burst_at : latest;
+            settled += result.settled;
+
+            HOST_CHECK(result.burst_at >= SPINUP_MIN_MS);
+            HOST_CHECK(result.burst_at <= SPINUP_MAX_MS + CONFIG_PMS5003_SPINUP_SAMPLE_INTERVAL);
+            /* Starting early must not publish a reading still on its way up */
+            if (result.settled) {
+                HOST_CHECK(abs((int)result.pm_2_5 - curve->pm_2_5) * 100 <= curve->pm_2_5 * 10 + 200);
+            }
+        }
+        printf("%-22s burst after %5.1f to %5.1f s, settled %2d of 50\n", curve->name, earliest / 1000.0,
+               latest / 1000.0, settled);
+        /* Noise can hold a settling curve off until the full spin-up time now and then */
+        if (curve->settles) {
+            HOST_CHECK(settled >= 45);
+        } else {
+            HOST_CHECK(settled < 5);
+        }
+    }
+    printf("mean spin-up %.1f s against %d s fixed\n", spinup_ms / 1000.0 / runs, CONFIG_PMS5003_MANAGER_SPINUP_TIME);
+}
+
+static void test_floor_and_reset(void)
+{
+    reading_convergence_t convergence;
+    reading_convergence_init(&convergence, 5, 2);
+    pms5003T_reading_t reading = {0};
+
+    /* Near-zero readings jump by large ratios on noise alone */
+    reading.atmospheric.pm_2_5 = 1;
+    reading.raw_pm_0_3 = 20;
+    HOST_CHECK(!reading_convergence_add(&convergence, &reading));
+    reading.atmospheric.pm_2_5 = 3;
+    reading.raw_pm_0_3 = 45;
+    HOST_CHECK(!reading_convergence_add(&convergence, &reading));
+    reading.atmospheric.pm_2_5 = 2;
+    HOST_CHECK(reading_convergence_add(&convergence, &reading));
+
+    /* One unsettled reading restarts the count */
+    reading_convergence_init(&convergence, 5, 2);
+    reading.raw_pm_0_3 = 1000;
+    reading_convergence_add(&convergence, &reading);
+    reading_convergence_add(&convergence, &reading);
+    reading.raw_pm_0_3 = 1200;
+    HOST_CHECK(!reading_convergence_add(&convergence, &reading));
+    HOST_CHECK(!reading_convergence_add(&convergence, &reading));
+    HOST_CHECK(reading_convergence_add(&convergence, &reading));
+}
+
+int main(void)
+{
+    test_warmup_curves();
+    test_floor_and_reset();
+    return host_test_result();
+}
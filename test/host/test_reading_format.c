@@ -0,0 +1,178 @@
+/* Airgradient Outdoor Sensor V1.1 firmware using ESP-IDF
+ * Copyright (C) 2023 Zach Strauss
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include "host_test.h"
+#include "reading_format.h"
+
+/**
+ * Compares reading_format_tenths() with the float printf it replaced: output, CPU time and stack use.
+ *
+ * Stack use is measured by running each formatter on a thread whose stack is a painted buffer and
+ * counting the bytes it overwrote, less what an idle thread overwrites. glibc is not newlib, so the
+ * figures show the direction and rough size of the difference rather than the ESP32-C3 numbers.
+ */
+
+#define BENCH_VALUES (300000)
+#define STACK_SIZE (256 * 1024)
+#define STACK_PAINT (0xA5)
+
+typedef int (*formatter_t)(char *buffer, int32_t tenths);
+
+static int format_idle(char *buffer, int32_t tenths)
+{
+    buffer[0] = '\0';
+    return 0;
+}
+
+static int format_integer(char *buffer, int32_t tenths)
+{
+    return reading_format_tenths(buffer, tenths);
+}
+
+/* What the per-topic layout published before, "21.500000" */
+static int format_float(char *buffer, int32_t tenths)
+{
+    return snprintf(buffer, READING_FORMAT_TENTHS_MAX_LEN + 1 + 6, "%f", tenths / 10.0);
+}
+
+static int format_float_one_decimal(char *buffer, int32_t tenths)
+{
+    return snprintf(buffer, READING_FORMAT_TENTHS_MAX_LEN + 1, "%.1f", tenths / 10.0);
+}
+
+static const struct {
+    const char *name;
+    formatter_t format;
+} formatters[] = {
+        {"reading_format_tenths", format_integer},
+        {"snprintf %f", format_float},
+        {"snprintf %.1f", format_float_one_decimal},
+};
+#define FORMATTER_COUNT (sizeof(formatters) / sizeof(formatters[0]))
+
+static void *stack_probe(void *arg)
+{
+    formatter_t format = (formatter_t)arg;
+    char buffer[32];
+    /* Temperature, humidity and a large value, through a volatile pointer so the call is not folded */
+    formatter_t volatile call = format;
+    call(buffer, -53);
+    call(buffer, 998);
+    call(buffer, INT32_MIN);
+    return NULL;
+}
+
+/**
+ * @param format formatter to run
+ * @return bytes of the thread stack the formatter wrote to, -1 if the thread could not run
+ */
+static long stack_used(formatter_t format)
+{
+    uint8_t *stack = aligned_alloc(4096, STACK_SIZE);
+    memset(stack, STACK_PAINT, STACK_SIZE);
+
+    pthread_attr_t attr;
+    pthread_t thread;
+    pthread_attr_init(&attr);
+    pthread_attr_setstack(&attr, stack, STACK_SIZE);
+    long used = -1;
+    if (pthread_create(&thread, &attr, stack_probe, (void *)format) == 0) {
+        pthread_join(thread, NULL);
+        /* The stack grows down, the lowest overwritten byte marks the deepest call */
+        size_t untouched = 0;
+        while (untouched < STACK_SIZE && stack[untouched] == STACK_PAINT) {
+            untouched++;
+        }
+        used = STACK_SIZE - untouched;
+    }
+    pthread_attr_destroy(&attr);
+    free(stack);
+    return used;
+}
+
+static void test_matches_printf(void)
+{
+    static const int32_t edges[] = {0, 1, -1, 9, -9, 10, -10, 99, -99, 100, -100, 1000000, INT32_MAX, INT32_MIN};
+    char expected[32];
+    char actual[32];
+
+    for (int32_t tenths = -2000; tenths <= 20000; tenths++) {
+        snprintf(expected, sizeof(expected), "%.1f", tenths / 10.0);
+        int len = reading_format_tenths(actual, tenths);
+        HOST_CHECK(strcmp(actual, expected) == 0);
+        HOST_CHECK(len == (int)strlen(expected));
+    }
+    for (size_t i = 0; i < sizeof(edges) / sizeof(edges[0]); i++) {
+        snprintf(expected, sizeof(expected), "%.1f", edges[i] / 10.0);
+        int len = reading_format_tenths(actual, edges[i]);
+        if (strcmp(actual, expected) != 0) {
+            printf("%ld: \"%s\", expected \"%s\"\n", (long)edges[i], actual, expected);
+        }
+        HOST_CHECK(strcmp(actual, expected) == 0);
+        HOST_CHECK(len <= READING_FORMAT_TENTHS_MAX_LEN);
+    }
+
+    static const uint32_t counts[] = {0, 7, 10, 65535, UINT32_MAX};
+    for (size_t i = 0; i < sizeof(counts) / sizeof(counts[0]); i++) {
+        snprintf(expected, sizeof(expected), "%lu", (unsigned long)counts[i]);
+        int len = reading_format_uint(actual, counts[i]);
+        HOST_CHECK(strcmp(actual, expected) == 0);
+        HOST_CHECK(len <= READING_FORMAT_UINT_MAX_LEN);
+    }
+}
+
+static void bench_formatters(void)
+{
+    long idle = stack_used(format_idle);
+    uint64_t best_ns[FORMATTER_COUNT];
+    long stack[FORMATTER_COUNT];
+
+    for (size_t f = 0; f < FORMATTER_COUNT; f++) {
+        char buffer[32];
+        uint32_t sink = 0;
+        best_ns[f] = UINT64_MAX;
+        for (int run = 0; run < 5; run++) {
+            uint32_t rng = 0x7E57;
+            uint64_t start = host_test_cpu_ns();
+            for (int i = 0; i < BENCH_VALUES; i++) {
+                /* Temperatures and humidities in tenths, -40.0 to 100.0 */
+                int32_t tenths = (int32_t)(host_test_random(&rng) % 1401) - 400;
+                sink += formatters[f].format(buffer, tenths);
+            }
+            uint64_t cpu = host_test_cpu_ns() - start;
+            best_ns[f] = cpu < best_ns[f] ? cpu : best_ns[f];
+        }
+        stack[f] = stack_used(formatters[f].format);
+        printf("%-22s %6.1f ns/value %6ld bytes of stack (sink %u)\n", formatters[f].name,
+               (double)best_ns[f] / BENCH_VALUES, stack[f] - idle, sink);
+    }
+
+    /* The integer path must beat both float printf variants on time and stack */
+    for (size_t f = 1; f < FORMATTER_COUNT; f++) {
+        HOST_CHECK(best_ns[0] < best_ns[f]);
+        HOST_CHECK(stack[0] < stack[f]);
+    }
+}
+
+int main(void)
+{
+    test_matches_printf();
+    bench_formatters();
+    return host_test_result();
+}
@@ -0,0 +1,171 @@
+/* Airgradient Outdoor Sensor V1.1 firmware using ESP-IDF
+ * Copyright (C) 2023 Zach Strauss
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+#include <string.h>
+#include "host_test.h"
+#include "reading_fusion.h"
+
+/**
+ * Fusion tests with two aligned sensor streams, one of which drifts away from the other
+ */
+
+#define CYCLE (290)
+#define STAGGER_SPACING (CYCLE / 2)
+#define SLACK (30)
+#define CYCLES (100)
+
+static const char *const sensor_names[2] = {"SENS0", "SENS1"};
+
+static void make_reading(int sensor, uint16_t pm_2_5, pms5003T_reading_t *reading)
+{
+    memset(reading, 0, sizeof(*reading));
+    reading->standard.pm_1_0 = pm_2_5 / 2;
+    reading->standard.pm_2_5 = pm_2_5;
+    reading->standard.pm_10_0 = pm_2_5 + 5;
+    reading->atmospheric = reading->standard;
+    reading->raw_pm_0_3 = pm_2_5 * 60;
+    reading->raw_pm_0_5 = pm_2_5 * 20;
+    reading->raw_pm_1_0 = pm_2_5 * 4;
+    reading->raw_pm_2_5 = pm_2_5;
+    reading->temperature = -25;
+    reading->humidity = 450;
+    reading->sensor_id = (char *)sensor_names[sensor];
+}
+
+typedef struct {
+    int pairs;
+    int divergent_pairs;
+    int first_divergent_cycle;
+    int min_agreement;
+} fusion_run_t;
+
+/**
+ * Feed both sensors through fusion for CYCLES cycles
+ * @param spacing seconds SENS1 wakes after SENS0, 0 for the aligned schedule
+ * @param pair_window pair window handed to fusion
+ * @param drift_from cycle from which SENS1 reads high by drift_step per cycle, CYCLES for never
+ * @param skip_every SENS1 misses every skip_every-th burst, 0 for never
+ * @param run destination
+ */
+static void fusion_run(uint32_t spacing, uint32_t pair_window, int drift_from, int drift_step, int skip_every, fusion_run_t *run)
+{
+    reading_fusion_t fusion;
+    reading_fusion_init(&fusion, "SENS0", "SENS1", pair_window, 50);
+    memset(run, 0, sizeof(*run));
+    run->first_divergent_cycle = -1;
+    run->min_agreement = 100;
+
+    for (int cycle = 0; cycle < CYCLES; cycle++) {
+        uint16_t truth = 10 + (cycle % 7);
+        for (int sensor = 0; sensor < 2; sensor++) {
+            uint16_t pm_2_5 = truth;
+            if (sensor == 1 && cycle >= drift_from) {
+                pm_2_5 += (cycle - drift_from + 1) * drift_step;
+            }
+            if (sensor == 1 && skip_every && cycle % skip_every == 0) {
+                continue;
+            }
+            pms5003T_reading_t reading;
+            make_reading(sensor, pm_2_5, &reading);
+            /* A burst lands a few seconds after its slot, SENS1's up to 10 s after SENS0's */
+            uint32_t now = cycle * CYCLE + sensor * spacing + (cycle * 7) % 11 + sensor * ((cycle * 3) % 11);
+            reading_fusion_result_t result;
+            if (!reading_fusion_add(&fusion, &reading, now, &result)) {
+                continue;
+            }
+            run->pairs++;
+            HOST_CHECK(result.fused.standard.pm_2_5 >= truth);
+            if (result.agreement < run->min_agreement) {
+                run->min_agreement = result.agreement;
+            }
+            if (result.divergent) {
+                if (run->first_divergent_cycle < 0) {
+                    run->first_divergent_cycle = cycle;
+                }
+                run->divergent_pairs++;
+            }
+        }
+    }
+}
+
+static void test_aligned_pairing(void)
+{
+    fusion_run_t run;
+    /* Staggered sensors are half a cycle apart, outside the window, so they are never paired */
+    fusion_run(STAGGER_SPACING, SLACK, CYCLES, 0, 0, &run);
+    HOST_CHECK(run.pairs == 0);
+
+    fusion_run(0, SLACK, CYCLES, 0, 0, &run);
+    printf("agreeing streams: %d pairs in %d cycles, min agreement %d\n", run.pairs, CYCLES, run.min_agreement);
+    HOST_CHECK(run.pairs == CYCLES);
+    HOST_CHECK(run.divergent_pairs == 0);
+    HOST_CHECK(run.min_agreement == 100);
+
+    /* A missed burst costs its own pair and nothing else */
+    fusion_run(0, SLACK, CYCLES, 0, 10, &run);
+    HOST_CHECK(run.pairs == CYCLES - CYCLES / 10);
+}
+
+static void test_drifting_sensor(void)
+{
+    fusion_run_t run;
+    fusion_run(0, SLACK, 50, 2, 0, &run);
+    printf("drifting stream: %d pairs, %d divergent, first at cycle %d, min agreement %d\n", run.pairs,
+           run.divergent_pairs, run.first_divergent_cycle, run.min_agreement);
+    HOST_CHECK(run.pairs == CYCLES);
+    HOST_CHECK(run.first_divergent_cycle > 50);
+    HOST_CHECK(run.first_divergent_cycle < 60);
+    HOST_CHECK(run.divergent_pairs >= CYCLES - run.first_divergent_cycle - 1);
+    HOST_CHECK(run.min_agreement < 50);
+}
+
+static void test_divergent_channels(void)
+{
+    reading_fusion_t fusion;
+    reading_fusion_init(&fusion, "SENS0", "SENS1", SLACK, 50);
+
+    pms5003T_reading_t a, b;
+    reading_fusion_result_t result;
+    make_reading(0, 40, &a);
+    make_reading(1, 40, &b);
+    /* Only the coarse channel of a fouled sensor reads high, the noise floor hides small absolute steps */
+    b.standard.pm_10_0 = 200;
+    b.atmospheric.pm_10_0 = 200;
+    b.temperature = -23;
+    HOST_CHECK(!reading_fusion_add(&fusion, &a, 0, &result));
+    HOST_CHECK(reading_fusion_add(&fusion, &b, 1, &result));
+    HOST_CHECK(result.divergent == ((1 << 2) | (1 << 5)));
+    HOST_CHECK(strcmp(reading_fusion_channel_name(2), "standard/pm10.0") == 0);
+    HOST_CHECK(result.fused.standard.pm_10_0 == (45 + 200 + 1) / 2);
+    HOST_CHECK(result.fused.temperature == -24);
+
+    /* Readings from other sensors are ignored, a stale reading is dropped rather than paired */
+    pms5003T_reading_t other;
+    make_reading(0, 40, &other);
+    other.sensor_id = "SENS7";
+    HOST_CHECK(!reading_fusion_add(&fusion, &other, 2, &result));
+    HOST_CHECK(!reading_fusion_add(&fusion, &a, 10, &result));
+    HOST_CHECK(!reading_fusion_add(&fusion, &b, 10 + SLACK + 1, &result));
+    HOST_CHECK(reading_fusion_add(&fusion, &a, 10 + SLACK + 2, &result));
+}
+
+int main(void)
+{
+    test_aligned_pairing();
+    test_drifting_sensor();
+    test_divergent_channels();
+    return host_test_result();
+}
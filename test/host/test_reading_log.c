@@ -0,0 +1,193 @@
+/* Airgradient Outdoor Sensor V1.1 firmware using ESP-IDF
+ * Copyright (C) 2023 Zach Strauss
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+#include <string.h>
+#include "host_test.h"
+#include "esp_partition_file.h"
+#include "reading_log.h"
+
+/**
+ * Reading log tests against a file-backed partition with NOR flash write semantics.
+ * Opening the log again on the same file stands in for a reboot.
+ */
+
+#define LOG_LABEL "readings"
+#define LOG_SECTORS (3)
+#define LOG_SIZE (LOG_SECTORS * 4096)
+#define PEEK_MAX (512)
+
+static reading_log_entry_t entries[PEEK_MAX];
+
+static void make_reading(uint32_t index, pms5003T_reading_t *reading)
+{
+    memset(reading, 0, sizeof(*reading));
+    reading->standard.pm_2_5 = index & 0xFFFF;
+    reading->raw_pm_0_3 = (index * 7) & 0xFFFF;
+    reading->temperature = -(int16_t)(index % 300);
+    reading->humidity = 500;
+    reading->captured_at = PMS5003_CAPTURED_EPOCH_MIN + index;
+    reading->sensor_id = index % 2 ? "pm_b" : "pm_a";
+}
+
+/**
+ * @return true if entry holds what make_reading produced for index
+ */
+static bool entry_matches(const reading_log_entry_t *entry, uint32_t index)
+{
+    pms5003T_reading_t expected;
+    make_reading(index, &expected);
+    return entry->reading.standard.pm_2_5 == expected.standard.pm_2_5 &&
+           entry->reading.raw_pm_0_3 == expected.raw_pm_0_3 &&
+           entry->reading.temperature == expected.temperature &&
+           entry->reading.captured_at == expected.captured_at &&
+           strcmp(entry->reading.sensor_id, expected.sensor_id) == 0;
+}
+
+static void test_append_consume_reboot(void)
+{
+    esp_partition_file_create(LOG_LABEL, LOG_SIZE);
+    reading_log_handle_t log = reading_log_init(LOG_LABEL);
+    HOST_CHECK(log != NULL);
+    HOST_CHECK(reading_log_pending(log) == 0);
+    HOST_CHECK(reading_log_peek(log, entries, PEEK_MAX) == 0);
+
+    pms5003T_reading_t reading;
+    for (uint32_t i = 0; i < 10; i++) {
+        make_reading(i, &reading);
+        HOST_CHECK(reading_log_append(log, &reading) == ESP_OK);
+    }
+    HOST_CHECK(reading_log_pending(log) == 10);
+    int count = reading_log_peek(log, entries, 4);
+    HOST_CHECK(count == 4);
+    for (int i = 0; i < count; i++) {
+        HOST_CHECK(entries[i].sequence == (uint32_t)i);
+        HOST_CHECK(entry_matches(&entries[i], i));
+    }
+
+    HOST_CHECK(reading_log_consume(log, 4) == ESP_OK);
+    HOST_CHECK(reading_log_pending(log) == 5);
+
+    /* Readings counted from uptime in the last boot cannot be placed after a reboot */
+    reading.captured_at = 42;
+    HOST_CHECK(reading_log_append(log, &reading) == ESP_OK);
+
+    log = reading_log_init(LOG_LABEL);
+    HOST_CHECK(log != NULL);
+    HOST_CHECK(reading_log_pending(log) == 6);
+    count = reading_log_peek(log, entries, PEEK_MAX);
+    HOST_CHECK(count == 6);
+    HOST_CHECK(entries[0].sequence == 5);
+    HOST_CHECK(entry_matches(&entries[0], 5));
+    HOST_CHECK(entries[5].sequence == 10);
+    HOST_CHECK(entries[5].reading.captured_at == 0);
+
+    make_reading(11, &reading);
+    HOST_CHECK(reading_log_append(log, &reading) == ESP_OK);
+    count = reading_log_peek(log, entries, PEEK_MAX);
+    HOST_CHECK(count == 7);
+    HOST_CHECK(entries[6].sequence == 11);
+
+    HOST_CHECK(reading_log_consume(log, 11) == ESP_OK);
+    HOST_CHECK(reading_log_pending(log) == 0);
+    log = reading_log_init(LOG_LABEL);
+    HOST_CHECK(reading_log_pending(log) == 0);
+}
+
+static void test_wrap_drops_oldest_sector(void)
+{
+    esp_partition_file_create(LOG_LABEL, LOG_SIZE);
+    reading_log_handle_t log = reading_log_init(LOG_LABEL);
+
+    /* Fill past the end of the partition without forwarding anything */
+    pms5003T_reading_t reading;
+    uint32_t appended = 0;
+    while (appended < 2000) {
+        make_reading(appended, &reading);
+        HOST_CHECK(reading_log_append(log, &reading) == ESP_OK);
+        appended++;
+        if (reading_log_pending(log) < appended) {
+            break;
+        }
+    }
+    uint32_t slots = appended - 1;
+    printf("%u slots in %d sectors\n", slots, LOG_SECTORS);
+    HOST_CHECK(slots % LOG_SECTORS == 0);
+    uint32_t per_sector = slots / LOG_SECTORS;
+
+    for (uint32_t i = 0; i < per_sector; i++, appended++) {
+        make_reading(appended, &reading);
+        HOST_CHECK(reading_log_append(log, &reading) == ESP_OK);
+    }
+    uint32_t pending = reading_log_pending(log);
+    HOST_CHECK(pending == slots - per_sector + 1);
+
+    for (int boot = 0; boot < 2; boot++) {
+        int count = reading_log_peek(log, entries, PEEK_MAX);
+        HOST_CHECK(count == (int)pending);
+        HOST_CHECK(entries[0].sequence == appended - pending);
+        HOST_CHECK(entries[count - 1].sequence == appended - 1);
+        for (int i = 0; i < count; i++) {
+            HOST_CHECK(entry_matches(&entries[i], entries[i].sequence));
+        }
+        log = reading_log_init(LOG_LABEL);
+        HOST_CHECK(reading_log_pending(log) == pending);
+    }
+}
+
+static void test_torn_write(void)
+{
+    esp_partition_file_create(LOG_LABEL, LOG_SIZE);
+    reading_log_handle_t log = reading_log_init(LOG_LABEL);
+
+    pms5003T_reading_t reading;
+    for (uint32_t i = 0; i < 3; i++) {
+        make_reading(i, &reading);
+        HOST_CHECK(reading_log_append(log, &reading) == ESP_OK);
+    }
+    make_reading(3, &reading);
+    esp_partition_file_tear_next_write(10);
+    HOST_CHECK(reading_log_append(log, &reading) != ESP_OK);
+
+    /* Reset before anything else is written: the torn record is skipped, not replayed */
+    log = reading_log_init(LOG_LABEL);
+    HOST_CHECK(reading_log_pending(log) == 3);
+    make_reading(4, &reading);
+    HOST_CHECK(reading_log_append(log, &reading) == ESP_OK);
+
+    log = reading_log_init(LOG_LABEL);
+    int count = reading_log_peek(log, entries, PEEK_MAX);
+    HOST_CHECK(count == 4);
+    HOST_CHECK(entries[2].sequence == 2);
+    HOST_CHECK(entries[3].sequence == 3);
+    HOST_CHECK(entry_matches(&entries[3], 4));
+}
+
+static void test_missing_partition(void)
+{
+    esp_partition_file_create(LOG_LABEL, 4096);
+    HOST_CHECK(reading_log_init(LOG_LABEL) == NULL);
+    HOST_CHECK(reading_log_init("other") == NULL);
+}
+
+int main(void)
+{
+    test_append_consume_reboot();
+    test_wrap_drops_oldest_sector();
+    test_torn_write();
+    test_missing_partition();
+    esp_partition_file_close();
+    return host_test_result();
+}
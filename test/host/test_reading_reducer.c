@@ -0,0 +1,169 @@
+/* Airgradient Outdoor Sensor V1.1 firmware using ESP-IDF
+ * Copyright (C) 2023 Zach Strauss
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+#include <string.h>
+#include "host_test.h"
+#include "reading_reducer.h"
+
+/**
+ * Reducer tests and a benchmark of the cost of one reduction against packing every reading once per field
+ */
+
+#define BENCH_ROUNDS (5000)
+
+static const char *reduction_names[] = {"mean", "median", "trimmed mean"};
+
+static void make_burst(uint32_t seed, int count, uint16_t (*fields)[PMS5003_FIELD_COUNT],
+                       pms5003T_reading_t *readings)
+{
+    uint32_t rng = seed;
+    for (int i = 0; i < count; i++) {
+        for (int field = 0; field < PMS5003_FIELD_COUNT; field++) {
+            fields[i][field] = host_test_random(&rng) & 0xFFFF;
+        }
+        memset(&readings[i], 0, sizeof(readings[i]));
+        pms5003_reading_unpack(fields[i], &readings[i]);
+    }
+}
+
+/**
+ * The reduction as first written, packing every reading again for each of the 13 fields
+ */
+static void legacy_reduce(const pms5003T_reading_t *readings, int count, reading_reduction_t reduction,
+                          pms5003T_reading_t *result)
+{
+    uint16_t packed[PMS5003_FIELD_COUNT];
+    int32_t column[READING_REDUCER_MAX_COUNT];
+    uint16_t reduced[PMS5003_FIELD_COUNT];
+
+    for (int field = 0; field < PMS5003_FIELD_COUNT; field++) {
+        for (int i = 0; i < count; i++) {
+            pms5003_reading_pack(&readings[i], packed);
+            column[i] = field == PMS5003_FIELD_TEMPERATURE ? (int16_t)packed[field] : packed[field];
+        }
+        if (reduction != READING_REDUCE_MEAN) {
+            reading_reducer_sort(column, count);
+        }
+        int64_t sum = 0;
+        int start = reduction == READING_REDUCE_MEAN ? 0 : (count - 1) / 2;
+        int len = reduction == READING_REDUCE_MEAN ? count : 2 - (count & 1);
+        for (int i = start; i < start + len; i++) {
+            sum += column[i];
+        }
+        reduced[field] = (uint16_t)(sum / len);
+    }
+    pms5003_reading_unpack(reduced, result);
+}
+
+static void test_outlier_rejected(void)
+{
+    uint16_t fields[10][PMS5003_FIELD_COUNT];
+    for (int i = 0; i < 10; i++) {
+        for (int field = 0; field < PMS5003_FIELD_COUNT; field++) {
+            fields[i][field] = 100 + i;
+        }
+        fields[i][PMS5003_FIELD_TEMPERATURE] = (uint16_t)(-50 - i);
+    }
+    /* One frame that passed the checksum with garbage in it */
+    for (int field = 0; field < PMS5003_FIELD_COUNT; field++) {
+        fields[3][field] = 0xFFFF;
+    }
+
+    pms5003T_reading_t result;
+    reading_reduce(fields, 10, READING_REDUCE_MEAN, 0, &result);
+    HOST_CHECK(result.standard.pm_2_5 > 6000);
+    reading_reduce(fields, 10, READING_REDUCE_MEDIAN, 0, &result);
+    HOST_CHECK(result.standard.pm_2_5 == 106);
+    HOST_CHECK(result.temperature == -55);
+    reading_reduce(fields, 10, READING_REDUCE_TRIMMED_MEAN, 10, &result);
+    HOST_CHECK(result.standard.pm_2_5 == (101 + 102 + 104 + 105 + 106 + 107 + 108 + 109 + 4) / 8);
+    /* 0xFFFF is -1 as a temperature, the highest value rather than an outlier below */
+    HOST_CHECK(result.temperature == -54);
+
+    /* Trimming more than there is keeps the middle reading */
+    reading_reduce(fields, 10, READING_REDUCE_TRIMMED_MEAN, 60, &result);
+    HOST_CHECK(result.standard.pm_2_5 == 106);
+    reading_reduce(fields, 1, READING_REDUCE_TRIMMED_MEAN, 40, &result);
+    HOST_CHECK(result.standard.pm_2_5 == 100);
+}
+
+static void test_matches_legacy(void)
+{
+    uint16_t fields[READING_REDUCER_MAX_COUNT][PMS5003_FIELD_COUNT];
+    pms5003T_reading_t readings[READING_REDUCER_MAX_COUNT];
+    make_burst(0xD1CE, 9, fields, readings);
+
+    /* An odd count keeps the median free of rounding, so both must agree exactly */
+    pms5003T_reading_t expected, result;
+    uint16_t expected_fields[PMS5003_FIELD_COUNT], result_fields[PMS5003_FIELD_COUNT];
+    legacy_reduce(readings, 9, READING_REDUCE_MEDIAN, &expected);
+    reading_reduce(fields, 9, READING_REDUCE_MEDIAN, 0, &result);
+    pms5003_reading_pack(&expected, expected_fields);
+    pms5003_reading_pack(&result, result_fields);
+    HOST_CHECK(memcmp(expected_fields, result_fields, sizeof(result_fields)) == 0);
+}
+
+/**
+ * @return best CPU time of a few runs of BENCH_ROUNDS reductions, packing every reading per field or not
+ */
+static uint64_t bench_run(bool legacy, const uint16_t (*fields)[PMS5003_FIELD_COUNT],
+                          const pms5003T_reading_t *readings, int count, reading_reduction_t reduction)
+{
+    volatile uint16_t sink = 0;
+    uint64_t best = UINT64_MAX;
+    for (int run = 0; run < 5; run++) {
+        uint64_t start = host_test_cpu_ns();
+        for (int round = 0; round < BENCH_ROUNDS; round++) {
+            pms5003T_reading_t result;
+            if (legacy) {
+                legacy_reduce(readings, count, reduction, &result);
+            } else {
+                reading_reduce(fields, count, reduction, 0, &result);
+            }
+            sink += result.standard.pm_2_5;
+        }
+        uint64_t elapsed = host_test_cpu_ns() - start;
+        best = elapsed < best ? elapsed : best;
+    }
+    return best;
+}
+
+static void bench(int count)
+{
+    uint16_t fields[READING_REDUCER_MAX_COUNT][PMS5003_FIELD_COUNT];
+    pms5003T_reading_t readings[READING_REDUCER_MAX_COUNT];
+    make_burst(count, count, fields, readings);
+
+    for (int reduction = READING_REDUCE_MEAN; reduction <= READING_REDUCE_MEDIAN; reduction++) {
+        uint64_t legacy_ns = bench_run(true, fields, readings, count, reduction);
+        uint64_t packed_ns = bench_run(false, fields, readings, count, reduction);
+        printf("%2d readings %-12s %6.0f ns per reduction, %6.0f ns packing per field\n", count,
+               reduction_names[reduction], (double)packed_ns / BENCH_ROUNDS, (double)legacy_ns / BENCH_ROUNDS);
+        /* The median is dominated by the sort both share, only the mean is a fair check */
+        if (reduction == READING_REDUCE_MEAN) {
+            HOST_CHECK(packed_ns < legacy_ns);
+        }
+    }
+}
+
+int main(void)
+{
+    test_outlier_rejected();
+    test_matches_legacy();
+    bench(10);
+    bench(READING_REDUCER_MAX_COUNT);
+    return host_test_result();
+}
@@ -0,0 +1,247 @@
+/* Airgradient Outdoor Sensor V1.1 firmware using ESP-IDF
+ * Copyright (C) 2023 Zach Strauss
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+#include <pthread.h>
+#include <sched.h>
+#include <string.h>
+#include "host_test.h"
+#include "reading_ring.h"
+
+/**
+ * Hands readings between two threads through the reading ring, woken the way the driver and manager wake their
+ * consumers, and through a copying queue like the event loops the ring replaced.
+ *
+ * The ring side checks every reading arrives once and in order and that a consumer is never left asleep with
+ * readings waiting. Both sides report wall time per reading; the queue copies each reading in and out and signals
+ * the consumer every time, as esp_event_post_to() and the event loop task did.
+ */
+
+#define HANDOFF_READINGS (200000)
+#define WAIT_TIMEOUT_MS (200)
+
+/**
+ * Task notification of the consumer: a counter taken and cleared at once, as ulTaskNotifyTake(pdTRUE, ...)
+ */
+typedef struct {
+    pthread_mutex_t lock;
+    pthread_cond_t wake;
+    uint32_t count;
+} notify_t;
+
+static void notify_init(notify_t *notify)
+{
+    pthread_mutex_init(&notify->lock, NULL);
+    pthread_cond_init(&notify->wake, NULL);
+    notify->count = 0;
+}
+
+static void notify_give(notify_t *notify)
+{
+    pthread_mutex_lock(&notify->lock);
+    notify->count++;
+    pthread_cond_signal(&notify->wake);
+    pthread_mutex_unlock(&notify->lock);
+}
+
+/**
+ * @return false if nothing woke the consumer within WAIT_TIMEOUT_MS
+ */
+static bool notify_take(notify_t *notify)
+{
+    struct timespec until;
+    clock_gettime(CLOCK_REALTIME, &until);
+    until.tv_nsec += WAIT_TIMEOUT_MS * 1000000L;
+    until.tv_sec += until.tv_nsec / 1000000000L;
+    until.tv_nsec %= 1000000000L;
+
+    pthread_mutex_lock(&notify->lock);
+    int ret = 0;
+    while (!notify->count && ret == 0) {
+        ret = pthread_cond_timedwait(&notify->wake, &notify->lock, &until);
+    }
+    notify->count = 0;
+    pthread_mutex_unlock(&notify->lock);
+    return ret == 0;
+}
+
+typedef struct {
+    reading_ring_t ring;
+    notify_t notify;
+    uint32_t notifications; /*!< wake-ups the producer sent */
+    uint32_t full; /*!< times the producer found the ring full and had to yield */
+    uint32_t received;
+    uint32_t out_of_order;
+    uint32_t stalls; /*!< waits that timed out with readings in the ring */
+} ring_handoff_t;
+
+static void *ring_producer(void *arg)
+{
+    ring_handoff_t *handoff = arg;
+    for (uint32_t i = 0; i < HANDOFF_READINGS; i++) {
+        pms5003T_reading_t *slot;
+        while (!(slot = reading_ring_reserve(&handoff->ring))) {
+            handoff->full++;
+            sched_yield();
+        }
+        slot->received_at = i;
+        slot->standard.pm_2_5 = i & 0xFFFF;
+        if (reading_ring_commit(&handoff->ring)) {
+            handoff->notifications++;
+            notify_give(&handoff->notify);
+        }
+    }
+    return NULL;
+}
+
+/* The manager task's loop: wait for a notification, then drain the ring */
+static void *ring_consumer(void *arg)
+{
+    ring_handoff_t *handoff = arg;
+    const pms5003T_reading_t *reading;
+    while (handoff->received < HANDOFF_READINGS) {
+        bool woken = notify_take(&handoff->notify);
+        if (!woken && reading_ring_peek(&handoff->ring)) {
+            handoff->stalls++;
+        }
+        while ((reading = reading_ring_peek(&handoff->ring))) {
+            if (reading->received_at != handoff->received || reading->standard.pm_2_5 != (handoff->received & 0xFFFF)) {
+                handoff->out_of_order++;
+            }
+            handoff->received++;
+            reading_ring_release(&handoff->ring);
+        }
+    }
+    return NULL;
+}
+
+/**
+ * Bounded queue copying readings in and out under a lock, the hand over before the rings
+ */
+typedef struct {
+    pms5003T_reading_t slots[READING_RING_CAPACITY];
+    unsigned head;
+    unsigned tail;
+    pthread_mutex_t lock;
+    pthread_cond_t not_empty;
+    pthread_cond_t not_full;
+    uint32_t received;
+    uint32_t out_of_order;
+} queue_handoff_t;
+
+static void *queue_producer(void *arg)
+{
+    queue_handoff_t *queue = arg;
+    pms5003T_reading_t reading;
+    memset(&reading, 0, sizeof(reading));
+    for (uint32_t i = 0; i < HANDOFF_READINGS; i++) {
+        reading.received_at = i;
+        reading.standard.pm_2_5 = i & 0xFFFF;
+        pthread_mutex_lock(&queue->lock);
+        while (queue->head - queue->tail >= READING_RING_CAPACITY) {
+            pthread_cond_wait(&queue->not_full, &queue->lock);
+        }
+        queue->slots[queue->head++ % READING_RING_CAPACITY] = reading;
+        pthread_cond_signal(&queue->not_empty);
+        pthread_mutex_unlock(&queue->lock);
+    }
+    return NULL;
+}
+
+static void *queue_consumer(void *arg)
+{
+    queue_handoff_t *queue = arg;
+    pms5003T_reading_t reading;
+    while (queue->received < HANDOFF_READINGS) {
+        pthread_mutex_lock(&queue->lock);
+        while (queue->head == queue->tail) {
+            pthread_cond_wait(&queue->not_empty, &queue->lock);
+        }
+        reading = queue->slots[queue->tail++ % READING_RING_CAPACITY];
+        pthread_cond_signal(&queue->not_full);
+        pthread_mutex_unlock(&queue->lock);
+        if (reading.received_at != queue->received) {
+            queue->out_of_order++;
+        }
+        queue->received++;
+    }
+    return NULL;
+}
+
+static uint64_t run_pair(void *(*producer)(void *), void *(*consumer)(void *), void *arg)
+{
+    pthread_t producer_thread;
+    pthread_t consumer_thread;
+    uint64_t start = host_test_wall_ns();
+    pthread_create(&consumer_thread, NULL, consumer, arg);
+    pthread_create(&producer_thread, NULL, producer, arg);
+    pthread_join(producer_thread, NULL);
+    pthread_join(consumer_thread, NULL);
+    return host_test_wall_ns() - start;
+}
+
+static void test_ring_full(void)
+{
+    reading_ring_t ring;
+    reading_ring_init(&ring);
+    for (int i = 0; i < READING_RING_CAPACITY; i++) {
+        pms5003T_reading_t *slot = reading_ring_reserve(&ring);
+        HOST_CHECK(slot != NULL);
+        HOST_CHECK(reading_ring_reserve(&ring) == slot);
+        /* Only the commit into an empty ring needs to wake the consumer */
+        HOST_CHECK(reading_ring_commit(&ring) == (i == 0));
+    }
+    HOST_CHECK(reading_ring_reserve(&ring) == NULL);
+    atomic_fetch_add_explicit(&ring.dropped, 1, memory_order_relaxed);
+    HOST_CHECK(atomic_load(&ring.dropped) == 1);
+
+    HOST_CHECK(reading_ring_peek(&ring) != NULL);
+    reading_ring_release(&ring);
+    HOST_CHECK(reading_ring_reserve(&ring) != NULL);
+}
+
+static void bench_handoff(void)
+{
+    static ring_handoff_t ring_handoff;
+    reading_ring_init(&ring_handoff.ring);
+    notify_init(&ring_handoff.notify);
+    uint64_t ring_ns = run_pair(ring_producer, ring_consumer, &ring_handoff);
+
+    static queue_handoff_t queue;
+    pthread_mutex_init(&queue.lock, NULL);
+    pthread_cond_init(&queue.not_empty, NULL);
+    pthread_cond_init(&queue.not_full, NULL);
+    uint64_t queue_ns = run_pair(queue_producer, queue_consumer, &queue);
+
+    printf("ring    %7u readings %7.1f ns/reading, %u wake-ups, %u waits on a full ring, %u stalls\n",
+           ring_handoff.received, (double)ring_ns / HANDOFF_READINGS, ring_handoff.notifications, ring_handoff.full,
+           ring_handoff.stalls);
+    printf("queue   %7u readings %7.1f ns/reading, %zu bytes copied per reading\n",
+           queue.received, (double)queue_ns / HANDOFF_READINGS, 2 * sizeof(pms5003T_reading_t));
+
+    HOST_CHECK(ring_handoff.received == HANDOFF_READINGS);
+    HOST_CHECK(ring_handoff.out_of_order == 0);
+    HOST_CHECK(ring_handoff.stalls == 0);
+    HOST_CHECK(ring_handoff.notifications <= HANDOFF_READINGS);
+    HOST_CHECK(queue.received == HANDOFF_READINGS);
+    HOST_CHECK(queue.out_of_order == 0);
+}
+
+int main(void)
+{
+    test_ring_full();
+    bench_handoff();
+    return host_test_result();
+}